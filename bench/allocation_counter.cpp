@@ -0,0 +1,57 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+namespace
+{
+    // Количество динамических выделений памяти с момента запуска программы
+    size_t allocation_count = 0;
+}  // namespace
+
+void* operator new(size_t size)
+{
+    ++allocation_count;
+    if (void* ptr = malloc(size != 0 ? size : 1))
+    {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/) noexcept
+{
+    free(ptr);
+}
+
+namespace bench
+{
+
+    size_t AllocationCount()
+    {
+        return allocation_count;
+    }
+
+}  // namespace bench
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bench
+{
+
+    /*
+     * Возвращает количество динамических выделений памяти с момента запуска программы.
+     * Счётчик ведёт глобальный operator new из allocation_counter.cpp. Этот файл собирается
+     * только в программу замеров, поэтому интерпретатор mython выделяет память без счётчика
+     */
+    size_t AllocationCount();
+
+}  // namespace bench
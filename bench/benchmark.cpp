@@ -0,0 +1,334 @@
+#include "allocation_counter.h"
+
+#include "bytecode.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "statement.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/*
+* Замеры производительности интерпретатора.
+* Помимо времени выполнения считается количество динамических выделений памяти
+* (см. allocation_counter.h).
+*/
+
+namespace bench
+{
+
+    namespace
+    {
+        // Средние показатели одного прогона
+        struct Measurement
+        {
+            double allocations = 0;
+            double nanoseconds = 0;
+        };
+
+        template <typename Func>
+        Measurement Measure(size_t iterations, Func func)
+        {
+            const size_t allocations_before = AllocationCount();
+            const auto start = chrono::steady_clock::now();
+
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                func();
+            }
+
+            const auto duration = chrono::steady_clock::now() - start;
+            const size_t allocations = AllocationCount() - allocations_before;
+
+            Measurement result;
+            result.allocations = static_cast<double>(allocations) / iterations;
+            result.nanoseconds = static_cast<double>(
+                chrono::duration_cast<chrono::nanoseconds>(duration).count()) / iterations;
+            return result;
+        }
+
+        void Report(ostream& out, string_view name, const Measurement& measurement)
+        {
+            out << name << ": "sv << measurement.allocations << " allocations, "sv
+                << measurement.nanoseconds << " ns per run"sv << endl;
+        }
+
+        // Если optimize равен true, дерево программы упрощается оптимизатором (см. optimizer.h)
+        unique_ptr<runtime::Executable> ParseString(const string& program, bytecode::ExecutionMode mode,
+            bool optimize)
+        {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            if (optimize)
+                tree = optimizer::Optimize(move(tree));
+            return bytecode::Prepare(move(tree), mode);
+        }
+
+        // Выполняет программу setup, а затем многократно - программу program в том же окружении
+        Measurement MeasureProgram(const string& setup, const string& program, size_t iterations,
+            bytecode::ExecutionMode mode = bytecode::ExecutionMode::TREE, bool optimize = false)
+        {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            auto setup_tree = ParseString(setup, mode, optimize);
+            setup_tree->Execute(closure, context);
+
+            auto tree = ParseString(program, mode, optimize);
+            // Первый прогон заполняет closure и кеши, его не учитываем
+            tree->Execute(closure, context);
+
+            return Measure(iterations, [&tree, &closure, &context]
+                {
+                    tree->Execute(closure, context);
+                });
+        }
+
+        // Многократно выполняет программу program в одном и том же окружении
+        Measurement MeasureProgram(const string& program, size_t iterations)
+        {
+            return MeasureProgram({}, program, iterations);
+        }
+
+        void BenchArithmetics(ostream& out)
+        {
+            Report(out, "x = 1+2+3+4+5"sv, MeasureProgram("x = 1+2+3+4+5\n"s, 1'000'000));
+            Report(out, "x = 1*2*3*4*5 - 36/4/3 + 2*5+10/2"sv,
+                MeasureProgram("x = 1*2*3*4*5 - 36/4/3 + 2*5+10/2\n"s, 1'000'000));
+            Report(out, "x = 1 < 2 and not 3 > 4"sv,
+                MeasureProgram("x = 1 < 2 and not 3 > 4\n"s, 1'000'000));
+        }
+
+        void BenchVariables(ostream& out)
+        {
+            Report(out, "y = x + x + x + x"sv,
+                MeasureProgram("x = 1\ny = x + x + x + x\n"s, 1'000'000));
+        }
+
+        void BenchMethodCalls(ostream& out)
+        {
+#ifdef MYTHON_STATS
+            ast::MethodCall::ResetCacheStats();
+#endif
+            Report(out, "counter.add(1)"sv, MeasureProgram(R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(delta):
+    new_value = self.value + delta
+    self.value = new_value
+
+counter = Counter()
+counter.add(1)
+)"s, 1'000'000));
+
+            Report(out, "factorial(10)"sv, MeasureProgram(R"(
+class Math:
+  def factorial(n):
+    if n < 2:
+      return 1
+    return n * self.factorial(n - 1)
+
+m = Math()
+x = m.factorial(10)
+)"s, 100'000));
+
+#ifdef MYTHON_STATS
+            const auto& stats = ast::MethodCall::GetCacheStats();
+            out << "method call cache: "sv << stats.hits << " hits, "sv
+                << stats.misses << " misses"sv << endl;
+#endif
+        }
+
+        void BenchStrings(ostream& out)
+        {
+            Report(out, "s = s + 'piece' x 1000"sv, MeasureProgram(R"(
+class Builder:
+  def build(n, s):
+    if n == 0:
+      return s
+    return self.build(n - 1, s + 'piece')
+
+b = Builder()
+s = b.build(1000, '')
+)"s, 1'000));
+        }
+
+        // Возвращает программу, создающую экземпляры a и b класса Wide с field_count полями.
+        // Поля объекта b добавлены в обратном порядке, поэтому у a и b разные формы
+        string MakeWideObjects(size_t field_count)
+        {
+            ostringstream fill;
+            ostringstream fill_reversed;
+            for (size_t i = 0; i < field_count; ++i)
+            {
+                fill << "    self.f"sv << i << " = "sv << i << '\n';
+                fill_reversed << "    self.f"sv << field_count - 1 - i << " = "sv << i << '\n';
+            }
+
+            ostringstream program;
+            program << "class Wide:\n"sv
+                << "  def fill():\n"sv << fill.str()
+                << "  def fill_reversed():\n"sv << fill_reversed.str()
+                << "  def read_last(o):\n"sv
+                << "    return o.f"sv << field_count - 1 << '\n'
+                << "a = Wide()\na.fill()\nb = Wide()\nb.fill_reversed()\n"sv;
+            return program.str();
+        }
+
+        void BenchFieldReads(ostream& out)
+        {
+            for (size_t field_count : {4, 64, 512})
+            {
+                const string setup = MakeWideObjects(field_count);
+                const string last = "f"s + to_string(field_count - 1);
+
+                Report(out, "x = a.f0 + a."s + last + ", "s + to_string(field_count) + " fields"s,
+                    MeasureProgram(setup, "x = a.f0 + a."s + last + "\n"s, 1'000'000));
+                // Обращение к полю внутри read_last видит попеременно две формы
+                Report(out, "a.read_last(a) + a.read_last(b), "s + to_string(field_count) + " fields"s,
+                    MeasureProgram(setup, "x = a.read_last(a) + a.read_last(b)\n"s, 1'000'000));
+            }
+        }
+
+        // Сравнивает обход дерева и виртуальную машину на одних и тех же программах
+        void BenchBytecode(ostream& out)
+        {
+            const pair<string_view, string> programs[] = {
+                { "x = 1*2*3*4*5 - 36/4/3 + 2*5+10/2"sv, "x = 1*2*3*4*5 - 36/4/3 + 2*5+10/2\n"s },
+                { "x = 1 < 2 and not 3 > 4"sv, "x = 1 < 2 and not 3 > 4\n"s },
+                { "factorial(10)"sv, R"(
+class Math:
+  def factorial(n):
+    if n < 2:
+      return 1
+    return n * self.factorial(n - 1)
+
+m = Math()
+x = m.factorial(10)
+)"s },
+            };
+
+            for (const auto& [name, program] : programs)
+            {
+                for (auto mode : { bytecode::ExecutionMode::TREE, bytecode::ExecutionMode::BYTECODE })
+                {
+                    const string mode_name = mode == bytecode::ExecutionMode::TREE ? " [tree]"s : " [vm]"s;
+                    Report(out, string(name) + mode_name, MeasureProgram({}, program, 100'000, mode));
+                }
+            }
+        }
+
+        // Присваивания с изменением значения до и после замены оптимизатором на один узел
+        void BenchUpdates(ostream& out)
+        {
+            const string setup = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add():
+    self.value = self.value + 1
+
+c = Counter()
+x = 0
+)"s;
+            for (bool optimize : { false, true })
+            {
+                const string suffix = optimize ? " [fused]"s : " [plain]"s;
+                Report(out, "self.value = self.value + 1"s + suffix,
+                    MeasureProgram(setup, "c.add()\n"s, 1'000'000, bytecode::ExecutionMode::TREE, optimize));
+                Report(out, "x = x + 1"s + suffix,
+                    MeasureProgram(setup, "x = x + 1\n"s, 1'000'000, bytecode::ExecutionMode::TREE, optimize));
+            }
+        }
+
+        // Форматирование значений в print и str()
+        void BenchOutput(ostream& out)
+        {
+            const string setup = "n = 123456\nflag = True\n"s;
+            for (auto mode : { bytecode::ExecutionMode::TREE, bytecode::ExecutionMode::BYTECODE })
+            {
+                const string mode_name = mode == bytecode::ExecutionMode::TREE ? " [tree]"s : " [vm]"s;
+                Report(out, "print n, 'line', flag, None"s + mode_name,
+                    MeasureProgram(setup, "print n, 'line', flag, None\n"s, 1'000'000, mode));
+                Report(out, "s = str(n)"s + mode_name, MeasureProgram(setup, "s = str(n)\n"s, 1'000'000, mode));
+            }
+        }
+
+        // Возвращает программу из класса Generated с method_count методами и вызовов всех его методов
+        string MakeGeneratedProgram(size_t method_count)
+        {
+            ostringstream program;
+            program << "class Generated:\n"sv;
+            for (size_t i = 0; i < method_count; ++i)
+            {
+                program << "  def m"sv << i << "(a, b):\n"sv
+                    << "    x = a * "sv << i << " + b - 3\n"sv
+                    << "    if x > 10 and not a < b:\n"sv
+                    << "      return x / 2\n"sv
+                    << "    return x + 1\n"sv;
+            }
+            program << "g = Generated()\ny = 0\n"sv;
+            for (size_t i = 0; i < method_count; ++i)
+            {
+                program << "y = y + g.m"sv << i << "("sv << i << ", 2)\n"sv;
+            }
+            return program.str();
+        }
+
+        // Разбор и разрушение дерева большой сгенерированной программы
+        void BenchParsing(ostream& out)
+        {
+            constexpr size_t ITERATIONS = 200;
+            const string program = MakeGeneratedProgram(500);
+
+            vector<unique_ptr<ast::Statement>> trees;
+            trees.reserve(ITERATIONS);
+            Report(out, "parse 500 generated methods"sv, Measure(ITERATIONS, [&program, &trees]
+                {
+                    istringstream input(program);
+                    parse::Lexer lexer(input);
+                    trees.push_back(ParseProgram(lexer));
+                }));
+            Report(out, "destroy 500 generated methods"sv, Measure(ITERATIONS, [&trees]
+                {
+                    trees.pop_back();
+                }));
+            Report(out, "run 500 generated methods"sv,
+                MeasureProgram(program, 1'000));
+        }
+
+    }  // namespace
+
+    void RunBenchmarks(ostream& out)
+    {
+#ifdef MYTHON_STATS
+        ast::SpecializingOperation::ResetQuickeningStats();
+#endif
+        BenchArithmetics(out);
+        BenchVariables(out);
+#ifdef MYTHON_STATS
+        const auto& stats = ast::SpecializingOperation::GetQuickeningStats();
+        out << "quickening: "sv << stats.specializations << " specializations, "sv
+            << stats.deoptimizations << " deoptimizations"sv << endl;
+#endif
+        BenchMethodCalls(out);
+        BenchFieldReads(out);
+        BenchStrings(out);
+        BenchBytecode(out);
+        BenchUpdates(out);
+        BenchOutput(out);
+        BenchParsing(out);
+    }
+
+}  // namespace bench
@@ -0,0 +1,15 @@
+#include <iostream>
+
+using namespace std;
+
+namespace bench
+{
+    void RunBenchmarks(ostream& out);
+}  // namespace bench
+
+// Программа замеров производительности интерпретатора (см. benchmark.cpp)
+int main()
+{
+    bench::RunBenchmarks(cout);
+    return 0;
+}
@@ -0,0 +1,852 @@
+#include "bytecode.h"
+
+#include <array>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+
+// GCC и Clang поддерживают переходы по адресам меток (computed goto): каждая команда
+// виртуальной машины сама переходит к обработчику следующей, без общего switch
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_THREADED_DISPATCH
+#endif
+
+namespace bytecode
+{
+
+    using runtime::Closure;
+    using runtime::Context;
+    using runtime::ObjectHolder;
+
+
+    namespace
+    {
+        // Изменение глубины стека значений каждой командой, без учёта аргументов вызовов.
+        // RETURN не снимает значение с точки зрения компилятора: команды после return недостижимы,
+        // а инструкция return, как и остальные, оставляет на стеке одно значение
+        constexpr array<int, static_cast<size_t>(OpCode::COUNT)> STACK_EFFECT = {
+            1,   // PUSH_CONST
+            1,   // PUSH_NONE
+            -1,  // POP
+            1,   // LOAD_GLOBAL
+            0,   // STORE_GLOBAL
+            1,   // LOAD_LOCAL
+            0,   // STORE_LOCAL
+            0,   // READ_FIELD
+            -1,  // STORE_FIELD
+            0,   // DEFINE_CLASS_GLOBAL
+            0,   // DEFINE_CLASS_LOCAL
+            0,   // PRINT_SEPARATOR
+            -1,  // PRINT_VALUE
+            1,   // PRINT_NEWLINE
+            0,   // CALL_METHOD
+            0,   // TAIL_CALL
+            1,   // NEW_INSTANCE
+            0,   // STRINGIFY
+            1,   // UPDATE
+            -1,  // ADD
+            -1,  // SUB
+            -1,  // MULT
+            -1,  // DIV
+            -1,  // LESS
+            -1,  // GREATER
+            -1,  // EQUAL
+            -1,  // NOT_EQUAL
+            -1,  // LESS_OR_EQUAL
+            -1,  // GREATER_OR_EQUAL
+            -1,  // COMPARE_WITH
+            0,   // NOT
+            0,   // TO_BOOL
+            0,   // JUMP
+            -1,  // JUMP_IF_FALSE
+            -1,  // JUMP_IF_TRUE
+            0,   // RETURN
+        };
+
+        // Стек значений большинства фрагментов байт-кода помещается в массив на стеке вызовов.
+        // Массив невелик: Run вызывается рекурсивно при вызовах методов, не скомпилированных в байт-код
+        constexpr size_t INLINE_STACK_SIZE = 8;
+
+        const runtime::Symbol ADD_METHOD{ "__add__"sv };
+
+        // Что команда RETURN делает с результатом метода, вызванного без рекурсии
+        enum class ReturnAction : uint8_t
+        {
+            VALUE,        // результат занимает место объекта
+            TO_BOOL,      // результат метода сравнения приводится к True или False
+            FROM_CMP,     // результат __cmp__ становится результатом команды сравнения (см. runtime::FromCmp)
+            KEEP_OBJECT,  // результат __init__ отбрасывается, на месте объекта остаётся созданный экземпляр
+        };
+
+        // Кадр кода, вызвавшего метод без рекурсии: куда вернуться после RETURN
+        struct CallFrame
+        {
+            Chunk* chunk;
+            // Номер команды, с которой продолжится выполнение chunk
+            uint32_t return_offset;
+            // Индекс объекта, у которого вызван метод, в стеке значений. С него (а при KEEP_OBJECT -
+            // со следующей ячейки) начинается стек значений метода, а после возврата на его месте лежит результат
+            uint32_t object_index;
+            // Кадр локальных переменных вызвавшего кода (см. ValueStack::PushFrame)
+            uint32_t outer_locals;
+            ReturnAction action;
+        };
+
+        // Освобождает кадры локальных переменных методов, из которых не было возврата
+        // из-за исключения, и выводит начало строки print, прерванной исключением
+        struct FrameGuard
+        {
+            Context& context;
+            const vector<CallFrame>& frames;
+
+            ~FrameGuard()
+            {
+                for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+                {
+                    context.GetValueStack().PopFrame(it->outer_locals);
+                }
+                context.GetFormatBuffer().WriteTo(context.GetOutput());
+            }
+        };
+
+        // Переносит стек значений [stack, sp) в кучу так, чтобы над вершиной поместилось ещё depth значений.
+        // Обновляет stack и stack_end и возвращает новое положение вершины
+        ObjectHolder* GrowStack(vector<ObjectHolder>& heap_stack, ObjectHolder*& stack, ObjectHolder*& stack_end,
+            ObjectHolder* sp, size_t depth)
+        {
+            const size_t used = static_cast<size_t>(sp - stack);
+            vector<ObjectHolder> grown(max(2 * static_cast<size_t>(stack_end - stack), used + depth));
+            move(stack, sp, grown.begin());
+            heap_stack = move(grown);
+
+            stack = heap_stack.data();
+            stack_end = stack + heap_stack.size();
+            return stack + used;
+        }
+
+        // Сохраняет в frames кадр кода caller, вызвавшего метод method у объекта в ячейке object стека stack,
+        // и переносит объект и аргументы [object + 1, args_end) в новый кадр локальных переменных.
+        // После RETURN результат обрабатывается согласно action, а выполнение caller продолжается
+        // с команды return_offset. Возвращает ячейку, с которой начинается стек значений метода
+        ObjectHolder* PushCall(vector<CallFrame>& frames, Context& context, const runtime::Method& method,
+            Chunk* caller, uint32_t return_offset, ObjectHolder* stack, ObjectHolder* object,
+            ObjectHolder* args_end, ReturnAction action)
+        {
+            if (frames.size() >= context.GetCallLimits().max_vm_depth)
+                throw runtime_error("bytecode::Run: Maximum recursion depth exceeded"s);
+
+            runtime::ValueStack& locals = context.GetValueStack();
+            const size_t outer_locals = locals.PushFrame(method.frame_size);
+            frames.push_back({ caller, return_offset, static_cast<uint32_t>(object - stack),
+                static_cast<uint32_t>(outer_locals), action });
+            const bool keep_object = action == ReturnAction::KEEP_OBJECT;
+            locals.Local(0) = keep_object ? *object : move(*object);
+            for (ObjectHolder* arg = object + 1; arg < args_end; ++arg)
+            {
+                locals.Local(static_cast<size_t>(arg - object)) = move(*arg);
+            }
+            return keep_object ? object + 1 : object;
+        }
+
+        // Возвращает байт-код тела метода method, если виртуальная машина может выполнить его
+        // без рекурсии, либо nullptr
+        Chunk* CompiledChunk(const runtime::Method* method)
+        {
+            if (method == nullptr || method->frame_size == 0)
+                return nullptr;
+            auto* body = dynamic_cast<CompiledStatement*>(method->body.get());
+            return body != nullptr ? &body->GetChunk() : nullptr;
+        }
+
+        // Возвращает метод __str__, которым выводится значение object, либо nullptr
+        const runtime::Method* StrMethodOf(const ObjectHolder& object)
+        {
+            const auto* instance = object.TryAs<runtime::ClassInstance>();
+            return instance != nullptr ? instance->GetStrMethod() : nullptr;
+        }
+
+        // Возвращает метод __add__, которым к значению lhs прибавляется другое, либо nullptr
+        const runtime::Method* AddMethodOf(const ObjectHolder& lhs)
+        {
+            const auto* instance = lhs.TryAs<runtime::ClassInstance>();
+            return instance != nullptr ? instance->GetClass().GetMethod(ADD_METHOD, 1) : nullptr;
+        }
+
+        // Возвращает методы, которыми сравнивает объекты команда сравнения op
+        const runtime::ComparisonMethods& ComparisonMethodsOf(OpCode op)
+        {
+            switch (op)
+            {
+            case OpCode::LESS:
+                return runtime::LESS_METHODS;
+            case OpCode::GREATER:
+                return runtime::GREATER_METHODS;
+            case OpCode::EQUAL:
+                return runtime::EQUAL_METHODS;
+            case OpCode::NOT_EQUAL:
+                return runtime::NOT_EQUAL_METHODS;
+            case OpCode::LESS_OR_EQUAL:
+                return runtime::LESS_OR_EQUAL_METHODS;
+            default:
+                return runtime::GREATER_OR_EQUAL_METHODS;
+            }
+        }
+
+        // Находит метод call, которым сравниваются значения sp[-2] и sp[-1] (см. runtime::FindComparisonCall).
+        // Если метод выполняется без рекурсии, ставит его объект в ячейку sp[-2] и возвращает байт-код метода,
+        // иначе возвращает nullptr
+        Chunk* PrepareComparison(ObjectHolder* sp, const runtime::ComparisonMethods& methods,
+            runtime::ComparisonCall& call)
+        {
+            if (sp[-2].GetKind() != runtime::Object::Kind::CLASS_INSTANCE
+                && sp[-1].GetKind() != runtime::Object::Kind::CLASS_INSTANCE)
+                return nullptr;
+
+            call = runtime::FindComparisonCall(sp[-2], sp[-1], methods);
+            Chunk* body = CompiledChunk(call.method);
+            if (body != nullptr && call.reflected)
+                swap(sp[-2], sp[-1]);
+            return body;
+        }
+
+        // Вызывает метод method объекта instance рекурсией C++ с аргументами [args, sp) и освобождает их.
+        // Вектор аргументов создаётся здесь, а не в кадре Run, который есть у каждого уровня такой рекурсии
+        ObjectHolder CallNative(runtime::ClassInstance& instance, const runtime::Method& method,
+            ObjectHolder* args, ObjectHolder* sp, Context& context)
+        {
+            vector<ObjectHolder> actual_args(make_move_iterator(args), make_move_iterator(sp));
+            return instance.Call(method, actual_args, context);
+        }
+
+        // Создаёт экземпляр класса узлом node с аргументами [args, sp) и освобождает их
+        ObjectHolder Instantiate(ast::NewInstance& node, ObjectHolder* args, ObjectHolder* sp, Context& context)
+        {
+            vector<ObjectHolder> actual_args(make_move_iterator(args), make_move_iterator(sp));
+            return node.Instantiate(actual_args, context);
+        }
+
+        const runtime::Number* AsNumber(const ObjectHolder& object)
+        {
+            return object.TryAs<runtime::Number>();
+        }
+
+        // Числа сравниваются напрямую, остальные значения - функциями из runtime
+        template <ast::ComparisonOperator Op>
+        bool Compare(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+        {
+            using ast::ComparisonOperator;
+
+            const runtime::Number* lhs_number = AsNumber(lhs);
+            const runtime::Number* rhs_number = AsNumber(rhs);
+            if (lhs_number != nullptr && rhs_number != nullptr)
+            {
+                const int l = lhs_number->GetValue();
+                const int r = rhs_number->GetValue();
+                if constexpr (Op == ComparisonOperator::LESS)
+                    return l < r;
+                else if constexpr (Op == ComparisonOperator::GREATER)
+                    return l > r;
+                else if constexpr (Op == ComparisonOperator::EQUAL)
+                    return l == r;
+                else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+                    return l != r;
+                else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+                    return l <= r;
+                else
+                    return l >= r;
+            }
+
+            if constexpr (Op == ComparisonOperator::LESS)
+                return runtime::Less(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::GREATER)
+                return runtime::Greater(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::EQUAL)
+                return runtime::Equal(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+                return runtime::NotEqual(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+                return runtime::LessOrEqual(lhs, rhs, context);
+            else
+                return runtime::GreaterOrEqual(lhs, rhs, context);
+        }
+    }  // namespace
+
+
+
+    /***************   Compiler   ***************/
+
+    Chunk Compiler::CompileStatement(ast::Statement& statement)
+    {
+        Compiler compiler;
+        compiler.Compile(&statement);
+        compiler.Emit(OpCode::RETURN);
+        return move(compiler.chunk_);
+    }
+
+
+    void Compiler::CompileMethods(runtime::Class& cls)
+    {
+        cls.ForEachOwnMethod([](runtime::Method& method)
+            {
+                auto* body = dynamic_cast<ast::Statement*>(method.body.get());
+                if (body == nullptr)
+                    return;
+
+                method.body.release();
+                method.body = make_unique<CompiledStatement>(unique_ptr<ast::Statement>(body));
+            });
+    }
+
+
+    void Compiler::Compile(ast::Statement* node)
+    {
+        if (node == nullptr)
+            throw runtime_error("Compiler::Compile: Null pointer"s);
+        node->Compile(*this);
+    }
+
+
+    void Compiler::Emit(OpCode op, uint32_t operand, size_t argument_count)
+    {
+        chunk_.code.push_back({ op, operand });
+
+        stack_depth_ = stack_depth_ + STACK_EFFECT[static_cast<size_t>(op)] - argument_count;
+        chunk_.max_stack_depth = max(chunk_.max_stack_depth, stack_depth_);
+    }
+
+
+    void Compiler::EmitConstant(ObjectHolder value)
+    {
+        chunk_.constants.push_back(move(value));
+        Emit(OpCode::PUSH_CONST, static_cast<uint32_t>(chunk_.constants.size() - 1));
+    }
+
+
+    size_t Compiler::EmitJump(OpCode op)
+    {
+        Emit(op);
+        return chunk_.code.size() - 1;
+    }
+
+
+    void Compiler::PatchJump(size_t jump)
+    {
+        chunk_.code[jump].operand = static_cast<uint32_t>(chunk_.code.size());
+    }
+
+
+    uint32_t Compiler::AddName(runtime::Symbol name)
+    {
+        chunk_.names.push_back(name);
+        return static_cast<uint32_t>(chunk_.names.size() - 1);
+    }
+
+
+    uint32_t Compiler::AddFieldRead(ast::VariableValue& variable, size_t index)
+    {
+        chunk_.field_reads.push_back({ &variable, index });
+        return static_cast<uint32_t>(chunk_.field_reads.size() - 1);
+    }
+
+
+    uint32_t Compiler::AddCall(ast::Statement& node, size_t argument_count)
+    {
+        chunk_.calls.push_back({ &node, argument_count });
+        return static_cast<uint32_t>(chunk_.calls.size() - 1);
+    }
+
+
+    uint32_t Compiler::AddNode(ast::Statement& node)
+    {
+        chunk_.nodes.push_back(&node);
+        return static_cast<uint32_t>(chunk_.nodes.size() - 1);
+    }
+
+
+
+    /***************   Run   ***************/
+
+    ObjectHolder Run(Chunk& chunk, Closure& closure, Context& context)
+    {
+        array<ObjectHolder, INLINE_STACK_SIZE> inline_stack;
+        vector<ObjectHolder> heap_stack;
+        ObjectHolder* stack = inline_stack.data();
+        ObjectHolder* stack_end = stack + INLINE_STACK_SIZE;
+        ObjectHolder* sp = stack;
+        if (chunk.max_stack_depth > INLINE_STACK_SIZE)
+            sp = GrowStack(heap_stack, stack, stack_end, sp, chunk.max_stack_depth);
+
+        // Методы, скомпилированные в байт-код, выполняются в этом же цикле: вызов сохраняет
+        // кадр вызывающего кода в frames и переключается на байт-код метода, а RETURN возвращается
+        // по сохранённому кадру. Так же вызываются операторы, сравнения, str(), print и __init__,
+        // если их метод скомпилирован. Глубина рекурсии Mython ограничена размером кучи, а не стека процесса
+        vector<CallFrame> frames;
+        const FrameGuard frame_guard{ context, frames };
+
+        Chunk* current = &chunk;
+        Closure* scope = &closure;
+        const Instruction* code = current->code.data();
+        const Instruction* ip = code;
+        // Метод, которым команда сравнения сравнивает объекты (см. PrepareComparison). Одна переменная
+        // на все команды сравнения не увеличивает кадр Run, который есть у каждого уровня рекурсии C++
+        runtime::ComparisonCall comparison;
+
+#ifdef MYTHON_THREADED_DISPATCH
+        // Порядок меток совпадает с порядком команд в OpCode
+        static const void* const LABELS[] = {
+            &&PUSH_CONST, &&PUSH_NONE, &&POP,
+            &&LOAD_GLOBAL, &&STORE_GLOBAL, &&LOAD_LOCAL, &&STORE_LOCAL, &&READ_FIELD, &&STORE_FIELD,
+            &&DEFINE_CLASS_GLOBAL, &&DEFINE_CLASS_LOCAL,
+            &&PRINT_SEPARATOR, &&PRINT_VALUE, &&PRINT_NEWLINE,
+            &&CALL_METHOD, &&TAIL_CALL, &&NEW_INSTANCE, &&STRINGIFY, &&UPDATE,
+            &&ADD, &&SUB, &&MULT, &&DIV,
+            &&LESS, &&GREATER, &&EQUAL, &&NOT_EQUAL, &&LESS_OR_EQUAL, &&GREATER_OR_EQUAL, &&COMPARE_WITH,
+            &&NOT, &&TO_BOOL,
+            &&JUMP, &&JUMP_IF_FALSE, &&JUMP_IF_TRUE,
+            &&RETURN,
+        };
+        static_assert(size(LABELS) == static_cast<size_t>(OpCode::COUNT));
+
+// Вычисляемый goto не вызывает деструкторы локальных переменных блока, из которого выходит,
+// поэтому обработчики разрушают свои локальные переменные до DISPATCH во вложенном блоке
+#define DISPATCH() goto* LABELS[static_cast<size_t>(ip->op)]
+#define CASE(op) op:
+#else
+#define DISPATCH() continue
+#define CASE(op) case OpCode::op:
+#endif
+#define NEXT() { ++ip; DISPATCH(); }
+// Переключается на байт-код body, стек значений которого начинается с ячейки base
+#define SWITCH_TO(body, base)                                                                \
+        {                                                                                    \
+            current = &(body);                                                               \
+            scope = &context.GetValueStack().EmptyClosure();                                 \
+            code = current->code.data();                                                     \
+            ip = code;                                                                       \
+            sp = (base);                                                                     \
+            if (static_cast<size_t>(stack_end - sp) < current->max_stack_depth)              \
+                sp = GrowStack(heap_stack, stack, stack_end, sp, current->max_stack_depth);  \
+            DISPATCH();                                                                      \
+        }
+// Вызывает без рекурсии метод method с байт-кодом body у объекта в ячейке object (см. PushCall).
+// После возврата выполнение продолжится с команды return_ip
+#define ENTER(method, body, object, action, return_ip)                                       \
+        {                                                                                    \
+            ObjectHolder* callee_base = PushCall(frames, context, (method), current,         \
+                static_cast<uint32_t>((return_ip) - code), stack, (object), sp, (action));   \
+            SWITCH_TO(body, callee_base);                                                    \
+        }
+
+#ifdef MYTHON_THREADED_DISPATCH
+        DISPATCH();
+#else
+        for (;;)
+        {
+            switch (ip->op)
+            {
+#endif
+
+        CASE(PUSH_CONST)
+        {
+            *sp++ = current->constants[ip->operand];
+            NEXT();
+        }
+        CASE(PUSH_NONE)
+        {
+            *sp++ = ObjectHolder::None();
+            NEXT();
+        }
+        CASE(POP)
+        {
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+
+        CASE(LOAD_GLOBAL)
+        {
+            auto it = scope->find(current->names[ip->operand]);
+            if (it == scope->end())
+                throw runtime_error("VariableValue::Execute: There is no value with the given name"s);
+            *sp++ = it->second;
+            NEXT();
+        }
+        CASE(STORE_GLOBAL)
+        {
+            (*scope)[current->names[ip->operand]] = sp[-1];
+            NEXT();
+        }
+        CASE(LOAD_LOCAL)
+        {
+            const ObjectHolder& local = context.GetValueStack().Local(ip->operand);
+            if (local.IsUnassigned())
+                throw runtime_error("VariableValue::Execute: There is no value with the given name"s);
+            *sp++ = local;
+            NEXT();
+        }
+        CASE(STORE_LOCAL)
+        {
+            context.GetValueStack().Local(ip->operand) = sp[-1];
+            NEXT();
+        }
+        CASE(READ_FIELD)
+        {
+            const FieldRead& read = current->field_reads[ip->operand];
+            sp[-1] = read.variable->ReadField(sp[-1], read.index);
+            NEXT();
+        }
+        CASE(STORE_FIELD)
+        {
+            {
+                auto* node = static_cast<ast::FieldAssignment*>(current->nodes[ip->operand]);
+                ObjectHolder value = move(*--sp);
+                sp[-1] = node->Assign(sp[-1], move(value));
+            }
+            NEXT();
+        }
+
+        CASE(DEFINE_CLASS_GLOBAL)
+        {
+            const ObjectHolder& defined = scope->emplace(current->names[ip->operand], sp[-1]).first->second;
+            sp[-1] = defined;
+            NEXT();
+        }
+        CASE(DEFINE_CLASS_LOCAL)
+        {
+            ObjectHolder& local = context.GetValueStack().Local(ip->operand);
+            if (local.IsUnassigned())
+                local = sp[-1];
+            sp[-1] = local;
+            NEXT();
+        }
+
+        CASE(PRINT_SEPARATOR)
+        {
+            context.GetFormatBuffer().Append(' ');
+            NEXT();
+        }
+        CASE(PRINT_VALUE)
+        {
+            const runtime::Method* str = StrMethodOf(sp[-1]);
+            if (Chunk* body = CompiledChunk(str))
+            {
+                // Вывод самого __str__ следует за уже выведенным началом строки,
+                // а его результат выводит эта же команда после возврата
+                context.GetFormatBuffer().WriteTo(context.GetOutput());
+                ENTER(*str, *body, sp - 1, ReturnAction::VALUE, ip);
+            }
+            {
+                ObjectHolder value = move(*--sp);
+                runtime::FormatBuffer& buffer = context.GetFormatBuffer();
+                if (!buffer.TryAppend(value))
+                {
+                    buffer.WriteTo(context.GetOutput());
+                    value->Print(context.GetOutputStream(), context);
+                }
+            }
+            NEXT();
+        }
+        CASE(PRINT_NEWLINE)
+        {
+            runtime::FormatBuffer& buffer = context.GetFormatBuffer();
+            buffer.Append('\n');
+            buffer.WriteTo(context.GetOutput());
+            *sp++ = ObjectHolder::None();
+            NEXT();
+        }
+
+        CASE(TAIL_CALL)
+        CASE(CALL_METHOD)
+        {
+            const CallSite& call = current->calls[ip->operand];
+            ObjectHolder* args = sp - call.argument_count;
+            runtime::ClassInstance* instance = args[-1].TryAs<runtime::ClassInstance>();
+            if (instance == nullptr)
+                throw runtime_error("MethodCall::Execute: Method call on non-object"s);
+            const runtime::Method& method
+                = static_cast<ast::MethodCall*>(call.node)->FindMethod(instance->GetClass());
+
+            Chunk* body = CompiledChunk(&method);
+            if (body == nullptr)
+            {
+                args[-1] = CallNative(*instance, method, args, sp, context);
+                sp = args;
+                NEXT();
+            }
+
+            // Объект переходит в ячейку self кадра метода, а стек значений метода начинается
+            // на его месте в стеке вызвавшего кода: туда RETURN положит результат
+            runtime::ValueStack& locals = context.GetValueStack();
+            ObjectHolder* object = args - 1;
+            if (ip->op != OpCode::TAIL_CALL || frames.empty()
+                || !runtime::CanReplaceCall(locals.Local(0).Get(), *object, args, sp))
+            {
+                ENTER(method, *body, object, ReturnAction::VALUE, ip + 1);
+            }
+
+            {
+                // Вызываемый метод занимает кадр текущего, а значения текущего метода освобождаются
+                ObjectHolder self = locals.Local(0).Get() == instance ? move(locals.Local(0)) : move(*object);
+                locals.PopFrame(frames.back().outer_locals);
+                static_cast<void>(locals.PushFrame(method.frame_size));
+                locals.Local(0) = move(self);
+                for (size_t i = 0; i < call.argument_count; ++i)
+                {
+                    locals.Local(i + 1) = move(args[i]);
+                }
+            }
+            // Кадр заменяемого метода сохраняет его действие при возврате и начало стека значений
+            const CallFrame& caller = frames.back();
+            ObjectHolder* base = stack + caller.object_index + (caller.action == ReturnAction::KEEP_OBJECT ? 1 : 0);
+            for (ObjectHolder* slot = base; slot < sp; ++slot)
+            {
+                *slot = ObjectHolder::None();
+            }
+            SWITCH_TO(*body, base);
+        }
+        CASE(NEW_INSTANCE)
+        {
+            const CallSite& call = current->calls[ip->operand];
+            auto& node = *static_cast<ast::NewInstance*>(call.node);
+            const runtime::Method* init = node.GetInitializer();
+            Chunk* body = CompiledChunk(init);
+            if (body == nullptr)
+            {
+                ObjectHolder* args = sp - call.argument_count;
+                *args = Instantiate(node, args, sp, context);
+                sp = args + 1;
+                NEXT();
+            }
+
+            // Созданный экземпляр занимает ячейку перед аргументами и остаётся в ней после __init__
+            if (sp == stack_end)
+                sp = GrowStack(heap_stack, stack, stack_end, sp, 1);
+            ObjectHolder* object = sp - call.argument_count;
+            move_backward(object, sp, sp + 1);
+            *object = node.Create();
+            ++sp;
+            ENTER(*init, *body, object, ReturnAction::KEEP_OBJECT, ip + 1);
+        }
+        CASE(STRINGIFY)
+        {
+            // Результат __str__ заменяет объект, и команда выполняется снова уже над ним
+            const runtime::Method* str = StrMethodOf(sp[-1]);
+            if (Chunk* body = CompiledChunk(str))
+            {
+                ENTER(*str, *body, sp - 1, ReturnAction::VALUE, ip);
+            }
+            sp[-1] = ast::Stringify::Apply(sp[-1], context);
+            NEXT();
+        }
+        CASE(UPDATE)
+        {
+            *sp++ = current->nodes[ip->operand]->Execute(*scope, context);
+            NEXT();
+        }
+
+        CASE(ADD)
+        {
+            const runtime::Number* lhs = AsNumber(sp[-2]);
+            const runtime::Number* rhs = AsNumber(sp[-1]);
+            if (lhs != nullptr && rhs != nullptr)
+            {
+                sp[-2] = ObjectHolder::Own(runtime::Number(lhs->GetValue() + rhs->GetValue()));
+            }
+            else
+            {
+                const runtime::Method* add = AddMethodOf(sp[-2]);
+                if (Chunk* body = CompiledChunk(add))
+                {
+                    ENTER(*add, *body, sp - 2, ReturnAction::VALUE, ip + 1);
+                }
+                sp[-2] = ast::Add::Apply(sp[-2], sp[-1], context);
+            }
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+        CASE(SUB)
+        {
+            const runtime::Number* lhs = AsNumber(sp[-2]);
+            const runtime::Number* rhs = AsNumber(sp[-1]);
+            if (lhs == nullptr || rhs == nullptr)
+                throw runtime_error("Sub: Error when subtracting two values."s);
+            sp[-2] = ObjectHolder::Own(runtime::Number(lhs->GetValue() - rhs->GetValue()));
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+        CASE(MULT)
+        {
+            const runtime::Number* lhs = AsNumber(sp[-2]);
+            const runtime::Number* rhs = AsNumber(sp[-1]);
+            if (lhs == nullptr || rhs == nullptr)
+                throw runtime_error("Mult: Error while multiplying two numbers."s);
+            sp[-2] = ObjectHolder::Own(runtime::Number(lhs->GetValue() * rhs->GetValue()));
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+        CASE(DIV)
+        {
+            const runtime::Number* lhs = AsNumber(sp[-2]);
+            const runtime::Number* rhs = AsNumber(sp[-1]);
+            if (lhs == nullptr || rhs == nullptr || rhs->GetValue() == 0)
+                throw runtime_error("Div: Error when dividing two values."s);
+            sp[-2] = ObjectHolder::Own(runtime::Number(lhs->GetValue() / rhs->GetValue()));
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+
+#define MYTHON_COMPARISON(op)                                                                \
+        CASE(op)                                                                             \
+        {                                                                                    \
+            if (AsNumber(sp[-2]) == nullptr || AsNumber(sp[-1]) == nullptr)                  \
+            {                                                                                \
+                if (Chunk* body = PrepareComparison(sp, runtime::op##_METHODS, comparison))  \
+                {                                                                            \
+                    ENTER(*comparison.method, *body, sp - 2, comparison.three_way            \
+                        ? ReturnAction::FROM_CMP : ReturnAction::TO_BOOL, ip + 1);           \
+                }                                                                            \
+            }                                                                                \
+            sp[-2] = ObjectHolder::FromBool(                                                 \
+                Compare<ast::ComparisonOperator::op>(sp[-2], sp[-1], context));              \
+            *--sp = ObjectHolder::None();                                                    \
+            NEXT();                                                                          \
+        }
+
+        MYTHON_COMPARISON(LESS)
+        MYTHON_COMPARISON(GREATER)
+        MYTHON_COMPARISON(EQUAL)
+        MYTHON_COMPARISON(NOT_EQUAL)
+        MYTHON_COMPARISON(LESS_OR_EQUAL)
+        MYTHON_COMPARISON(GREATER_OR_EQUAL)
+#undef MYTHON_COMPARISON
+
+        CASE(COMPARE_WITH)
+        {
+            const auto* node = static_cast<const ast::Comparison*>(current->nodes[ip->operand]);
+            sp[-2] = ObjectHolder::FromBool(node->GetComparator()(sp[-2], sp[-1], context));
+            *--sp = ObjectHolder::None();
+            NEXT();
+        }
+
+        CASE(NOT)
+        {
+            sp[-1] = ObjectHolder::FromBool(!runtime::IsTrue(sp[-1]));
+            NEXT();
+        }
+        CASE(TO_BOOL)
+        {
+            sp[-1] = ObjectHolder::FromBool(runtime::IsTrue(sp[-1]));
+            NEXT();
+        }
+
+        CASE(JUMP)
+        {
+            ip = code + ip->operand;
+            DISPATCH();
+        }
+        CASE(JUMP_IF_FALSE)
+        {
+            const bool condition = runtime::IsTrue(*--sp);
+            *sp = ObjectHolder::None();
+            if (!condition)
+            {
+                ip = code + ip->operand;
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(JUMP_IF_TRUE)
+        {
+            const bool condition = runtime::IsTrue(*--sp);
+            *sp = ObjectHolder::None();
+            if (condition)
+            {
+                ip = code + ip->operand;
+                DISPATCH();
+            }
+            NEXT();
+        }
+
+        CASE(RETURN)
+        {
+            if (frames.empty())
+                return move(*--sp);
+
+            // Результат метода занимает в стеке вызывающего кода место объекта
+            const CallFrame& caller = frames.back();
+            ObjectHolder* result = stack + caller.object_index;
+            --sp;
+            switch (caller.action)
+            {
+            case ReturnAction::VALUE:
+                if (sp != result)
+                    *result = move(*sp);
+                break;
+            case ReturnAction::TO_BOOL:
+                *result = ObjectHolder::FromBool(runtime::IsTrue(*sp));
+                break;
+            case ReturnAction::FROM_CMP:
+                *result = ObjectHolder::FromBool(runtime::FromCmp(*sp,
+                    ComparisonMethodsOf(caller.chunk->code[caller.return_offset - 1].op)));
+                break;
+            case ReturnAction::KEEP_OBJECT:
+                break;
+            }
+            for (ObjectHolder* slot = result + 1; slot <= sp; ++slot)
+            {
+                *slot = ObjectHolder::None();
+            }
+            context.GetValueStack().PopFrame(caller.outer_locals);
+
+            current = caller.chunk;
+            code = current->code.data();
+            ip = code + caller.return_offset;
+            sp = result + 1;
+            frames.pop_back();
+            if (frames.empty())
+                scope = &closure;
+            DISPATCH();
+        }
+
+#ifndef MYTHON_THREADED_DISPATCH
+            default:
+                throw runtime_error("bytecode::Run: Unknown instruction"s);
+            }
+        }
+#endif
+
+#undef ENTER
+#undef SWITCH_TO
+#undef NEXT
+#undef CASE
+#undef DISPATCH
+    }
+
+
+
+    /***************   CompiledStatement   ***************/
+
+    CompiledStatement::CompiledStatement(unique_ptr<ast::Statement> statement)
+        : statement_(move(statement))
+        , chunk_(Compiler::CompileStatement(*statement_))
+    {
+    }
+
+
+    ObjectHolder CompiledStatement::Execute(Closure& closure, Context& context)
+    {
+        return Run(chunk_, closure, context);
+    }
+
+
+
+    /***************   Prepare   ***************/
+
+    unique_ptr<runtime::Executable> Prepare(unique_ptr<ast::Statement> program, ExecutionMode mode)
+    {
+        if (mode == ExecutionMode::BYTECODE)
+            return make_unique<CompiledStatement>(move(program));
+        return program;
+    }
+
+}  // namespace bytecode
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace bytecode
+{
+
+    /*
+     * Команды стековой виртуальной машины.
+     * Каждая команда снимает со стека свои операнды и кладёт на него результат.
+     * Параметр команды (operand) - номер константы, имени, ячейки кадра, узла дерева
+     * или команды, на которую выполняется переход
+     */
+    enum class OpCode : std::uint8_t
+    {
+        PUSH_CONST,        // кладёт на стек константу номер operand
+        PUSH_NONE,         // кладёт на стек None
+        POP,               // снимает значение со стека
+
+        LOAD_GLOBAL,       // кладёт на стек значение переменной с именем номер operand из Closure
+        STORE_GLOBAL,      // присваивает переменной с именем номер operand значение с вершины стека
+        LOAD_LOCAL,        // кладёт на стек значение ячейки operand кадра вызова метода
+        STORE_LOCAL,       // присваивает ячейке operand кадра значение с вершины стека
+        READ_FIELD,        // заменяет объект на вершине стека значением его поля (см. FieldRead)
+        STORE_FIELD,       // object value -> value, присваивает поле узлом FieldAssignment номер operand
+
+        DEFINE_CLASS_GLOBAL,  // объявляет класс с вершины стека в Closure под именем номер operand
+        DEFINE_CLASS_LOCAL,   // объявляет класс с вершины стека в ячейке operand кадра
+
+        PRINT_SEPARATOR,   // выводит пробел между аргументами print
+        PRINT_VALUE,       // снимает значение со стека и выводит его
+        PRINT_NEWLINE,     // завершает строку вывода print и кладёт на стек None
+
+        CALL_METHOD,       // object args... -> result, вызов метода (см. CallSite)
+        TAIL_CALL,         // вызов метода в инструкции return: как CALL_METHOD, но вызываемый
+                           // метод занимает кадр текущего, если может его заменить (см. runtime::TailCall)
+        NEW_INSTANCE,      // args... -> instance, создание экземпляра класса (см. CallSite)
+        STRINGIFY,         // заменяет значение на вершине стека его строковым представлением
+        UPDATE,            // выполняет присваивание с изменением значения узлом номер operand
+                           // (см. ast::FieldUpdate) и кладёт на стек его результат
+
+        ADD,
+        SUB,
+        MULT,
+        DIV,
+
+        LESS,
+        GREATER,
+        EQUAL,
+        NOT_EQUAL,
+        LESS_OR_EQUAL,
+        GREATER_OR_EQUAL,
+        COMPARE_WITH,      // lhs rhs -> bool, сравнение функцией узла Comparison номер operand
+
+        NOT,
+        TO_BOOL,           // приводит значение на вершине стека к True или False
+
+        JUMP,              // переходит к команде номер operand
+        JUMP_IF_FALSE,     // снимает значение со стека и переходит, если оно приводится к False
+        JUMP_IF_TRUE,      // снимает значение со стека и переходит, если оно приводится к True
+
+        RETURN,            // завершает выполнение байт-кода, возвращая значение с вершины стека
+
+        COUNT              // количество команд, не является командой
+    };
+
+    struct Instruction
+    {
+        OpCode op;
+        std::uint32_t operand = 0;
+    };
+
+    // Чтение поля номер index цепочки имён узла variable
+    struct FieldRead
+    {
+        ast::VariableValue* variable = nullptr;
+        size_t index = 0;
+    };
+
+    // Вызов метода либо создание экземпляра: узел, выполняющий вызов,
+    // и количество вычисленных аргументов, которые команда снимает со стека
+    struct CallSite
+    {
+        ast::Statement* node = nullptr;
+        size_t argument_count = 0;
+    };
+
+    /*
+     * Байт-код одной инструкции дерева (программы или тела метода) вместе с таблицами,
+     * на которые ссылаются параметры команд.
+     * Команды ссылаются на узлы дерева: узлы хранят встроенные кеши методов и полей,
+     * поэтому дерево должно жить дольше байт-кода (см. CompiledStatement)
+     */
+    struct Chunk
+    {
+        std::vector<Instruction> code;
+        std::vector<runtime::ObjectHolder> constants;
+        std::vector<runtime::Symbol> names;
+        std::vector<FieldRead> field_reads;
+        std::vector<CallSite> calls;
+        std::vector<ast::Statement*> nodes;
+        // Наибольшая глубина стека значений при выполнении байт-кода
+        size_t max_stack_depth = 0;
+    };
+
+
+
+    // Компилятор дерева программы в байт-код. Узлы дерева добавляют свои команды
+    // методом Statement::Compile, вызывая методы компилятора
+    class Compiler
+    {
+    public:
+        // Компилирует statement в байт-код, возвращающий значение statement
+        [[nodiscard]] static Chunk CompileStatement(ast::Statement& statement);
+
+        // Заменяет тела собственных методов класса cls скомпилированными.
+        // Уже скомпилированные тела и тела, не являющиеся узлами дерева, остаются прежними
+        static void CompileMethods(runtime::Class& cls);
+
+        // Компилирует узел node. Если node равен nullptr, выбрасывает runtime_error
+        void Compile(ast::Statement* node);
+
+        // Добавляет команду op. Команды вызова снимают со стека ещё argument_count аргументов
+        void Emit(OpCode op, std::uint32_t operand = 0, size_t argument_count = 0);
+        // Добавляет команду, кладущую на стек константу value
+        void EmitConstant(runtime::ObjectHolder value);
+
+        // Добавляет команду перехода op с пока не известной целью и возвращает её номер
+        [[nodiscard]] size_t EmitJump(OpCode op);
+        // Направляет переход номер jump на следующую добавляемую команду
+        void PatchJump(size_t jump);
+
+        // Добавляют запись в таблицы байт-кода и возвращают её номер
+        [[nodiscard]] std::uint32_t AddName(runtime::Symbol name);
+        [[nodiscard]] std::uint32_t AddFieldRead(ast::VariableValue& variable, size_t index);
+        [[nodiscard]] std::uint32_t AddCall(ast::Statement& node, size_t argument_count);
+        [[nodiscard]] std::uint32_t AddNode(ast::Statement& node);
+
+        // Глубина стека значений после уже добавленных команд.
+        // После безусловного перехода ветка, на которую он не ведёт, начинается с прежней глубины,
+        // её восстанавливает SetStackDepth
+        [[nodiscard]] size_t GetStackDepth() const noexcept
+        {
+            return stack_depth_;
+        }
+
+        void SetStackDepth(size_t depth) noexcept
+        {
+            stack_depth_ = depth;
+        }
+
+    private:
+        Compiler() = default;
+
+        Chunk chunk_;
+        size_t stack_depth_ = 0;
+    };
+
+
+
+    // Выполняет байт-код chunk. Возвращает значение, снятое командой RETURN.
+    // Вызовы методов, скомпилированных в байт-код, выполняются без рекурсии, их глубина ограничена
+    // CallLimits::max_vm_depth контекста. Так же выполняются скомпилированные методы __add__,
+    // методы сравнения, __str__ в str() и print и __init__
+    runtime::ObjectHolder Run(Chunk& chunk, runtime::Closure& closure, runtime::Context& context);
+
+
+
+    // Инструкция, скомпилированная в байт-код. Владеет исходным деревом, на узлы которого
+    // ссылается байт-код, и выполняет его виртуальной машиной
+    class CompiledStatement final : public runtime::Executable
+    {
+    public:
+        explicit CompiledStatement(std::unique_ptr<ast::Statement> statement);
+
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+        [[nodiscard]] const Chunk& GetChunk() const noexcept
+        {
+            return chunk_;
+        }
+
+        [[nodiscard]] Chunk& GetChunk() noexcept
+        {
+            return chunk_;
+        }
+
+    private:
+        std::unique_ptr<ast::Statement> statement_;
+        Chunk chunk_;
+    };
+
+
+
+    // Способ выполнения программы
+    enum class ExecutionMode
+    {
+        TREE,      // обход дерева
+        BYTECODE   // компиляция в байт-код и выполнение виртуальной машиной
+    };
+
+    // Готовит дерево program к выполнению способом mode
+    std::unique_ptr<runtime::Executable> Prepare(std::unique_ptr<ast::Statement> program,
+        ExecutionMode mode);
+
+}  // namespace bytecode
@@ -0,0 +1,357 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "parse.h"
+
+#include "test_runner.h"
+
+using namespace std;
+
+namespace bytecode
+{
+
+    namespace
+    {
+
+        unique_ptr<ast::Statement> ParseString(const string& program)
+        {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            return ParseProgram(lexer);
+        }
+
+        string RunProgram(const string& program)
+        {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            Prepare(ParseString(program), ExecutionMode::BYTECODE)->Execute(closure, context);
+            return string(context.output.View());
+        }
+
+        void TestChunkLayout()
+        {
+            // x = 1 + 2 * 3
+            ast::Assignment assignment("x"s, make_unique<ast::Add>(make_unique<ast::NumericConst>(1),
+                make_unique<ast::Mult>(make_unique<ast::NumericConst>(2), make_unique<ast::NumericConst>(3))));
+            const Chunk chunk = Compiler::CompileStatement(assignment);
+
+            const vector<OpCode> expected = {
+                OpCode::PUSH_CONST, OpCode::PUSH_CONST, OpCode::PUSH_CONST, OpCode::MULT,
+                OpCode::ADD, OpCode::STORE_GLOBAL, OpCode::RETURN
+            };
+            ASSERT_EQUAL(chunk.code.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                ASSERT(chunk.code[i].op == expected[i]);
+            }
+            ASSERT_EQUAL(chunk.constants.size(), 3U);
+            ASSERT_EQUAL(chunk.max_stack_depth, 3U);
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            Chunk runnable = chunk;
+            Run(runnable, closure, context);
+            ASSERT_EQUAL(closure.at("x"s).TryAs<runtime::Number>()->GetValue(), 7);
+        }
+
+        void TestDeepExpression()
+        {
+            // Правоассоциативная сумма не помещается во встроенный стек виртуальной машины
+            string expression = "1"s;
+            for (int i = 2; i <= 40; ++i)
+            {
+                expression = to_string(i) + " + ("s + expression + ")"s;
+            }
+            ASSERT_EQUAL(RunProgram("print "s + expression + "\n"s), "820\n"s);
+        }
+
+        void TestMethodsAreCompiled()
+        {
+            const string program = R"(
+class Base:
+  def value():
+    return 1
+
+class Derived(Base):
+  def twice():
+    return self.value() * 2
+
+d = Derived()
+print d.twice()
+)"s;
+
+            auto compiled = Prepare(ParseString(program), ExecutionMode::BYTECODE);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            compiled->Execute(closure, context);
+            ASSERT_EQUAL(context.output.View(), "2\n"s);
+
+            const auto& derived = *closure.at("Derived"s).TryAs<runtime::Class>();
+            for (const char* name : { "value", "twice" })
+            {
+                const runtime::Method* method = derived.GetMethod(name);
+                ASSERT(method != nullptr);
+                ASSERT(dynamic_cast<const CompiledStatement*>(method->body.get()) != nullptr);
+            }
+        }
+
+        void TestShortCircuit()
+        {
+            const string program = R"(
+class Loud:
+  def get(value):
+    print 'get', value
+    return value
+
+l = Loud()
+print l.get(0) and l.get(1)
+print l.get(1) or l.get(0)
+print not l.get('') or l.get(2)
+if l.get(None):
+  print 'then'
+else:
+  print 'else'
+)"s;
+            ASSERT_EQUAL(RunProgram(program),
+                "get 0\nFalse\nget 1\nTrue\nget \nTrue\nget None\nelse\n"s);
+        }
+
+        void TestDeepRecursion()
+        {
+            const string program = R"(
+class Counter:
+  def count(n):
+    if n == 0:
+      return 0
+    return 1 + self.count(n - 1)
+
+c = Counter()
+print c.count(100000)
+)"s;
+            ASSERT_EQUAL(RunProgram(program), "100000\n"s);
+        }
+
+        void TestRecursionLimit()
+        {
+            const string program = R"(
+class Counter:
+  def count(n):
+    if n == 0:
+      return 0
+    return 1 + self.count(n - 1)
+
+c = Counter()
+)"s;
+            for (auto mode : { ExecutionMode::TREE, ExecutionMode::BYTECODE })
+            {
+                runtime::DummyContext context;
+                context.GetCallLimits() = { 50, 50 };
+                runtime::Closure closure;
+                Prepare(ParseString(program), mode)->Execute(closure, context);
+
+                auto count = Prepare(ParseString("print c.count(100)\n"s), mode);
+                ASSERT_THROWS(count->Execute(closure, context), runtime_error);
+
+                // После ошибки кадры освобождены, и вызовы в том же контексте выполняются как прежде
+                Prepare(ParseString("print c.count(40)\n"s), mode)->Execute(closure, context);
+                ASSERT_EQUAL(context.output.View(), "40\n"s);
+            }
+        }
+
+        void TestOperatorRecursionLimit()
+        {
+            // Операторы и str() вызывают методы рекурсией C++ в обоих режимах. Такая рекурсия
+            // останавливается ошибкой до переполнения стека процесса, хотя её уровни тяжелее вызовов методов
+            const string program = R"(
+class Deep:
+  def __init__(n):
+    self.n = n
+
+  def __add__(n):
+    if n == 0:
+      return 0
+    return self + (n - 1)
+
+  def __lt__(n):
+    if n == 0:
+      return True
+    return self < (n - 1)
+
+  def __str__():
+    if self.n == 0:
+      return 'deep'
+    self.n = self.n - 1
+    return str(self)
+
+d = Deep(1000000)
+)"s;
+            for (auto mode : { ExecutionMode::TREE, ExecutionMode::BYTECODE })
+            {
+                runtime::DummyContext context;
+                context.GetCallLimits().max_vm_depth = 20'000;
+                runtime::Closure closure;
+                Prepare(ParseString(program), mode)->Execute(closure, context);
+
+                for (const string& expression : { "d + 1000000"s, "d < 1000000"s, "str(d)"s })
+                {
+                    auto deep = Prepare(ParseString("print "s + expression + "\n"s), mode);
+                    ASSERT_THROWS(deep->Execute(closure, context), runtime_error);
+                }
+
+                Prepare(ParseString("d.n = 3\nprint d + 40, d < 3, str(d)\n"s), mode)->Execute(closure, context);
+                ASSERT_EQUAL(context.output.View(), "0 True deep\n"s);
+            }
+        }
+
+        void TestOperatorMethods()
+        {
+            // Виртуальная машина вызывает эти методы в своём цикле, а обход дерева - рекурсией C++.
+            // Результаты и порядок вывода должны совпадать
+            const string program = R"(
+class Text:
+  def __init__(value):
+    self.value = value
+    print 'init', value
+
+  def __str__():
+    print 'str of', self.value
+    return self.value
+
+class Version:
+  def __init__(number):
+    return self.set(number)
+
+  def set(number):
+    self.number = number
+    return 'ignored'
+
+  def __cmp__(other):
+    return self.number - other.number
+
+  def __add__(delta):
+    return self.number + delta
+
+  def __str__():
+    return Text('v' + str(self.number))
+
+class Limit:
+  def __lt__(value):
+    return value
+
+v1 = Version(1)
+v2 = Version(2)
+print v1 < v2, v1 > v2, v1 == v2, v1 != v2, v1 <= v2, v1 >= v2
+print 'values', v1, str(v2) + '!', v1 + 10
+print 5 > Limit(), 0 > Limit()
+)"s;
+            const string expected = "True False False True True False\n"
+                "values init v1\nstr of v1\nv1 init v2\nstr of v2\nv2! 11\n"
+                "True False\n"s;
+            for (auto mode : { ExecutionMode::TREE, ExecutionMode::BYTECODE })
+            {
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                Prepare(ParseString(program), mode)->Execute(closure, context);
+                ASSERT_EQUAL(context.output.View(), expected);
+            }
+        }
+
+        void TestDeepOperatorRecursion()
+        {
+            const string program = R"(
+class Deep:
+  def __init__(n):
+    self.n = n
+
+  def __add__(n):
+    if n == 0:
+      return 0
+    return 1 + (self + (n - 1))
+
+  def __cmp__(n):
+    if n == 0:
+      return -1
+    if self < (n - 1):
+      return -1
+    return 1
+
+  def __str__():
+    if self.n == 0:
+      return 'deep'
+    self.n = self.n - 1
+    return str(self)
+
+d = Deep(100000)
+print d + 100000, d < 100000, str(d)
+)"s;
+            ASSERT_EQUAL(RunProgram(program), "100000 True deep\n"s);
+        }
+
+        void TestTailCalls()
+        {
+            const string program = R"(
+class Loop:
+  def sum(n, acc):
+    if n == 0:
+      return acc
+    return self.sum(n - 1, acc + n)
+
+class Player:
+  def play(n):
+    if n == 0:
+      return 'done'
+    return self.partner.play(n - 1)
+
+class Relay:
+  def pass_on(n):
+    loop = Loop()
+    return loop.sum(n, 0)
+
+class Visitor:
+  def visit(node, n):
+    return node.walk(n - 1)
+
+class Node:
+  def walk(n):
+    if n == 0:
+      relay = Relay()
+      return relay.pass_on(10000)
+    visitor = Visitor()
+    return visitor.visit(self, n)
+
+ping = Player()
+pong = Player()
+ping.partner = pong
+pong.partner = ping
+loop = Loop()
+node = Node()
+print loop.sum(20000, 0), ping.play(10001), node.walk(3)
+)"s;
+            for (auto mode : { ExecutionMode::TREE, ExecutionMode::BYTECODE })
+            {
+                // Хвостовые вызовы не увеличивают глубину вызовов, поэтому хватает нескольких уровней.
+                // Вызов visit(self, n) не может заменить walk: после замены объект self мог бы разрушиться
+                runtime::DummyContext context;
+                context.GetCallLimits() = { 12, 12 };
+                runtime::Closure closure;
+                Prepare(ParseString(program), mode)->Execute(closure, context);
+                ASSERT_EQUAL(context.output.View(), "200010000 done 50005000\n"s);
+            }
+        }
+
+    }  // namespace
+
+    void RunBytecodeTests(TestRunner& tr)
+    {
+        RUN_TEST(tr, bytecode::TestChunkLayout);
+        RUN_TEST(tr, bytecode::TestDeepExpression);
+        RUN_TEST(tr, bytecode::TestMethodsAreCompiled);
+        RUN_TEST(tr, bytecode::TestShortCircuit);
+        RUN_TEST(tr, bytecode::TestDeepRecursion);
+        RUN_TEST(tr, bytecode::TestRecursionLimit);
+        RUN_TEST(tr, bytecode::TestOperatorRecursionLimit);
+        RUN_TEST(tr, bytecode::TestOperatorMethods);
+        RUN_TEST(tr, bytecode::TestDeepOperatorRecursion);
+        RUN_TEST(tr, bytecode::TestTailCalls);
+    }
+
+}  // namespace bytecode
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <charconv>
 #include <cctype>
+#include <limits>
 
 #include "lexer.h"
 
@@ -1,9 +1,14 @@
+#include "bytecode.h"
 #include "lexer.h"
+#include "optimizer.h"
 #include "parse.h"
 #include "runtime.h"
 #include "statement.h"
 #include "test_runner.h"
+#include "transpiler.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 
 using namespace std;
@@ -26,19 +31,62 @@ namespace runtime
 
 void TestParseProgram(TestRunner& tr);
 
+namespace bytecode
+{
+    void RunBytecodeTests(TestRunner& tr);
+}  // namespace bytecode
+
+namespace optimizer
+{
+    void RunOptimizerTests(TestRunner& tr);
+}  // namespace optimizer
+
+namespace transpiler
+{
+    void RunTranspilerTests(TestRunner& tr);
+}  // namespace transpiler
+
 namespace
 {
 
-    void RunMythonProgram(istream& input, ostream& output)
+    using bytecode::ExecutionMode;
+
+    // Если fold_report не равен nullptr, в него выводятся замены, сделанные оптимизатором дерева
+    void RunMythonProgram(istream& input, runtime::Context& context, ExecutionMode mode,
+        ostream* fold_report = nullptr)
     {
         parse::Lexer lexer(input);
-        auto program = ParseProgram(lexer);
+        auto program = bytecode::Prepare(optimizer::Optimize(ParseProgram(lexer), fold_report), mode);
 
-        runtime::SimpleContext context{ output };
         runtime::Closure closure;
         program->Execute(closure, context);
     }
 
+    void RunMythonProgram(istream& input, ostream& output, ExecutionMode mode)
+    {
+        runtime::SimpleContext context{ output };
+        RunMythonProgram(input, context, mode);
+    }
+
+    // Задаёт limits по значению параметра --max-depth=N. Глубина вызовов виртуальной машины
+    // становится равной N, а вызовы рекурсией C++ не могут превысить безопасного значения
+    // по умолчанию. Если value - не положительное целое число, выбрасывает invalid_argument
+    void SetMaxDepth(string_view value, runtime::CallLimits& limits)
+    {
+        size_t depth = 0;
+        const auto [end, error] = from_chars(value.data(), value.data() + value.size(), depth);
+        if (value.empty() || error != errc{} || end != value.data() + value.size() || depth == 0)
+        {
+            throw invalid_argument("--max-depth expects a positive integer, got '"s + string(value)
+                + "'\nusage: mython [--vm] [--fold-report] [--max-depth=N] [--flush=line|size|exit]"s
+                + " < program.my\n       mython --emit-cpp < program.my"s);
+        }
+
+        limits.max_vm_depth = depth;
+        limits.max_native_depth = min(depth, runtime::CallLimits{}.max_native_depth);
+    }
+
+    template <ExecutionMode Mode>
     void TestSimplePrints()
     {
         istringstream input(R"(
@@ -52,11 +100,12 @@ print None
 )");
 
         ostringstream output;
-        RunMythonProgram(input, output);
+        RunMythonProgram(input, output, Mode);
 
         ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
     }
 
+    template <ExecutionMode Mode>
     void TestAssignments()
     {
         istringstream input(R"(
@@ -72,21 +121,23 @@ print x, y
 )");
 
         ostringstream output;
-        RunMythonProgram(input, output);
+        RunMythonProgram(input, output, Mode);
 
         ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
     }
 
+    template <ExecutionMode Mode>
     void TestArithmetics()
     {
         istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
 
         ostringstream output;
-        RunMythonProgram(input, output);
+        RunMythonProgram(input, output, Mode);
 
         ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
     }
 
+    template <ExecutionMode Mode>
     void TestVariablesArePointers()
     {
         istringstream input(R"(
@@ -116,11 +167,31 @@ print y.value
 )");
 
         ostringstream output;
-        RunMythonProgram(input, output);
+        RunMythonProgram(input, output, Mode);
 
         ASSERT_EQUAL(output.str(), "2\n3\n");
     }
 
+    template <ExecutionMode Mode>
+    void TestPrintOrder()
+    {
+        istringstream input(R"(
+class Logger:
+  def log(value):
+    print 'log:', value
+    return value
+
+l = Logger()
+print 'start', l.log(-15), str(True) + str(l.log(7)), None
+print 'partial', 1 / 0
+)");
+
+        // Вложенные print и начало строки, прерванной ошибкой, выводятся в прежнем порядке
+        ostringstream output;
+        ASSERT_THROWS(RunMythonProgram(input, output, Mode), runtime_error);
+        ASSERT_EQUAL(output.str(), "start log: -15\n-15 log: 7\nTrue7 None\npartial "s);
+    }
+
     void TestAll()
     {
         TestRunner tr;
@@ -129,21 +200,67 @@ print y.value
         runtime::RunObjectsTests(tr);
         ast::RunUnitTests(tr);
         TestParseProgram(tr);
-
-        RUN_TEST(tr, TestSimplePrints);
-        RUN_TEST(tr, TestAssignments);
-        RUN_TEST(tr, TestArithmetics);
-        RUN_TEST(tr, TestVariablesArePointers);
+        bytecode::RunBytecodeTests(tr);
+        optimizer::RunOptimizerTests(tr);
+        transpiler::RunTranspilerTests(tr);
+
+        RUN_TEST(tr, TestSimplePrints<ExecutionMode::TREE>);
+        RUN_TEST(tr, TestSimplePrints<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, TestAssignments<ExecutionMode::TREE>);
+        RUN_TEST(tr, TestAssignments<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, TestArithmetics<ExecutionMode::TREE>);
+        RUN_TEST(tr, TestArithmetics<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, TestVariablesArePointers<ExecutionMode::TREE>);
+        RUN_TEST(tr, TestVariablesArePointers<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, TestPrintOrder<ExecutionMode::TREE>);
+        RUN_TEST(tr, TestPrintOrder<ExecutionMode::BYTECODE>);
     }
 
 }  // namespace
 
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
         TestAll();
-        RunMythonProgram(cin, cout);
+
+        // mython --emit-cpp выводит вместо исполнения программу на C++ (см. transpiler.h)
+        if (argc > 1 && argv[1] == "--emit-cpp"sv)
+        {
+            parse::Lexer lexer(cin);
+            transpiler::Transpile(*optimizer::Optimize(ParseProgram(lexer)), cout);
+            return 0;
+        }
+
+        // mython --vm выполняет программу виртуальной машиной, а не обходом дерева,
+        // mython --fold-report выводит в cerr замены, сделанные оптимизатором дерева,
+        // mython --max-depth=N ограничивает глубину вызовов методов (см. runtime::CallLimits),
+        // mython --flush=line|size|exit задаёт, когда выводится накопленный вывод программы
+        bool use_vm = false;
+        bool fold_report = false;
+        runtime::CallLimits limits;
+        runtime::FlushPolicy flush = runtime::FlushPolicy::THRESHOLD;
+        for (int i = 1; i < argc; ++i)
+        {
+            const string_view arg = argv[i];
+            use_vm = use_vm || arg == "--vm"sv;
+            fold_report = fold_report || arg == "--fold-report"sv;
+            if (arg.substr(0, "--max-depth="sv.size()) == "--max-depth="sv)
+                SetMaxDepth(arg.substr("--max-depth="sv.size()), limits);
+            if (arg == "--flush=line"sv)
+                flush = runtime::FlushPolicy::PER_LINE;
+            else if (arg == "--flush=exit"sv)
+                flush = runtime::FlushPolicy::AT_EXIT;
+        }
+
+        // Вывод программы записывается прямо в дескриптор стандартного вывода, минуя cout.
+        // Остаток буфера выводится при выходе из блока, в том числе при ошибке
+        runtime::FdSink stdout_sink(1);
+        runtime::BufferedSink output(stdout_sink, flush);
+        runtime::SinkContext context(output);
+        context.GetCallLimits() = limits;
+        RunMythonProgram(cin, context, use_vm ? ExecutionMode::BYTECODE : ExecutionMode::TREE,
+            fold_report ? &cerr : nullptr);
     }
     catch (const exception& e)
     {
@@ -0,0 +1,156 @@
+#include "optimizer.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace optimizer
+{
+
+    using runtime::ObjectHolder;
+
+
+    namespace
+    {
+        // Возвращает true, если node - узел одного из типов Types
+        template <typename... Types>
+        bool IsOneOf(const ast::Statement* node)
+        {
+            return ((dynamic_cast<const Types*>(node) != nullptr) || ...);
+        }
+    }  // namespace
+
+
+
+    Folder::Folder(ostream* report)
+        : report_(report)
+    {
+    }
+
+
+    void Folder::Fold(unique_ptr<ast::Statement>& node)
+    {
+        if (!node)
+            return;
+
+        if (auto replacement = node->Fold(*this))
+            node = move(replacement);
+    }
+
+
+    void Folder::FoldMethods(runtime::Class& cls)
+    {
+        cls.ForEachOwnMethod([this](runtime::Method& method) {
+            // Тела, скомпилированные в байт-код, уже не являются узлами дерева
+            if (auto* body = dynamic_cast<ast::Statement*>(method.body.get()))
+            {
+                if (auto replacement = body->Fold(*this))
+                    method.body = move(replacement);
+            }
+        });
+    }
+
+
+    optional<ObjectHolder> Folder::GetConstant(ast::Statement* node)
+    {
+        if (auto* number = dynamic_cast<ast::NumericConst*>(node))
+            return number->GetValue();
+        if (auto* str = dynamic_cast<ast::StringConst*>(node))
+            return str->GetValue();
+        if (auto* boolean = dynamic_cast<ast::BoolConst*>(node))
+            return boolean->GetValue();
+        if (dynamic_cast<const ast::None*>(node) != nullptr)
+            return ObjectHolder::None();
+        return nullopt;
+    }
+
+
+    bool Folder::IsNumeric(const ast::Statement* node)
+    {
+        // Вычитание, умножение и деление либо возвращают число, либо выбрасывают исключение
+        return IsOneOf<ast::NumericConst, ast::Sub, ast::Mult, ast::Div>(node);
+    }
+
+
+    bool Folder::IsBoolean(const ast::Statement* node)
+    {
+        return IsOneOf<ast::BoolConst, ast::Not, ast::And, ast::Or, ast::Comparison,
+            ast::Less, ast::Greater, ast::Equal, ast::NotEqual, ast::LessOrEqual, ast::GreaterOrEqual>(node);
+    }
+
+
+    optional<ObjectHolder> Folder::Evaluate(ast::Statement& node)
+    {
+        try
+        {
+            runtime::Closure closure;
+            return node.Execute(closure, context_);
+        }
+        catch (const runtime_error&)
+        {
+            return nullopt;
+        }
+    }
+
+
+    unique_ptr<ast::Statement> Folder::ReplaceWithConstant(string_view rule, const ObjectHolder& value)
+    {
+        unique_ptr<ast::Statement> constant;
+        switch (value.GetKind())
+        {
+        case runtime::Object::Kind::NUMBER:
+            constant = make_unique<ast::NumericConst>(*value.TryAs<runtime::Number>());
+            break;
+        case runtime::Object::Kind::STRING:
+            constant = make_unique<ast::StringConst>(*value.TryAs<runtime::String>());
+            break;
+        case runtime::Object::Kind::BOOL:
+            constant = make_unique<ast::BoolConst>(*value.TryAs<runtime::Bool>());
+            break;
+        case runtime::Object::Kind::NONE:
+            constant = make_unique<ast::None>();
+            break;
+        default:
+            return nullptr;
+        }
+
+        if (report_)
+        {
+            *report_ << rule << " -> "sv;
+            if (value)
+                value->Print(*report_, context_);
+            else
+                *report_ << "None"sv;
+            *report_ << '\n';
+        }
+        ++change_count_;
+        return constant;
+    }
+
+
+    unique_ptr<ast::Statement> Folder::Replace(string_view rule, unique_ptr<ast::Statement> node)
+    {
+        if (report_)
+            *report_ << rule << '\n';
+        ++change_count_;
+        return node;
+    }
+
+
+    void Folder::Drop(string_view rule)
+    {
+        if (report_)
+            *report_ << rule << '\n';
+        ++change_count_;
+    }
+
+
+
+    unique_ptr<ast::Statement> Optimize(unique_ptr<ast::Statement> program, ostream* report)
+    {
+        Folder folder(report);
+        folder.Fold(program);
+        return program;
+    }
+
+}  // namespace optimizer
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+namespace optimizer
+{
+
+    /*
+     * Упрощает дерево программы после разбора: заменяет поддеревья из одних констант
+     * их значениями, отбрасывает ветки if с постоянным условием, недостижимые и пустые инструкции
+     * и применяет тождества вроде e * 1 = e, если они не меняют поведения программы (в том числе ошибок).
+     * Узлы дерева упрощают себя методом Statement::Fold, вызывая методы Folder
+     */
+    class Folder
+    {
+    public:
+        // Если report не равен nullptr, Folder выводит в него по строке на каждую замену
+        explicit Folder(std::ostream* report = nullptr);
+
+        // Упрощает поддерево node и при необходимости заменяет его
+        void Fold(std::unique_ptr<ast::Statement>& node);
+        // Упрощает тела собственных методов класса cls
+        void FoldMethods(runtime::Class& cls);
+
+        // Возвращает значение узла-константы (числа, строки, логического значения либо None)
+        // или nullopt, если node - не константа
+        [[nodiscard]] static std::optional<runtime::ObjectHolder> GetConstant(ast::Statement* node);
+        // Возвращает true, если значение node - всегда число
+        [[nodiscard]] static bool IsNumeric(const ast::Statement* node);
+        // Возвращает true, если значение node - всегда True или False
+        [[nodiscard]] static bool IsBoolean(const ast::Statement* node);
+
+        // Вычисляет узел, операнды которого - константы. Если вычисление завершилось ошибкой,
+        // возвращает nullopt: узел остаётся в дереве и сообщит об ошибке при выполнении
+        std::optional<runtime::ObjectHolder> Evaluate(ast::Statement& node);
+
+        // Возвращает узел-константу со значением value, сообщив о замене правилом rule.
+        // Для значений, у которых нет узла-константы, возвращает nullptr
+        std::unique_ptr<ast::Statement> ReplaceWithConstant(std::string_view rule,
+            const runtime::ObjectHolder& value);
+        // Возвращает узел node, которым заменяется текущий, сообщив о замене правилом rule
+        std::unique_ptr<ast::Statement> Replace(std::string_view rule, std::unique_ptr<ast::Statement> node);
+        // Сообщает об удалении из дерева инструкций, которые не влияют на выполнение программы
+        void Drop(std::string_view rule);
+
+        [[nodiscard]] size_t GetChangeCount() const noexcept
+        {
+            return change_count_;
+        }
+
+    private:
+        std::ostream* report_;
+        runtime::DummyContext context_;
+        size_t change_count_ = 0;
+    };
+
+
+
+    // Упрощает дерево program и возвращает результат.
+    // Если report не равен nullptr, выводит в него описание каждой замены
+    std::unique_ptr<ast::Statement> Optimize(std::unique_ptr<ast::Statement> program,
+        std::ostream* report = nullptr);
+
+}  // namespace optimizer
@@ -0,0 +1,271 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+
+#include "test_runner.h"
+
+using namespace std;
+
+namespace optimizer
+{
+
+    namespace
+    {
+
+        // Результат оптимизации и выполнения программы
+        struct Outcome
+        {
+            string report;
+            string output;
+        };
+
+        Outcome OptimizeAndRun(const string& program,
+            bytecode::ExecutionMode mode = bytecode::ExecutionMode::TREE)
+        {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            ostringstream report;
+            auto tree = bytecode::Prepare(Optimize(ParseProgram(lexer), &report), mode);
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+            return { report.str(), string(context.output.View()) };
+        }
+
+        // Возвращает текст ошибки, с которой завершается программа, с оптимизацией или без неё
+        string ErrorText(const string& program, bool optimize)
+        {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            if (optimize)
+                tree = Optimize(move(tree), nullptr);
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            try
+            {
+                tree->Execute(closure, context);
+            }
+            catch (const runtime_error& e)
+            {
+                return e.what();
+            }
+            return "no error"s;
+        }
+
+        // Возвращает количество строк отчёта report, равных line
+        size_t CountLines(const string& report, const string& line)
+        {
+            istringstream input(report);
+            size_t count = 0;
+            for (string current; getline(input, current);)
+            {
+                count += current == line ? 1 : 0;
+            }
+            return count;
+        }
+
+        void TestConstantFolding()
+        {
+            const string program = R"(
+print 2*5+10/2, -3, 'con' + 'cat', str(12), 1 < 2 and not 3 > 4
+)"s;
+            const Outcome outcome = OptimizeAndRun(program);
+            ASSERT_EQUAL(outcome.output, "15 -3 concat 12 True\n"s);
+            ASSERT_EQUAL(outcome.report,
+                "constant * -> 10\n"
+                "constant / -> 5\n"
+                "constant + -> 15\n"
+                "constant * -> -3\n"
+                "constant + -> concat\n"
+                "constant str() -> 12\n"
+                "constant comparison -> True\n"
+                "constant comparison -> False\n"
+                "constant not -> True\n"
+                "constant and -> True\n"s);
+        }
+
+        void TestErrorsAreKept()
+        {
+            // Ошибки вычисления констант остаются в дереве до выполнения программы
+            for (const string& program : { "x = 1 / 0\n"s, "x = 2147483647 + 1\n"s, "x = 1 + 'a'\n"s,
+                     "x = 1 < 'a'\n"s })
+            {
+                istringstream input(program);
+                parse::Lexer lexer(input);
+                ostringstream report;
+                Optimize(ParseProgram(lexer), &report);
+                ASSERT_EQUAL(report.str(), ""s);
+            }
+
+            // x * 1 нельзя заменить на x: для строки x умножение выбрасывает исключение
+            ASSERT_THROWS(OptimizeAndRun("x = 'a'\ny = x * 1\n"s), runtime_error);
+        }
+
+        void TestIdentities()
+        {
+            const string program = R"(
+n = 7
+print (n - 1) * 1, 0 + n / 2, - - n, not not n < 8, True and n > 1
+)"s;
+            for (auto mode : { bytecode::ExecutionMode::TREE, bytecode::ExecutionMode::BYTECODE })
+            {
+                const Outcome outcome = OptimizeAndRun(program, mode);
+                ASSERT_EQUAL(outcome.output, "6 3 7 True True\n"s);
+                // Для переменной n неизвестно, что она число, поэтому - - n становится n * 1, а не n
+                ASSERT_EQUAL(outcome.report,
+                    "e * 1 -> e\n"
+                    "0 + e -> e\n"
+                    "(e * c1) * c2 -> e * (c1 * c2)\n"
+                    "not not e -> e\n"
+                    "True and e -> e\n"s);
+            }
+        }
+
+        void TestDeadBranches()
+        {
+            const string program = R"(
+class Config:
+  def mode():
+    if 1 > 2:
+      return 'never'
+    else:
+      return 'always'
+
+  def debug():
+    if not True:
+      print 'debug'
+
+c = Config()
+print c.mode(), c.debug()
+)"s;
+            for (auto mode : { bytecode::ExecutionMode::TREE, bytecode::ExecutionMode::BYTECODE })
+            {
+                const Outcome outcome = OptimizeAndRun(program, mode);
+                ASSERT_EQUAL(outcome.output, "always None\n"s);
+                ASSERT(outcome.report.find("if False -> else body\n"s) != string::npos);
+                ASSERT(outcome.report.find("if False -> None\n"s) != string::npos);
+            }
+        }
+
+        void TestUnreachableCode()
+        {
+            const string program = R"(
+class Service:
+  def handle(x):
+    if False:
+      print 'legacy path'
+    if x > 0 or False:
+      return 'positive'
+      print 'unreachable'
+    if x == 0:
+      if not not False:
+        print 'disabled'
+    return 'other'
+
+s = Service()
+print s.handle(1), s.handle(0) and True
+)"s;
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            ostringstream report;
+            auto tree = bytecode::Prepare(Optimize(ParseProgram(lexer), &report),
+                bytecode::ExecutionMode::BYTECODE);
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+            ASSERT_EQUAL(context.output.View(), "positive True\n"s);
+            ASSERT_EQUAL(report.str(),
+                "if False -> None\n"
+                "unused constant\n"
+                "e or False -> e\n"
+                "unreachable code after return\n"
+                "constant not -> True\n"
+                "constant not -> False\n"
+                "if False -> None\n"
+                "unused constant\n"
+                "if with empty branches -> condition\n"
+                "nested block\n"s);
+
+            // От отключённых веток не остаётся ни условий, ни переходов: в методе проверяется
+            // лишь условие x > 0, а от if x == 0 - вычисление условия
+            const auto& service = *closure.at("Service"s).TryAs<runtime::Class>();
+            const auto& chunk = dynamic_cast<const bytecode::CompiledStatement&>(
+                *service.GetMethod("handle")->body).GetChunk();
+            size_t jumps = 0;
+            for (const auto& instruction : chunk.code)
+            {
+                jumps += instruction.op == bytecode::OpCode::JUMP_IF_FALSE ? 1 : 0;
+            }
+            ASSERT_EQUAL(jumps, 1U);
+        }
+
+        void TestFusedUpdates()
+        {
+            const string program = R"(
+class Money:
+  def __init__(amount):
+    self.amount = amount
+    self.additions = 0
+
+  def __add__(other):
+    self.additions = self.additions + 1
+    return self.amount + other
+
+class Account:
+  def __init__():
+    self.balance = Money(10)
+    self.visits = 0
+    self.log = ''
+
+  def deposit(amount):
+    self.balance = self.balance + amount
+    self.visits = self.visits + 1
+    self.log = self.log + '+'
+    steps = 10
+    steps = steps / 2
+    steps = steps - amount
+    return steps * 1
+
+a = Account()
+total = 1
+total = total * 3
+print a.deposit(5), a.deposit(2), a.balance, a.visits, a.log, total
+a.other = a.visits + 1
+total = 1 + total
+)"s;
+            for (auto mode : { bytecode::ExecutionMode::TREE, bytecode::ExecutionMode::BYTECODE })
+            {
+                const Outcome outcome = OptimizeAndRun(program, mode);
+                ASSERT_EQUAL(outcome.output, "0 3 17 2 ++ 3\n"s);
+                // a.other = a.visits + 1 и total = 1 + total не являются присваиваниями с изменением
+                ASSERT_EQUAL(CountLines(outcome.report, "o.f = o.f op e -> update"s), 4U);
+                ASSERT_EQUAL(CountLines(outcome.report, "x = x op e -> update"s), 3U);
+            }
+
+            // Ошибки остаются прежними, вплоть до текста сообщения
+            for (const string& program : { "x = 1\nx = x / 0\n"s, "x = 'a'\nx = x - 1\n"s, "x = x + 1\n"s,
+                     "class A:\n  def f():\n    self.n = self.n + 1\na = A()\na.f()\n"s,
+                     "class A:\n  def f(o):\n    o.n = o.n + 1\na = A()\na.f(1)\n"s })
+            {
+                ASSERT_EQUAL(ErrorText(program, true), ErrorText(program, false));
+            }
+        }
+
+    }  // namespace
+
+    void RunOptimizerTests(TestRunner& tr)
+    {
+        RUN_TEST(tr, optimizer::TestConstantFolding);
+        RUN_TEST(tr, optimizer::TestErrorsAreKept);
+        RUN_TEST(tr, optimizer::TestIdentities);
+        RUN_TEST(tr, optimizer::TestDeadBranches);
+        RUN_TEST(tr, optimizer::TestUnreachableCode);
+        RUN_TEST(tr, optimizer::TestFusedUpdates);
+    }
+
+}  // namespace optimizer
@@ -0,0 +1,220 @@
+#include "output.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace runtime
+{
+
+    /*****************************************************
+    ****************   Class OutputSink   ****************
+    ******************************************************/
+
+    void OutputSink::WriteParts(const string_view* parts, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Write(parts[i]);
+        }
+    }
+
+
+
+    /*****************************************************
+    ****************   Class StreamSink   ****************
+    ******************************************************/
+
+    void StreamSink::Write(string_view text)
+    {
+        os_.write(text.data(), static_cast<streamsize>(text.size()));
+    }
+
+
+    void StreamSink::Flush()
+    {
+        os_.flush();
+    }
+
+
+
+    /*****************************************************
+    ***************   Class BufferedSink   ***************
+    ******************************************************/
+
+    BufferedSink::BufferedSink(OutputSink& target, FlushPolicy policy, size_t capacity)
+        : target_(target)
+        , policy_(policy)
+        , capacity_(capacity)
+    {
+        buffer_.reserve(capacity_);
+    }
+
+
+    BufferedSink::~BufferedSink()
+    {
+        // Ошибку записи из деструктора сообщить некому
+        try
+        {
+            Flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+
+    void BufferedSink::Write(string_view text)
+    {
+        if (policy_ != FlushPolicy::AT_EXIT && buffer_.size() + text.size() > capacity_)
+        {
+            // Большой фрагмент не копируется в буфер, а передаётся вместе с его содержимым
+            const array<string_view, 2> parts = { string_view(buffer_), text };
+            target_.WriteParts(parts.data(), parts.size());
+            buffer_.clear();
+        }
+        else
+        {
+            buffer_ += text;
+        }
+
+        if (policy_ == FlushPolicy::PER_LINE && text.find('\n') != string_view::npos)
+            Flush();
+    }
+
+
+    void BufferedSink::Flush()
+    {
+        if (!buffer_.empty())
+        {
+            target_.Write(buffer_);
+            buffer_.clear();
+        }
+        target_.Flush();
+    }
+
+
+
+    /*****************************************************
+    *******************   Class FdSink   *****************
+    ******************************************************/
+
+    void FdSink::Write(string_view text)
+    {
+        WriteParts(&text, 1);
+    }
+
+
+#ifdef _WIN32
+    void FdSink::WriteParts(const string_view* parts, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            string_view text = parts[i];
+            while (!text.empty())
+            {
+                const int written = _write(fd_, text.data(), static_cast<unsigned>(text.size()));
+                if (written < 0)
+                    throw runtime_error("FdSink::Write: Error writing to file descriptor"s);
+                text.remove_prefix(static_cast<size_t>(written));
+            }
+        }
+    }
+#else
+    void FdSink::WriteParts(const string_view* parts, size_t count)
+    {
+        // writev принимает ограниченное число фрагментов за вызов, большие наборы передаются частями
+        constexpr size_t MAX_PARTS = 64;
+        array<iovec, MAX_PARTS> vectors;
+
+        while (count > 0)
+        {
+            size_t used = 0;
+            for (; used < min(count, MAX_PARTS); ++used)
+            {
+                vectors[used].iov_base = const_cast<char*>(parts[used].data());
+                vectors[used].iov_len = parts[used].size();
+            }
+
+            // Запись может завершиться частично: пропускаем записанное и повторяем
+            iovec* current = vectors.data();
+            size_t remaining = used;
+            while (remaining > 0)
+            {
+                const ssize_t written = writev(fd_, current, static_cast<int>(remaining));
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    throw runtime_error("FdSink::Write: Error writing to file descriptor"s);
+                }
+
+                size_t left = static_cast<size_t>(written);
+                while (remaining > 0 && left >= current->iov_len)
+                {
+                    left -= current->iov_len;
+                    ++current;
+                    --remaining;
+                }
+                if (remaining > 0)
+                {
+                    current->iov_base = static_cast<char*>(current->iov_base) + left;
+                    current->iov_len -= left;
+                }
+            }
+
+            parts += used;
+            count -= used;
+        }
+    }
+#endif
+
+
+
+    /*****************************************************
+    ****************   Class SinkStream   ****************
+    ******************************************************/
+
+    SinkStream::SinkStream(OutputSink& sink)
+        : std::ostream(nullptr)
+        , buffer_(sink)
+    {
+        rdbuf(&buffer_);
+    }
+
+
+    SinkStream::Buffer::int_type SinkStream::Buffer::overflow(int_type ch)
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            const char c = traits_type::to_char_type(ch);
+            sink_.Write(string_view(&c, 1));
+        }
+        return traits_type::not_eof(ch);
+    }
+
+
+    streamsize SinkStream::Buffer::xsputn(const char* s, streamsize count)
+    {
+        sink_.Write(string_view(s, static_cast<size_t>(count)));
+        return count;
+    }
+
+
+    int SinkStream::Buffer::sync()
+    {
+        sink_.Flush();
+        return 0;
+    }
+
+}  // namespace runtime
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace runtime
+{
+
+    /*
+     * Приёмник текста, который выводит программа Mython (см. Context::GetOutput).
+     * Приёмники можно соединять: например, BufferedSink накапливает вывод и передаёт его FdSink
+     */
+    class OutputSink
+    {
+    public:
+        virtual ~OutputSink() = default;
+
+        // Принимает очередной фрагмент вывода
+        virtual void Write(std::string_view text) = 0;
+        // Принимает count фрагментов parts подряд. Приёмники, которые умеют передавать их
+        // одной операцией, переопределяют метод
+        virtual void WriteParts(const std::string_view* parts, size_t count);
+        // Передаёт дальше вывод, накопленный приёмником
+        virtual void Flush()
+        {
+        }
+    };
+
+
+
+    // Передаёт вывод в поток os
+    class StreamSink : public OutputSink
+    {
+    public:
+        explicit StreamSink(std::ostream& os)
+            : os_(os)
+        {
+        }
+
+        void Write(std::string_view text) override;
+        void Flush() override;
+
+    private:
+        std::ostream& os_;
+    };
+
+
+
+    // Когда BufferedSink передаёт накопленный вывод дальше
+    enum class FlushPolicy
+    {
+        PER_LINE,   // после каждого фрагмента, завершающего строку
+        THRESHOLD,  // когда в буфере накопилось capacity символов
+        AT_EXIT     // только при вызове Flush и разрушении приёмника, буфер не ограничен
+    };
+
+    /*
+     * Накапливает вывод в буфере и передаёт его приёмнику target крупными блоками согласно policy.
+     * Фрагменты, не помещающиеся в буфер, передаются вместе с его содержимым одной операцией
+     * WriteParts, не копируясь в буфер. Разрушение приёмника передаёт остаток вывода
+     */
+    class BufferedSink : public OutputSink
+    {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+        explicit BufferedSink(OutputSink& target, FlushPolicy policy = FlushPolicy::THRESHOLD,
+            size_t capacity = DEFAULT_CAPACITY);
+        ~BufferedSink() override;
+
+        BufferedSink(const BufferedSink&) = delete;
+        BufferedSink& operator=(const BufferedSink&) = delete;
+
+        void Write(std::string_view text) override;
+        // Передаёт накопленный вывод приёмнику target и вызывает у него Flush
+        void Flush() override;
+
+    private:
+        OutputSink& target_;
+        FlushPolicy policy_;
+        size_t capacity_;
+        std::string buffer_;
+    };
+
+
+
+    /*
+     * Записывает вывод в файловый дескриптор fd системными вызовами write и writev, без буферизации.
+     * Не владеет дескриптором. При ошибке записи выбрасывает runtime_error
+     */
+    class FdSink : public OutputSink
+    {
+    public:
+        explicit FdSink(int fd)
+            : fd_(fd)
+        {
+        }
+
+        void Write(std::string_view text) override;
+        void WriteParts(const std::string_view* parts, size_t count) override;
+
+    private:
+        int fd_;
+    };
+
+
+
+    // Сохраняет вывод в памяти. Накопленный текст доступен без копирования
+    class MemorySink : public OutputSink
+    {
+    public:
+        void Write(std::string_view text) override
+        {
+            text_ += text;
+        }
+
+        // Возвращает весь вывод. Ссылка действительна до следующей записи или Clear
+        [[nodiscard]] std::string_view View() const noexcept
+        {
+            return text_;
+        }
+
+        void Clear() noexcept
+        {
+            text_.clear();
+        }
+
+    private:
+        std::string text_;
+    };
+
+
+
+    // Поток, передающий выводимый в него текст приёмнику sink без промежуточного буфера
+    class SinkStream : public std::ostream
+    {
+    public:
+        explicit SinkStream(OutputSink& sink);
+
+    private:
+        class Buffer : public std::streambuf
+        {
+        public:
+            explicit Buffer(OutputSink& sink)
+                : sink_(sink)
+            {
+            }
+
+        protected:
+            int_type overflow(int_type ch) override;
+            std::streamsize xsputn(const char* s, std::streamsize count) override;
+            int sync() override;
+
+        private:
+            OutputSink& sink_;
+        };
+
+        Buffer buffer_;
+    };
+
+}  // namespace runtime
@@ -3,12 +3,18 @@
 #include "lexer.h"
 #include "statement.h"
 
+#include <optional>
+#include <utility>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
 
 namespace
 {
+    const runtime::Symbol STR_FUNCTION{ "str"sv };
+    const runtime::Symbol SELF{ "self"sv };
+
     bool operator==(const parse::Token& token, char c)
     {
         const auto* p = token.TryAs<TokenType::Char>();
@@ -20,6 +26,43 @@ namespace
         return !(token == c);
     }
 
+    // Локальные переменные разбираемого метода и номера их ячеек в кадре вызова
+    class MethodScope
+    {
+    public:
+        // Ячейка 0 отводится под self, ячейки 1..n - под параметры метода
+        explicit MethodScope(const vector<runtime::Symbol>& formal_params)
+            : frame_size_(formal_params.size() + 1)
+        {
+            slots_.emplace(SELF, 0);
+            for (size_t i = 0; i < formal_params.size(); ++i)
+            {
+                // Как и в Closure, при совпадении имён побеждает первое из них
+                slots_.emplace(formal_params[i], i + 1);
+            }
+        }
+
+        // Возвращает номер ячейки переменной name, при необходимости выделяя новую ячейку
+        size_t Resolve(runtime::Symbol name)
+        {
+            auto [it, inserted] = slots_.emplace(name, frame_size_);
+            if (inserted)
+            {
+                ++frame_size_;
+            }
+            return it->second;
+        }
+
+        [[nodiscard]] size_t GetFrameSize() const
+        {
+            return frame_size_;
+        }
+
+    private:
+        unordered_map<runtime::Symbol, size_t, runtime::SymbolHasher> slots_;
+        size_t frame_size_;
+    };
+
     class Parser
     {
     public:
@@ -87,7 +130,11 @@ namespace
                 lexer_.ExpectNext<TokenType::Char>(':');
                 lexer_.NextToken();
 
+                // Переменные тела метода размещаются в ячейках кадра, а не в Closure
+                auto outer_scope = exchange(method_scope_, MethodScope(m.formal_params));
                 m.body = make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+                m.frame_size = method_scope_->GetFrameSize();
+                method_scope_ = move(outer_scope);
 
                 result.push_back(move(m));
             }
@@ -135,12 +182,28 @@ namespace
                 throw ParseError("Class "s + class_name + " already exists"s);
             }
 
+            if (method_scope_)
+            {
+                return make_unique<ast::ClassDefinition>(it->second,
+                    method_scope_->Resolve(class_name));
+            }
             return make_unique<ast::ClassDefinition>(it->second);
         }
 
-        vector<string> ParseDottedIds()
+        // Создаёт узел чтения переменной либо цепочки полей dotted_ids
+        ast::VariableValue MakeVariableValue(vector<runtime::Symbol> dotted_ids)
         {
-            vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+            if (method_scope_)
+            {
+                const size_t slot = method_scope_->Resolve(dotted_ids.front());
+                return ast::VariableValue(move(dotted_ids), slot);
+            }
+            return ast::VariableValue(move(dotted_ids));
+        }
+
+        vector<runtime::Symbol> ParseDottedIds()
+        {
+            vector<runtime::Symbol> result(1, lexer_.Expect<TokenType::Id>().value);
 
             while (lexer_.NextToken() == '.')
             {
@@ -156,8 +219,8 @@ namespace
         {
             lexer_.Expect<TokenType::Id>();
 
-            vector<string> id_list = ParseDottedIds();
-            string last_name = id_list.back();
+            vector<runtime::Symbol> id_list = ParseDottedIds();
+            runtime::Symbol last_name = id_list.back();
             id_list.pop_back();
 
             if (lexer_.CurrentToken() == '=')
@@ -166,17 +229,22 @@ namespace
 
                 if (id_list.empty())
                 {
-                    return make_unique<ast::Assignment>(move(last_name), ParseTest());
+                    if (method_scope_)
+                    {
+                        const size_t slot = method_scope_->Resolve(last_name);
+                        return make_unique<ast::Assignment>(last_name, slot, ParseTest());
+                    }
+                    return make_unique<ast::Assignment>(last_name, ParseTest());
                 }
-                return make_unique<ast::FieldAssignment>(ast::VariableValue{ move(id_list) },
-                    move(last_name), ParseTest());
+                return make_unique<ast::FieldAssignment>(MakeVariableValue(move(id_list)),
+                    last_name, ParseTest());
             }
             lexer_.Expect<TokenType::Char>('(');
             lexer_.NextToken();
 
             if (id_list.empty())
             {
-                throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+                throw ParseError("Mython doesn't support functions, only methods: "s + last_name.GetName());
             }
 
             vector<unique_ptr<ast::Statement>> args;
@@ -187,8 +255,8 @@ namespace
             lexer_.Expect<TokenType::Char>(')');
             lexer_.NextToken();
 
-            return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(move(id_list)),
-                move(last_name), move(args));
+            return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(MakeVariableValue(move(id_list))),
+                last_name, move(args));
         }
 
         // Expr -> Adder ['+'/'-' Adder]*
@@ -290,7 +358,7 @@ namespace
 
         unique_ptr<ast::Statement> ParseDottedIdsInMultExpr()
         {
-            vector<string> names = ParseDottedIds();
+            vector<runtime::Symbol> names = ParseDottedIds();
 
             if (lexer_.CurrentToken() == '(')
             {
@@ -309,14 +377,15 @@ namespace
                 if (!names.empty())
                 {
                     return make_unique<ast::MethodCall>(
-                        make_unique<ast::VariableValue>(move(names)), move(method_name), move(args));
+                        make_unique<ast::VariableValue>(MakeVariableValue(move(names))),
+                        method_name, move(args));
                 }
                 if (auto it = declared_classes_.find(method_name); it != declared_classes_.end())
                 {
                     return make_unique<ast::NewInstance>(
                         static_cast<const runtime::Class&>(*it->second), move(args));  // NOLINT
                 }
-                if (method_name == "str"sv)
+                if (method_name == STR_FUNCTION)
                 {
                     if (args.size() != 1)
                     {
@@ -324,9 +393,9 @@ namespace
                     }
                     return make_unique<ast::Stringify>(move(args.front()));
                 }
-                throw ParseError("Unknown call to "s + method_name + "()"s);
+                throw ParseError("Unknown call to "s + method_name.GetName() + "()"s);
             }
-            return make_unique<ast::VariableValue>(move(names));
+            return make_unique<ast::VariableValue>(MakeVariableValue(move(names)));
         }
 
         vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
@@ -413,38 +482,32 @@ namespace
             if (tok == '<')
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Less, move(result),
-                    ParseExpression());
+                return make_unique<ast::Less>(move(result), ParseExpression());
             }
             if (tok == '>')
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Greater, move(result),
-                    ParseExpression());
+                return make_unique<ast::Greater>(move(result), ParseExpression());
             }
             if (tok.Is<TokenType::Eq>())
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Equal, move(result),
-                    ParseExpression());
+                return make_unique<ast::Equal>(move(result), ParseExpression());
             }
             if (tok.Is<TokenType::NotEq>())
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::NotEqual, move(result),
-                    ParseExpression());
+                return make_unique<ast::NotEqual>(move(result), ParseExpression());
             }
             if (tok.Is<TokenType::LessOrEq>())
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::LessOrEqual, move(result),
-                    ParseExpression());
+                return make_unique<ast::LessOrEqual>(move(result), ParseExpression());
             }
             if (tok.Is<TokenType::GreaterOrEq>())
             {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::GreaterOrEqual, move(result),
-                    ParseExpression());
+                return make_unique<ast::GreaterOrEqual>(move(result), ParseExpression());
             }
             return result;
         }
@@ -498,11 +561,13 @@ namespace
 
         parse::Lexer& lexer_;
         runtime::Closure declared_classes_;
+        // Область видимости метода, тело которого разбирается в данный момент
+        optional<MethodScope> method_scope_;
     };
 
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer)
+unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer)
 {
     return Parser{lexer}.ParseProgram();
 }
\ No newline at end of file
@@ -10,9 +10,9 @@ namespace parse
     class Lexer;
 }
 
-namespace runtime
+namespace ast
 {
-    class Executable;
+    class Statement;
 }
 
 struct ParseError : std::runtime_error
@@ -20,4 +20,4 @@ struct ParseError : std::runtime_error
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
+std::unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include "bytecode.h"
 #include "lexer.h"
 #include "parse.h"
 #include "statement.h"
@@ -9,13 +10,17 @@ using namespace std;
 namespace parse
 {
 
-    unique_ptr<ast::Statement> ParseProgramFromString(const string& program)
+    using bytecode::ExecutionMode;
+
+    // Разбирает программу и готовит её к выполнению способом mode
+    unique_ptr<runtime::Executable> ParseProgramFromString(const string& program, ExecutionMode mode)
     {
         istringstream is(program);
         parse::Lexer lexer(is);
-        return ParseProgram(lexer);
+        return bytecode::Prepare(ParseProgram(lexer), mode);
     }
 
+    template <ExecutionMode Mode>
     void TestSimpleProgram()
     {
         const string program = R"(
@@ -29,12 +34,13 @@ print x + y, z + n
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "9 hello, world\n"s);
+        ASSERT_EQUAL(context.output.View(), "9 hello, world\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestProgramWithClasses()
     {
         const string program = R"(
@@ -69,12 +75,13 @@ print program_name, origin, far_far_away, origin.SetX(1)
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        //ASSERT_EQUAL(context.output.str(), "Success\nSuccess\n"s);
+        //ASSERT_EQUAL(context.output.View(), "Success\nSuccess\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestProgramWithIf()
     {
         const string program = R"(
@@ -96,12 +103,13 @@ else:
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "x <= y\ny >= 0\n"s);
+        ASSERT_EQUAL(context.output.View(), "x <= y\ny >= 0\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestReturnFromIf()
     {
         const string program = R"(
@@ -119,12 +127,13 @@ print x.calc(2)
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "2\n"s);
+        ASSERT_EQUAL(context.output.View(), "2\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestRecursion()
     {
         const string program = R"(
@@ -147,12 +156,13 @@ print x.result
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "55\n"s);
+        ASSERT_EQUAL(context.output.View(), "55\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestRecursion2()
     {
         const string program = R"(
@@ -177,12 +187,13 @@ print x.call_count
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "17\n1\n115\n"s);
+        ASSERT_EQUAL(context.output.View(), "17\n1\n115\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestComplexLogicalExpression()
     {
         const string program = R"(
@@ -196,12 +207,13 @@ print ok
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(), "False\n"s);
+        ASSERT_EQUAL(context.output.View(), "False\n"s);
     }
 
+    template <ExecutionMode Mode>
     void TestClassicalPolymorphism()
     {
         const string program = R"(
@@ -249,23 +261,135 @@ print r, c, t1, t2
         runtime::DummyContext context;
 
         runtime::Closure closure;
-        auto tree = ParseProgramFromString(program);
+        auto tree = ParseProgramFromString(program, Mode);
         tree->Execute(closure, context);
 
-        ASSERT_EQUAL(context.output.str(),
+        ASSERT_EQUAL(context.output.View(),
             "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
     }
 
+    template <ExecutionMode Mode>
+    void TestMethodLocals()
+    {
+        const string program = R"(
+class Calc:
+  def __init__(base):
+    self.base = base
+
+  def sum(a, b):
+    total = a + b
+    if total > 10:
+      extra = self.base
+    else:
+      extra = 0
+    result = total + extra
+    return result
+
+  def fact(n):
+    if n < 2:
+      return 1
+    prev = n - 1
+    return n * self.fact(prev)
+
+  def none_local():
+    x = None
+    return x
+
+  def unbound_local(flag):
+    if flag:
+      y = 1
+    return y
+
+c = Calc(100)
+total = 7
+print c.sum(2, 3), c.sum(8, 9), c.fact(5), c.none_local(), total
+print c.unbound_local(True)
+print c.unbound_local(False)
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program, Mode);
+        try
+        {
+            tree->Execute(closure, context);
+            ASSERT(false);
+        }
+        catch (const runtime_error&)
+        {
+        }
+
+        ASSERT_EQUAL(context.output.View(), "5 117 120 None 7\n1\n"s);
+        ASSERT(closure.count("total"s));
+        ASSERT(!closure.count("result"s));
+    }
+
+    template <ExecutionMode Mode>
+    void TestFieldsWithDifferentShapes()
+    {
+        const string program = R"(
+class Box:
+  def __init__(first):
+    if first:
+      self.a = 1
+      self.b = 2
+    else:
+      self.b = 20
+      self.a = 10
+
+  def sum():
+    return self.a + self.b
+
+  def set_c(c):
+    self.c = c
+
+class Holder:
+  def __init__(box):
+    self.box = box
+
+x = Box(True)
+y = Box(False)
+print x.sum(), y.sum(), x.sum(), y.sum()
+y.set_c(5)
+x.set_c(7)
+print x.c, y.c, x.a, y.a
+h = Holder(y)
+print h.box.c + h.box.a
+print h.box.missing
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program, Mode);
+        ASSERT_THROWS(tree->Execute(closure, context), runtime_error);
+
+        ASSERT_EQUAL(context.output.View(), "3 30 3 30\n7 5 1 10\n15\n"s);
+    }
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr)
 {
-    RUN_TEST(tr, parse::TestSimpleProgram);
-    RUN_TEST(tr, parse::TestProgramWithClasses);
-    RUN_TEST(tr, parse::TestProgramWithIf);
-    RUN_TEST(tr, parse::TestReturnFromIf);
-    RUN_TEST(tr, parse::TestRecursion);
-    RUN_TEST(tr, parse::TestRecursion2);
-    RUN_TEST(tr, parse::TestComplexLogicalExpression);
-    RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestSimpleProgram<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestSimpleProgram<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestMethodLocals<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestMethodLocals<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestFieldsWithDifferentShapes<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestFieldsWithDifferentShapes<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestProgramWithClasses<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestProgramWithClasses<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestProgramWithIf<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestProgramWithIf<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestReturnFromIf<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestReturnFromIf<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestRecursion<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestRecursion<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestRecursion2<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestRecursion2<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestComplexLogicalExpression<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestComplexLogicalExpression<parse::ExecutionMode::BYTECODE>);
+    RUN_TEST(tr, parse::TestClassicalPolymorphism<parse::ExecutionMode::TREE>);
+    RUN_TEST(tr, parse::TestClassicalPolymorphism<parse::ExecutionMode::BYTECODE>);
 }
\ No newline at end of file
@@ -1,14 +1,147 @@
 #include "runtime.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <limits>
 #include <optional>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <intrin.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
 
 using namespace std;
 
 namespace runtime
 {
 
+    namespace
+    {
+        const Symbol EQ_METHOD{ "__eq__"sv };
+        const Symbol NE_METHOD{ "__ne__"sv };
+        const Symbol LT_METHOD{ "__lt__"sv };
+        const Symbol GT_METHOD{ "__gt__"sv };
+        const Symbol LE_METHOD{ "__le__"sv };
+        const Symbol GE_METHOD{ "__ge__"sv };
+        const Symbol CMP_METHOD{ "__cmp__"sv };
+        const Symbol STR_METHOD{ "__str__"sv };
+        const Symbol SELF{ "self"sv };
+
+        // Возвращает значение объекта object, вид которого уже проверен и соответствует типу T
+        template <typename T>
+        const auto& ValueOf(const ObjectHolder& object)
+        {
+            return static_cast<const T*>(object.Get())->GetValue();
+        }
+
+        // Сравнивает тексты строк, начиная с более дешёвых проверок длины и хеша
+        bool EqualStrings(const String& lhs, const String& rhs)
+        {
+            return &lhs == &rhs
+                || (lhs.GetLength() == rhs.GetLength() && lhs.GetHash() == rhs.GetHash()
+                    && lhs.GetValue() == rhs.GetValue());
+        }
+
+        /*
+         * Вычисляет сравнение одним вызовом пользовательского метода (см. FindComparisonCall).
+         * Возвращает nullopt, если ни один из методов не определён
+         */
+        optional<bool> CompareByMethod(const ObjectHolder& lhs, const ObjectHolder& rhs,
+            const ComparisonMethods& methods, Context& context)
+        {
+            const ComparisonCall call = FindComparisonCall(lhs, rhs, methods);
+            if (call.object == nullptr)
+                return nullopt;
+
+            ObjectHolder result = call.object->Call(*call.method, { call.reflected ? lhs : rhs }, context);
+            return call.three_way ? FromCmp(result, methods) : IsTrue(result);
+        }
+    }  // namespace
+
+    /*****************************************************
+    ******************   Class Symbol   *****************
+    ******************************************************/
+
+    Symbol::Symbol(string_view name)
+        : id_(SymbolTable::Instance().Intern(name))
+    {
+    }
+
+
+    Symbol::Symbol(const string& name)
+        : Symbol(string_view(name))
+    {
+    }
+
+
+    Symbol::Symbol(const char* name)
+        : Symbol(string_view(name))
+    {
+    }
+
+
+    const string& Symbol::GetName() const
+    {
+        return SymbolTable::Instance().GetName(id_);
+    }
+
+
+    ostream& operator<<(ostream& os, Symbol symbol)
+    {
+        return os << symbol.GetName();
+    }
+
+
+
+    /*****************************************************
+    ****************   Class SymbolTable   ***************
+    ******************************************************/
+
+    SymbolTable::SymbolTable()
+    {
+        // Номер 0 зарезервирован за пустым именем, которое соответствует Symbol()
+        names_.emplace_back();
+        ids_.emplace(names_.back(), 0);
+    }
+
+
+    SymbolTable& SymbolTable::Instance()
+    {
+        static SymbolTable table;
+        return table;
+    }
+
+
+    uint32_t SymbolTable::Intern(string_view name)
+    {
+        if (auto it = ids_.find(name); it != ids_.end())
+        {
+            return it->second;
+        }
+
+        const auto id = static_cast<uint32_t>(names_.size());
+        names_.emplace_back(name);
+        ids_.emplace(names_.back(), id);
+        return id;
+    }
+
+
+    const string& SymbolTable::GetName(uint32_t id) const
+    {
+        return names_.at(id);
+    }
+
+
+
     /*****************************************************
     **************   Class ObjectHolder   ***************
     ******************************************************/
@@ -18,15 +151,18 @@ namespace runtime
     {
     }
 
+
     void ObjectHolder::AssertIsValid() const
     {
-        assert(data_ != nullptr);
+        assert(Get() != nullptr);
     }
 
     ObjectHolder ObjectHolder::Share(Object& object)
     {
-        // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-        return ObjectHolder(shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+        // Храним простой указатель: временем жизни объекта управляет его владелец
+        ObjectHolder result;
+        result.data_.emplace<Object*>(&object);
+        return result;
     }
 
 
@@ -36,6 +172,16 @@ namespace runtime
     }
 
 
+    ObjectHolder ObjectHolder::FromBool(bool value)
+    {
+        // Объекты не разрушаются до завершения программы
+        static Bool true_object(true);
+        static Bool false_object(false);
+
+        return Share(value ? true_object : false_object);
+    }
+
+
     Object& ObjectHolder::operator*() const
     {
         AssertIsValid();
@@ -52,7 +198,22 @@ namespace runtime
 
     Object* ObjectHolder::Get() const
     {
-        return data_.get();
+        if (const auto* object = get_if<shared_ptr<Object>>(&data_))
+        {
+            return object->get();
+        }
+        else if (Object* const* object = get_if<Object*>(&data_))
+        {
+            return *object;
+        }
+        else if (Number* number = get_if<Number>(&data_))
+        {
+            return number;
+        }
+        else
+        {
+            return nullptr;
+        }
     }
 
 
@@ -62,33 +223,371 @@ namespace runtime
     }
 
 
+    Object::Kind ObjectHolder::GetKind() const
+    {
+        if (const auto* object = get_if<shared_ptr<Object>>(&data_))
+        {
+            return *object ? (*object)->GetKind() : Object::Kind::NONE;
+        }
+        else if (Object* const* object = get_if<Object*>(&data_))
+        {
+            return (*object)->GetKind();
+        }
+        else if (holds_alternative<Number>(data_))
+        {
+            return Object::Kind::NUMBER;
+        }
+        else
+        {
+            return Object::Kind::NONE;
+        }
+    }
+
+
+
+    /*****************************************************
+    ****************   Class ValueStack   ***************
+    ******************************************************/
+
+    ValueStack::Frame::Frame(ValueStack& stack, size_t size)
+        : stack_(stack)
+        , outer_base_(stack.PushFrame(size))
+    {
+    }
+
+
+    ValueStack::Frame::~Frame()
+    {
+        stack_.PopFrame(outer_base_);
+    }
+
+
+    size_t ValueStack::PushFrame(size_t size)
+    {
+        const size_t outer_base = base_;
+        base_ = slots_.size();
+        slots_.resize(base_ + size, ObjectHolder::Unassigned());
+        return outer_base;
+    }
+
+
+    void ValueStack::PopFrame(size_t outer_base)
+    {
+        slots_.resize(base_);
+        base_ = outer_base;
+    }
+
+
+
+    /*****************************************************
+    *************   Class FormatBuffer   ****************
+    ******************************************************/
+
+    namespace
+    {
+        // Вмещает запись любого int со знаком
+        using NumberDigits = array<char, numeric_limits<int>::digits10 + 2>;
+
+        string_view FormatNumber(int value, NumberDigits& digits)
+        {
+            const auto result = to_chars(digits.data(), digits.data() + digits.size(), value);
+            return { digits.data(), static_cast<size_t>(result.ptr - digits.data()) };
+        }
+    }  // namespace
+
+
+    bool FormatBuffer::TryAppend(const ObjectHolder& value)
+    {
+        switch (value.GetKind())
+        {
+        case Object::Kind::NONE:
+            Append("None"sv);
+            return true;
+        case Object::Kind::NUMBER:
+            Append(value.TryAs<Number>()->GetValue());
+            return true;
+        case Object::Kind::BOOL:
+            Append(value.TryAs<Bool>()->GetValue() ? "True"sv : "False"sv);
+            return true;
+        case Object::Kind::STRING:
+            Append(value.TryAs<String>()->GetValue());
+            return true;
+        default:
+            return false;
+        }
+    }
+
+
+    void FormatBuffer::Append(int number)
+    {
+        NumberDigits digits;
+        buffer_ += FormatNumber(number, digits);
+    }
+
+
+    void FormatBuffer::WriteTo(OutputSink& sink)
+    {
+        if (buffer_.empty())
+            return;
+        sink.Write(buffer_);
+        buffer_.clear();
+    }
+
+
+
+    /*****************************************************
+    ***************   Class Context   *******************
+    ******************************************************/
+
+    Context::Context(OutputSink& output)
+        : output_(output)
+        , output_stream_(output)
+    {
+    }
+
+
+    namespace
+    {
+        // Запас стека для функций C++, выполняемых между двумя вызовами NativeCall,
+        // и для раскрутки стека при выбросе исключения
+        constexpr size_t STACK_RESERVE = 256 * 1024;
+
+        // Возвращает адрес в текущем кадре стека процесса. Стек растёт вниз
+        const char* StackPosition()
+        {
+#ifdef _MSC_VER
+            return static_cast<const char*>(_AddressOfReturnAddress());
+#else
+            return static_cast<const char*>(__builtin_frame_address(0));
+#endif
+        }
+
+        // Возвращает нижнюю границу стека текущего потока либо nullptr, если она неизвестна
+        const char* FindStackEnd()
+        {
+#ifdef _WIN32
+            ULONG_PTR low = 0;
+            ULONG_PTR high = 0;
+            GetCurrentThreadStackLimits(&low, &high);
+            return reinterpret_cast<const char*>(low);
+#elif defined(__linux__)
+            pthread_attr_t attributes;
+            if (pthread_getattr_np(pthread_self(), &attributes) != 0)
+                return nullptr;
+            void* address = nullptr;
+            size_t size = 0;
+            const bool found = pthread_attr_getstack(&attributes, &address, &size) == 0;
+            pthread_attr_destroy(&attributes);
+            return found ? static_cast<const char*>(address) : nullptr;
+#else
+            return nullptr;
+#endif
+        }
+
+        // Возвращает адрес, ниже которого вызовы NativeCall не опускают стек текущего потока,
+        // либо nullptr, если границы стека неизвестны и глубину ограничивает только счётчик вызовов
+        const char* StackLimit()
+        {
+            thread_local const char* const limit = []() -> const char*
+                {
+                    const char* end = FindStackEnd();
+                    return end != nullptr && StackPosition() - end > static_cast<ptrdiff_t>(2 * STACK_RESERVE)
+                        ? end + STACK_RESERVE
+                        : nullptr;
+                }();
+            return limit;
+        }
+    }  // namespace
+
+
+    Context::NativeCall::NativeCall(Context& context)
+        : context_(context)
+    {
+        if (context_.native_depth_ == 0)
+            context_.stack_limit_ = StackLimit();
+        if (context_.native_depth_ >= context_.call_limits_.max_native_depth
+            || StackPosition() < context_.stack_limit_)
+            throw runtime_error("ClassInstance::Call: Maximum recursion depth exceeded"s);
+        ++context_.native_depth_;
+    }
+
+
+    Context::NativeCall::~NativeCall()
+    {
+        --context_.native_depth_;
+    }
+
+
+
+    bool CanReplaceCall(const Object* self, const ObjectHolder& object,
+        const ObjectHolder* args_begin, const ObjectHolder* args_end)
+    {
+        if (object.Get() == self)
+            return true;
+        return none_of(args_begin, args_end, [self](const ObjectHolder& arg) {
+            return arg.Get() == self;
+        });
+    }
+
+
 
     bool IsTrue(const ObjectHolder& object)
     {
-        if (object)
+        switch (object.GetKind())
         {
-            if (object.TryAs<String>())
-            {
-                return !object.TryAs<String>()->GetValue().empty();
-            }
-            else if (object.TryAs<Bool>())
-            {
-                return object.TryAs<Bool>()->GetValue();
-            }
-            else if (object.TryAs<Number>())
-            {
-                return object.TryAs<Number>()->GetValue() != 0;
-            }
-            else
+        case Object::Kind::STRING:
+            return static_cast<const String*>(object.Get())->GetLength() != 0;
+        case Object::Kind::BOOL:
+            return ValueOf<Bool>(object);
+        case Object::Kind::NUMBER:
+            return ValueOf<Number>(object) != 0;
+        default:
+            return false;
+        }
+    }
+
+
+
+    /*****************************************************
+    ******************   Class Shape   ******************
+    ******************************************************/
+
+    Shape::Shape()
+    {
+        // Номер 0 не принадлежит ни одной форме и обозначает пустой кеш
+        static uint64_t last_id = 0;
+        id_ = ++last_id;
+    }
+
+
+    size_t Shape::FindField(Symbol name) const
+    {
+        if (fields_.size() <= LINEAR_SEARCH_LIMIT)
+        {
+            for (size_t i = 0; i < fields_.size(); ++i)
             {
-                return false;
+                if (fields_[i] == name)
+                    return i;
             }
+            return NO_FIELD;
         }
-        else
-        {
-            return false;
 
+        auto it = lower_bound(sorted_fields_.begin(), sorted_fields_.end(),
+            make_pair(name.GetId(), size_t{ 0 }));
+        return it != sorted_fields_.end() && it->first == name.GetId() ? it->second : NO_FIELD;
+    }
+
+
+    const Shape& Shape::AddField(Symbol name) const
+    {
+        unique_ptr<Shape>& next = transitions_[name];
+        if (!next)
+        {
+            next = make_unique<Shape>();
+            next->fields_ = fields_;
+            next->fields_.push_back(name);
+
+            const auto field = make_pair(name.GetId(), fields_.size());
+            next->sorted_fields_ = sorted_fields_;
+            next->sorted_fields_.insert(
+                lower_bound(next->sorted_fields_.begin(), next->sorted_fields_.end(), field), field);
         }
+        return *next;
+    }
+
+
+
+    /*****************************************************
+    *************   Class InstanceFields   **************
+    ******************************************************/
+
+    InstanceFields::InstanceFields(const Shape& shape)
+        : shape_(&shape)
+        , values_(shape.GetFieldCount())
+    {
+    }
+
+
+    ObjectHolder& InstanceFields::operator[](Symbol name)
+    {
+        return values_[Define(name)];
+    }
+
+
+    ObjectHolder& InstanceFields::at(Symbol name)
+    {
+        const size_t slot = shape_->FindField(name);
+        if (slot == Shape::NO_FIELD)
+            throw out_of_range("InstanceFields::at: No field "s + name.GetName());
+        return values_[slot];
+    }
+
+
+    const ObjectHolder& InstanceFields::at(Symbol name) const
+    {
+        return const_cast<InstanceFields*>(this)->at(name);
+    }
+
+
+    InstanceFields::iterator InstanceFields::find(Symbol name)
+    {
+        const size_t slot = shape_->FindField(name);
+        return slot == Shape::NO_FIELD ? end() : iterator(*shape_, values_.data(), slot);
+    }
+
+
+    InstanceFields::const_iterator InstanceFields::find(Symbol name) const
+    {
+        const size_t slot = shape_->FindField(name);
+        return slot == Shape::NO_FIELD ? end() : const_iterator(*shape_, values_.data(), slot);
+    }
+
+
+    size_t InstanceFields::count(Symbol name) const
+    {
+        return shape_->FindField(name) == Shape::NO_FIELD ? 0 : 1;
+    }
+
+
+    InstanceFields::iterator InstanceFields::begin()
+    {
+        return iterator(*shape_, values_.data(), 0);
+    }
+
+
+    InstanceFields::iterator InstanceFields::end()
+    {
+        return iterator(*shape_, values_.data(), values_.size());
+    }
+
+
+    InstanceFields::const_iterator InstanceFields::begin() const
+    {
+        return const_iterator(*shape_, values_.data(), 0);
+    }
+
+
+    InstanceFields::const_iterator InstanceFields::end() const
+    {
+        return const_iterator(*shape_, values_.data(), values_.size());
+    }
+
+
+    size_t InstanceFields::Define(Symbol name)
+    {
+        const size_t slot = shape_->FindField(name);
+        if (slot != Shape::NO_FIELD)
+            return slot;
+
+        ExtendTo(shape_->AddField(name));
+        return values_.size() - 1;
+    }
+
+
+    void InstanceFields::ExtendTo(const Shape& shape)
+    {
+        shape_ = &shape;
+        values_.resize(shape.GetFieldCount());
     }
 
 
@@ -98,65 +597,158 @@ namespace runtime
     ******************************************************/
 
     ClassInstance::ClassInstance(const Class& cls)
-        : class_(cls)
-        , class_field_()
+        : Object(KIND)
+        , class_(cls)
+        , class_field_(cls.GetRootShape())
     {
     }
 
 
     void ClassInstance::Print(ostream& os, Context& context)
     {
-        if (HasMethod("__str__"s, 0))
-            Call("__str__"s, {}, context)->Print(os, context);
+        if (const Method* str = GetStrMethod())
+            Call(*str, {}, context)->Print(os, context);
         else
             os << this;
     }
 
 
-    bool ClassInstance::HasMethod(const string& method, size_t argument_count) const
+    bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const
     {
-        return class_.GetMethod(method) != nullptr &&
-            (class_.GetMethod(method)->formal_params.size()) == argument_count;
+        return class_.GetMethod(method, argument_count) != nullptr;
     }
 
 
-    Closure& ClassInstance::Fields()
+    const Method* ClassInstance::GetStrMethod() const
+    {
+        return class_.GetMethod(STR_METHOD, 0);
+    }
+
+
+    InstanceFields& ClassInstance::Fields()
     {
         return class_field_;
     }
 
 
-    const Closure& ClassInstance::Fields() const
+    const InstanceFields& ClassInstance::Fields() const
     {
-        return const_cast<const Closure&>(class_field_);
+        return const_cast<const InstanceFields&>(class_field_);
     }
 
 
-    ObjectHolder ClassInstance::Call(const string& method,
+    ObjectHolder ClassInstance::Call(Symbol method,
         const vector<ObjectHolder>& actual_args,
         Context& context)
     {
-        if (HasMethod(method, actual_args.size()))
+        const Method* called = class_.GetMethod(method, actual_args.size());
+        if (called == nullptr)
         {
-            // Создаём контейнер для аргументов, передающихся в метод
-            Closure args;
+            throw runtime_error("ClassInstance::Call: No method with passed parameters"s);
+        }
+
+        return Call(*called, actual_args, context);
+    }
 
-            // Передаём в метод ссылку на обьект (self)
-            args.emplace("self"s, ObjectHolder::Share(*this));
 
+    ObjectHolder ClassInstance::Call(const Method& method,
+        const vector<ObjectHolder>& actual_args,
+        Context& context)
+    {
+        MethodCallScope scope(context, *this);
+        ObjectHolder result = Execute(method, actual_args, context);
+        scope.Finish(result);
+        return result;
+    }
+
+
+    ObjectHolder ClassInstance::Execute(const Method& method,
+        const vector<ObjectHolder>& actual_args,
+        Context& context)
+    {
+        if (method.frame_size != 0)
+        {
+            // Размещаем self и аргументы в ячейках нового кадра
+            ValueStack& stack = context.GetValueStack();
+            ValueStack::Frame frame(stack, method.frame_size);
+
+            stack.Local(0) = ObjectHolder::Share(*this);
             for (size_t i = 0; i < actual_args.size(); i++)
             {
-                // Заполняем контейнер аргументов: передаём имя параметра, взятое из метода и аргумент, переданный в метод
-                args.emplace(class_.GetMethod(method)->formal_params[i], actual_args[i]);
+                stack.Local(i + 1) = actual_args[i];
             }
 
-            // Вызываем у метода тело с переданными аргументами 
-            return class_.GetMethod(method)->body->Execute(args, context);
+            return method.body->Execute(stack.EmptyClosure(), context);
         }
-        else
+
+        return ExecuteInClosure(method, actual_args, context);
+    }
+
+
+    ObjectHolder ClassInstance::ExecuteInClosure(const Method& method,
+        const vector<ObjectHolder>& actual_args,
+        Context& context)
+    {
+        // Создаём контейнер для аргументов, передающихся в метод
+        Closure args;
+
+        // Передаём в метод ссылку на обьект (self)
+        args.emplace(SELF, ObjectHolder::Share(*this));
+
+        for (size_t i = 0; i < actual_args.size(); i++)
         {
-            throw runtime_error("ClassInstance::Call: No method with passed parameters"s);
+            // Заполняем контейнер аргументов: передаём имя параметра, взятое из метода и аргумент, переданный в метод
+            args.emplace(method.formal_params[i], actual_args[i]);
         }
+
+        // Вызываем у метода тело с переданными аргументами 
+        return method.body->Execute(args, context);
+    }
+
+
+
+    /*****************************************************
+    **************   Class MethodCallScope   *************
+    ******************************************************/
+
+    MethodCallScope::MethodCallScope(Context& context, const ClassInstance& self)
+        : call_(context)
+        , context_(context)
+    {
+        tail_call_.self = &self;
+        outer_ = context_.ExchangeTailCall(&tail_call_);
+    }
+
+
+    MethodCallScope::~MethodCallScope()
+    {
+        context_.ExchangeTailCall(outer_);
+    }
+
+
+    void MethodCallScope::RunTailCalls(ObjectHolder& result)
+    {
+        // Объект отложенного вызова, который может больше нигде не храниться
+        ObjectHolder owner;
+        while (tail_call_.method != nullptr)
+        {
+            const Method& next = *exchange(tail_call_.method, nullptr);
+            const vector<ObjectHolder> args = move(tail_call_.args);
+            tail_call_.args.clear();
+
+            auto* instance = tail_call_.object.TryAs<ClassInstance>();
+            if (instance != tail_call_.self)
+            {
+                owner = move(tail_call_.object);
+                tail_call_.self = instance;
+            }
+            tail_call_.object = ObjectHolder::None();
+            result = instance->Execute(next, args, context_);
+        }
+
+        // Метод, вернувший self, не должен пережить свой объект
+        if (owner && result.Get() == owner.Get())
+            result = move(owner);
     }
 
 
@@ -166,28 +758,33 @@ namespace runtime
     ******************************************************/
 
     Class::Class(string name, vector<Method> methods, const Class* parent)
-        : methods_()
+        : Object(KIND)
+        , methods_()
         , name_(name)
         , parent_(parent)
+        , root_shape_(make_unique<Shape>())
     {
         for (Method& method : methods)
             methods_[method.name] = move(method);
+
+        // Родительский класс уже содержит полную таблицу, дополняем её своими методами.
+        // Узлы unordered_map не перемещаются, поэтому указатели на методы остаются действительными
+        if (parent_ != nullptr)
+            method_table_ = parent_->method_table_;
+        for (const auto& [method_name, method] : methods_)
+            method_table_[method_name] = &method;
     }
 
-    const Method* Class::GetMethod(const string& name) const
+    const Method* Class::GetMethod(Symbol name) const
     {
-        if (methods_.count(name))
-        {
-            return &methods_.at(name);
-        }
-        else if (parent_ != nullptr && parent_->GetMethod(name))
-        {
-            return parent_->GetMethod(name);
-        }
-        else
-        {
-            return nullptr;
-        }
+        auto it = method_table_.find(name);
+        return it != method_table_.end() ? it->second : nullptr;
+    }
+
+    const Method* Class::GetMethod(Symbol name, size_t argument_count) const
+    {
+        const Method* method = GetMethod(name);
+        return method != nullptr && method->formal_params.size() == argument_count ? method : nullptr;
     }
 
     [[nodiscard]] const string& Class::GetName() const
@@ -204,6 +801,117 @@ namespace runtime
 
     /*****************   Class String   *******************/
 
+    // Узел дерева фрагментов строки: лист с текстом либо конкатенация двух поддеревьев
+    struct String::Rope
+    {
+        string text;
+        shared_ptr<Rope> left;
+        shared_ptr<Rope> right;
+
+        ~Rope();
+    };
+
+
+    String::Rope::~Rope()
+    {
+        // Длинную цепочку конкатенаций разрушаем без рекурсии: забираем у узлов поддеревья,
+        // которыми больше никто не владеет, и разрушаем узлы уже без потомков
+        vector<shared_ptr<Rope>> pending;
+        auto take = [&pending](shared_ptr<Rope>& node)
+        {
+            if (node && node.use_count() == 1)
+                pending.push_back(move(node));
+        };
+
+        take(left);
+        take(right);
+        while (!pending.empty())
+        {
+            shared_ptr<Rope> node = move(pending.back());
+            pending.pop_back();
+            take(node->left);
+            take(node->right);
+        }
+    }
+
+
+    String::String(string value)
+        : Object(KIND)
+        , value_(move(value))
+        , length_(value_.size())
+    {
+    }
+
+
+    String String::Concat(const String& lhs, const String& rhs)
+    {
+        // Короткие строки дешевле склеить сразу
+        constexpr size_t FLAT_CONCAT_LIMIT = 64;
+
+        const size_t length = lhs.length_ + rhs.length_;
+        if (length <= FLAT_CONCAT_LIMIT)
+        {
+            string value;
+            value.reserve(length);
+            value.append(lhs.GetValue()).append(rhs.GetValue());
+            return String(move(value));
+        }
+
+        String result(string{});
+        result.rope_ = make_shared<Rope>();
+        result.rope_->left = lhs.ToRope();
+        result.rope_->right = rhs.ToRope();
+        result.length_ = length;
+        return result;
+    }
+
+
+    shared_ptr<String::Rope> String::ToRope() const
+    {
+        if (rope_)
+            return rope_;
+
+        auto leaf = make_shared<Rope>();
+        leaf->text = value_;
+        return leaf;
+    }
+
+
+    const string& String::GetValue() const
+    {
+        if (rope_)
+        {
+            // Обходим листья слева направо без рекурсии
+            value_.reserve(length_);
+            vector<const Rope*> stack{ rope_.get() };
+            while (!stack.empty())
+            {
+                const Rope* node = stack.back();
+                stack.pop_back();
+                if (node->left)
+                {
+                    stack.push_back(node->right.get());
+                    stack.push_back(node->left.get());
+                }
+                else
+                {
+                    value_ += node->text;
+                }
+            }
+            rope_.reset();
+        }
+        return value_;
+    }
+
+
+    size_t String::GetHash() const
+    {
+        if (!hash_)
+            hash_ = hash<string>{}(GetValue());
+        return *hash_;
+    }
+
+
     void String::Print(ostream& os, [[maybe_unused]] Context& context)
     {
         os << GetValue();
@@ -215,7 +923,9 @@ namespace runtime
 
     void Number::Print(ostream& os, [[maybe_unused]] Context& context)
     {
-        os << GetValue();
+        // Поток выводит число с учётом локали, а to_chars - всегда одинаково и быстрее
+        NumberDigits digits;
+        os << FormatNumber(GetValue(), digits);
     }
 
 
@@ -231,27 +941,66 @@ namespace runtime
 
     /*******************   Supp Func   ********************/
 
-    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
-    {
-        const auto cls_obj = lhs.TryAs<ClassInstance>();
-        if (cls_obj != nullptr && cls_obj->HasMethod("__eq__", 1))
-            return cls_obj->Call("__eq__", { rhs }, context).TryAs<Bool>()->GetValue();
+    const ComparisonMethods EQUAL_METHODS{ EQ_METHOD, EQ_METHOD, [](int sign) { return sign == 0; } };
+    const ComparisonMethods NOT_EQUAL_METHODS{ NE_METHOD, NE_METHOD, [](int sign) { return sign != 0; } };
+    const ComparisonMethods LESS_METHODS{ LT_METHOD, GT_METHOD, [](int sign) { return sign < 0; } };
+    const ComparisonMethods GREATER_METHODS{ GT_METHOD, LT_METHOD, [](int sign) { return sign > 0; } };
+    const ComparisonMethods LESS_OR_EQUAL_METHODS{ LE_METHOD, GE_METHOD, [](int sign) { return sign <= 0; } };
+    const ComparisonMethods GREATER_OR_EQUAL_METHODS{ GE_METHOD, LE_METHOD, [](int sign) { return sign >= 0; } };
 
-        if (lhs.TryAs<String>() && rhs.TryAs<String>())
-        {
-            return lhs.TryAs<String>()->GetValue() == rhs.TryAs<String>()->GetValue();
-        }
-        else if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>())
+
+    ComparisonCall FindComparisonCall(const ObjectHolder& lhs, const ObjectHolder& rhs,
+        const ComparisonMethods& methods)
+    {
+        if (auto* instance = lhs.TryAs<ClassInstance>())
         {
-            return lhs.TryAs<Bool>()->GetValue() == rhs.TryAs<Bool>()->GetValue();
+            const Class& cls = instance->GetClass();
+            if (const Method* method = cls.GetMethod(methods.direct, 1))
+                return { instance, method, false, false };
+            if (const Method* method = cls.GetMethod(CMP_METHOD, 1))
+                return { instance, method, false, true };
         }
-        else if (lhs.TryAs<Number>() && rhs.TryAs<Number>())
+
+        if (auto* instance = rhs.TryAs<ClassInstance>())
         {
-            return lhs.TryAs<Number>()->GetValue() == rhs.TryAs<Number>()->GetValue();
+            if (const Method* method = instance->GetClass().GetMethod(methods.reflected, 1))
+                return { instance, method, true, false };
         }
-        else if (!lhs && !rhs)
+        return {};
+    }
+
+
+    bool FromCmp(const ObjectHolder& sign, const ComparisonMethods& methods)
+    {
+        const Number* number = sign.TryAs<Number>();
+        if (number == nullptr)
+            throw runtime_error("__cmp__ must return a number"s);
+        return methods.from_cmp(number->GetValue());
+    }
+
+
+    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+    {
+        if (optional<bool> result = CompareByMethod(lhs, rhs, EQUAL_METHODS, context))
+            return *result;
+
+        const Object::Kind kind = lhs.GetKind();
+        if (kind == rhs.GetKind())
         {
-            return true;
+            switch (kind)
+            {
+            case Object::Kind::STRING:
+                return EqualStrings(*static_cast<const String*>(lhs.Get()),
+                    *static_cast<const String*>(rhs.Get()));
+            case Object::Kind::BOOL:
+                return ValueOf<Bool>(lhs) == ValueOf<Bool>(rhs);
+            case Object::Kind::NUMBER:
+                return ValueOf<Number>(lhs) == ValueOf<Number>(rhs);
+            case Object::Kind::NONE:
+                return true;
+            default:
+                break;
+            }
         }
 
         throw runtime_error("Equal: No implementation of comparing two passed objects"s);
@@ -260,21 +1009,23 @@ namespace runtime
 
     bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
     {
-        ClassInstance* cls_obj = lhs.TryAs<ClassInstance>();
-        if (cls_obj != nullptr && cls_obj->HasMethod("__lt__", 1))
-            return cls_obj->Call("__lt__", { rhs }, context).TryAs<Bool>()->GetValue();
+        if (optional<bool> result = CompareByMethod(lhs, rhs, LESS_METHODS, context))
+            return *result;
 
-        if (lhs.TryAs<String>() && rhs.TryAs<String>())
+        const Object::Kind kind = lhs.GetKind();
+        if (kind == rhs.GetKind())
         {
-            return lhs.TryAs<String>()->GetValue() < rhs.TryAs<String>()->GetValue();
-        }
-        else if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>())
-        {
-            return lhs.TryAs<Bool>()->GetValue() < rhs.TryAs<Bool>()->GetValue();
-        }
-        else if (lhs.TryAs<Number>() && rhs.TryAs<Number>())
-        {
-            return lhs.TryAs<Number>()->GetValue() < rhs.TryAs<Number>()->GetValue();
+            switch (kind)
+            {
+            case Object::Kind::STRING:
+                return ValueOf<String>(lhs) < ValueOf<String>(rhs);
+            case Object::Kind::BOOL:
+                return ValueOf<Bool>(lhs) < ValueOf<Bool>(rhs);
+            case Object::Kind::NUMBER:
+                return ValueOf<Number>(lhs) < ValueOf<Number>(rhs);
+            default:
+                break;
+            }
         }
 
         throw runtime_error("Less: No implementation of comparing two passed objects"s);
@@ -283,24 +1034,33 @@ namespace runtime
 
     bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
     {
+        if (optional<bool> result = CompareByMethod(lhs, rhs, NOT_EQUAL_METHODS, context))
+            return *result;
         return !Equal(lhs, rhs, context);
     }
 
 
     bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
     {
+        if (optional<bool> result = CompareByMethod(lhs, rhs, GREATER_METHODS, context))
+            return *result;
+        // Без подходящего метода выражаем сравнение через __lt__ и __eq__
         return !Less(lhs, rhs, context) && NotEqual(lhs, rhs, context);
     }
 
 
     bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
     {
+        if (optional<bool> result = CompareByMethod(lhs, rhs, LESS_OR_EQUAL_METHODS, context))
+            return *result;
         return !Greater(lhs, rhs, context);
     }
 
 
     bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
     {
+        if (optional<bool> result = CompareByMethod(lhs, rhs, GREATER_OR_EQUAL_METHODS, context))
+            return *result;
         return !Less(lhs, rhs, context);
     }
 
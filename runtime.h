@@ -1,34 +1,240 @@
 #pragma once
 
+#include "output.h"
+
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace runtime
 {
 
-    // Контекст исполнения инструкций Mython
-    class Context
+    // Имя (идентификатор) Mython-программы, занесённое в таблицу символов интерпретатора.
+    // Каждое имя хранится в таблице в единственном экземпляре, поэтому символы сравниваются
+    // и хешируются как целые числа
+    class Symbol
     {
     public:
-        // Возвращает поток вывода для команд print
-        virtual std::ostream& GetOutputStream() = 0;
+        // Создаёт символ для пустого имени
+        Symbol() = default;
 
-    protected:
-        ~Context() = default;
+        // Заносит name в таблицу символов (если его там ещё нет) и создаёт соответствующий символ
+        Symbol(std::string_view name);    // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        Symbol(const std::string& name);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        Symbol(const char* name);         // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+        // Возвращает номер символа в таблице символов
+        [[nodiscard]] std::uint32_t GetId() const noexcept
+        {
+            return id_;
+        }
+
+        // Возвращает имя, соответствующее символу
+        [[nodiscard]] const std::string& GetName() const;
+
+        friend bool operator==(Symbol lhs, Symbol rhs) noexcept
+        {
+            return lhs.id_ == rhs.id_;
+        }
+
+        friend bool operator!=(Symbol lhs, Symbol rhs) noexcept
+        {
+            return lhs.id_ != rhs.id_;
+        }
+
+    private:
+        std::uint32_t id_ = 0;
+    };
+
+    std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+    // Хеш-функция для символов: номер символа уже уникален
+    struct SymbolHasher
+    {
+        size_t operator()(Symbol symbol) const noexcept
+        {
+            return symbol.GetId();
+        }
     };
 
 
 
+    // Таблица символов интерпретатора, связывающая имена с их номерами.
+    // Общая для всех программ, выполняемых интерпретатором
+    class SymbolTable
+    {
+    public:
+        static SymbolTable& Instance();
+
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable& operator=(const SymbolTable&) = delete;
+
+        // Возвращает номер имени name, при необходимости занося его в таблицу
+        [[nodiscard]] std::uint32_t Intern(std::string_view name);
+
+        // Возвращает имя с номером id
+        [[nodiscard]] const std::string& GetName(std::uint32_t id) const;
+
+    private:
+        SymbolTable();
+
+        // deque не перемещает строки при добавлении, поэтому ключи ids_ остаются действительными
+        std::deque<std::string> names_;
+        std::unordered_map<std::string_view, std::uint32_t> ids_;
+    };
+
+
+
+    class Context;
+
+
+
     // Базовый класс для всех объектов языка Mython
     class Object
     {
     public:
+        // Вид объекта. Позволяет узнать тип объекта без dynamic_cast
+        enum class Kind : std::uint8_t
+        {
+            NONE,            // значение None (пустой ObjectHolder)
+            NUMBER,          // Number
+            STRING,          // String
+            BOOL,            // Bool
+            CLASS,           // Class
+            CLASS_INSTANCE,  // ClassInstance
+            OTHER,           // прочие наследники Object
+        };
+
         virtual ~Object() = default;
         // выводит в os своё представление в виде строки
         virtual void Print(std::ostream& os, Context& context) = 0;
+
+        [[nodiscard]] Kind GetKind() const noexcept
+        {
+            return kind_;
+        }
+
+    protected:
+        Object() = default;
+
+        // Вид объекта задаёт только конкретный класс-наследник
+        explicit Object(Kind kind) noexcept
+            : kind_(kind)
+        {
+        }
+
+    private:
+        Kind kind_ = Kind::OTHER;
+    };
+
+    // Равно true, если у класса T есть собственный вид KIND, и его объекты можно распознать
+    // по GetKind() без dynamic_cast
+    template <typename T, typename = void>
+    constexpr bool HAS_OWN_KIND = false;
+
+    template <typename T>
+    constexpr bool HAS_OWN_KIND<T, std::void_t<decltype(T::KIND)>> = T::KIND != Object::Kind::OTHER;
+
+
+
+    // Объект-значение, хранящий значение типа T
+    template <typename T, Object::Kind K = Object::Kind::OTHER>
+    class ValueObject : public Object
+    {
+    public:
+        static constexpr Kind KIND = K;
+
+        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+            : Object(K)
+            , value_(v)
+        {
+        }
+
+        void Print(std::ostream& os, [[maybe_unused]] Context& context) override
+        {
+            os << value_;
+        }
+
+        [[nodiscard]] const T& GetValue() const
+        {
+            return value_;
+        }
+
+    private:
+        T value_;
+    };
+
+
+
+    /*
+     * Строковое значение.
+     * Короткие строки хранятся внутри объекта (small string optimization std::string).
+     * Результат конкатенации длинных строк хранится в виде дерева фрагментов (rope) и склеивается
+     * в одну строку только при первом обращении к тексту, поэтому построение строки добавлением
+     * фрагментов не копирует уже накопленный текст
+     */
+    class String : public Object
+    {
+    public:
+        static constexpr Kind KIND = Kind::STRING;
+
+        String(std::string value);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+        // Возвращает строку, равную lhs + rhs
+        [[nodiscard]] static String Concat(const String& lhs, const String& rhs);
+
+        void Print(std::ostream& os, Context& context) override;
+
+        // Возвращает текст строки, при необходимости склеивая фрагменты
+        [[nodiscard]] const std::string& GetValue() const;
+
+        [[nodiscard]] size_t GetLength() const noexcept
+        {
+            return length_;
+        }
+
+        // Возвращает хеш текста строки. Вычисляется при первом обращении
+        [[nodiscard]] size_t GetHash() const;
+
+    private:
+        // Узел дерева фрагментов (см. runtime.cpp)
+        struct Rope;
+
+        // Возвращает дерево фрагментов, представляющее текст строки
+        [[nodiscard]] std::shared_ptr<Rope> ToRope() const;
+
+        // Несклеенный результат конкатенации либо nullptr, если текст хранится в value_
+        mutable std::shared_ptr<Rope> rope_;
+        mutable std::string value_;
+        size_t length_;
+        mutable std::optional<size_t> hash_;
+    };
+
+
+    // Числовое значение
+    class Number : public ValueObject<int, Object::Kind::NUMBER>
+    {
+    public:
+        using ValueObject<int, Object::Kind::NUMBER>::ValueObject;
+        void Print(std::ostream& os, Context& context) override;
+    };
+
+
+    // Логическое значение
+    class Bool : public ValueObject<bool, Object::Kind::BOOL>
+    {
+    public:
+        using ValueObject<bool, Object::Kind::BOOL>::ValueObject;
+        void Print(std::ostream& os, Context& context) override;
     };
 
 
@@ -37,23 +243,48 @@ namespace runtime
     class ObjectHolder
     {
     public:
+        // Объекты типа T хранятся непосредственно внутри ObjectHolder, без выделения памяти в куче
+        template <typename T>
+        static constexpr bool IS_INLINE = std::is_same_v<T, Number>;
+
         // Создаёт пустое значение
         ObjectHolder() = default;
 
         // Возвращает ObjectHolder, владеющий объектом типа T
         // Тип T - конкретный класс-наследник Object.
-        // object копируется или перемещается в кучу
+        // object копируется или перемещается внутрь ObjectHolder (см. IS_INLINE) либо в кучу.
+        // Вместо значений Bool возвращаются общие объекты True и False (см. FromBool)
         template <typename T>
         [[nodiscard]] static ObjectHolder Own(T&& object)
         {
-            return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+            using Type = std::decay_t<T>;
+            if constexpr (std::is_same_v<Type, Bool>)
+            {
+                return FromBool(object.GetValue());
+            }
+            else if constexpr (IS_INLINE<Type>)
+            {
+                ObjectHolder result;
+                result.data_.emplace<Type>(std::forward<T>(object));
+                return result;
+            }
+            else
+            {
+                return ObjectHolder(std::make_shared<Type>(std::forward<T>(object)));
+            }
         }
 
-        // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
+        // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки).
+        // Не выделяет память: внутри хранится только указатель на object
         [[nodiscard]] static ObjectHolder Share(Object& object);
         // Создаёт пустой ObjectHolder, соответствующий значению None
         [[nodiscard]] static ObjectHolder None();
 
+        // Возвращает ссылку на общий для всего интерпретатора объект True либо False.
+        // Эти объекты существуют всё время работы программы, поэтому ObjectHolder хранит
+        // лишь указатель на них без подсчёта ссылок
+        [[nodiscard]] static ObjectHolder FromBool(bool value);
+
         // Возвращает ссылку на Object внутри ObjectHolder.
         // ObjectHolder должен быть непустым
         Object& operator*() const;
@@ -63,53 +294,292 @@ namespace runtime
         [[nodiscard]] Object* Get() const;
 
         // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
-        // объект данного типа
+        // объект данного типа.
+        // Указатель на объект, хранящийся внутри ObjectHolder, действителен, пока жив сам ObjectHolder
         template <typename T>
         [[nodiscard]] T* TryAs() const
         {
-            return dynamic_cast<T*>(this->Get());
+            if constexpr (IS_INLINE<T>)
+            {
+                if (T* value = std::get_if<T>(&data_))
+                {
+                    return value;
+                }
+            }
+
+            if constexpr (HAS_OWN_KIND<T>)
+            {
+                Object* object = this->Get();
+                return object != nullptr && object->GetKind() == T::KIND ? static_cast<T*>(object)
+                                                                          : nullptr;
+            }
+            else
+            {
+                return dynamic_cast<T*>(this->Get());
+            }
         }
 
+        // Возвращает вид хранящегося объекта. Для None возвращает Object::Kind::NONE
+        [[nodiscard]] Object::Kind GetKind() const;
+
         // Возвращает true, если ObjectHolder не пуст
         explicit operator bool() const;
 
+        // Возвращает значение ячейки ValueStack, переменной в которой ещё не присвоено значение.
+        // Как и None, оно пусто, но отличается от None результатом IsUnassigned.
+        // Вид такого значения не определён, поэтому GetKind и операции с ним не вызываются
+        [[nodiscard]] static ObjectHolder Unassigned() noexcept
+        {
+            ObjectHolder result;
+            result.data_.emplace<Object*>(nullptr);
+            return result;
+        }
+
+        [[nodiscard]] bool IsUnassigned() const noexcept
+        {
+            Object* const* object = std::get_if<Object*>(&data_);
+            return object != nullptr && *object == nullptr;
+        }
+
     private:
+        // Пусто (None), объект в куче, чужой объект (см. Share; nullptr - см. Unassigned)
+        // либо значение, хранящееся по месту
+        using Data = std::variant<std::monostate, std::shared_ptr<Object>, Object*, Number>;
+
         explicit ObjectHolder(std::shared_ptr<Object> data);
         void AssertIsValid() const;
 
-        std::shared_ptr<Object> data_;
+        mutable Data data_;
     };
 
 
 
-    // Объект-значение, хранящий значение типа T
-    template <typename T>
-    class ValueObject : public Object
+    // Таблица символов, связывающая имя объекта с его значением
+    using Closure = std::unordered_map<Symbol, ObjectHolder, SymbolHasher>;
+
+    /*
+     * Стек значений локальных переменных вызванных методов.
+     * Парсер назначает self, параметрам и локальным переменным каждого метода номера ячеек кадра,
+     * поэтому вызов метода выделяет на стеке непрерывный кадр, а не создаёт новый Closure
+     */
+    class ValueStack
     {
     public:
-        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-            : value_(v)
+        // Кадр вызова метода: занимает на стеке size ячеек и освобождает их при разрушении
+        class Frame
         {
+        public:
+            Frame(ValueStack& stack, size_t size);
+            ~Frame();
+
+            Frame(const Frame&) = delete;
+            Frame& operator=(const Frame&) = delete;
+
+        private:
+            ValueStack& stack_;
+            size_t outer_base_;
+        };
+
+        // Возвращает ячейку slot текущего кадра.
+        // Пока переменной не присвоено значение, ячейка хранит ObjectHolder::Unassigned().
+        // Ссылка действительна до создания следующего кадра
+        [[nodiscard]] ObjectHolder& Local(size_t slot)
+        {
+            return slots_[base_ + slot];
         }
 
-        void Print(std::ostream& os, [[maybe_unused]] Context& context) override
+        // Выделяет кадр из size ячеек и делает его текущим. Возвращает значение, которое
+        // нужно передать PopFrame для возврата к прежнему кадру. Обычно кадрами управляет Frame,
+        // а виртуальная машина, хранящая свои кадры вызовов в куче, вызывает методы напрямую
+        [[nodiscard]] size_t PushFrame(size_t size);
+        // Освобождает текущий кадр и делает текущим кадр outer_base, полученный от PushFrame
+        void PopFrame(size_t outer_base);
+
+        // Возвращает пустой Closure для тел методов, хранящих переменные в кадре
+        [[nodiscard]] Closure& EmptyClosure()
         {
-            os << value_;
+            return empty_closure_;
         }
 
-        [[nodiscard]] const T& GetValue() const
+    private:
+        std::vector<ObjectHolder> slots_;
+        // Индекс первой ячейки текущего кадра
+        size_t base_ = 0;
+        Closure empty_closure_;
+    };
+
+
+
+    struct TailCall;
+
+
+
+    /*
+     * Буфер, в котором print и str() форматируют значения. Числа записываются функцией std::to_chars,
+     * логические значения, строки и None копируются, поэтому форматирование обходится без потоков
+     * и, когда буфер достиг нужного размера, без выделения памяти. Контекст хранит один буфер
+     * и переиспользует его для всех инструкций
+     */
+    class FormatBuffer
+    {
+    public:
+        // Дописывает текст значения value. Возвращает false и ничего не дописывает,
+        // если value - объект, который выводит себя сам (см. Object::Print)
+        bool TryAppend(const ObjectHolder& value);
+        void Append(int number);
+
+        void Append(std::string_view text)
         {
-            return value_;
+            buffer_ += text;
+        }
+
+        void Append(char c)
+        {
+            buffer_ += c;
+        }
+
+        [[nodiscard]] size_t GetSize() const noexcept
+        {
+            return buffer_.size();
         }
 
+        // Возвращает текст, дописанный начиная с позиции from
+        [[nodiscard]] std::string_view View(size_t from = 0) const noexcept
+        {
+            return std::string_view(buffer_).substr(from);
+        }
+
+        // Отбрасывает текст после первых size символов
+        void Truncate(size_t size)
+        {
+            buffer_.resize(size);
+        }
+
+        // Передаёт весь текст буфера приёмнику sink и очищает буфер
+        void WriteTo(OutputSink& sink);
+
     private:
-        T value_;
+        std::string buffer_;
     };
 
 
 
-    // Таблица символов, связывающая имя объекта с его значением
-    using Closure = std::unordered_map<std::string, ObjectHolder>;
+    /*
+     * Ограничения глубины вложенных вызовов методов. При их превышении выполнение прерывается
+     * исключением runtime_error, а не переполнением стека процесса
+     */
+    struct CallLimits
+    {
+        // Вызовы, выполняемые рекурсией функций C++: все вызовы при обходе дерева, а в виртуальной
+        // машине - методы, не скомпилированные в байт-код. Кроме счётчика такие вызовы ограничивает
+        // свободное место в стеке процесса: разные пути вызова занимают от 700 байт до 1.5 КБ стека,
+        // поэтому счётчик сам по себе от переполнения стека не защищает
+        size_t max_native_depth = 10'500;
+        // Вызовы, которые виртуальная машина выполняет в собственном стеке кадров в куче
+        size_t max_vm_depth = 1'000'000;
+    };
+
+
+
+    // Контекст исполнения инструкций Mython
+    class Context
+    {
+    public:
+        // Учитывает вызов метода рекурсией C++ на время своего существования.
+        // Если вложенных вызовов становится больше CallLimits::max_native_depth или в стеке потока
+        // остаётся меньше 256 КБ, выбрасывает runtime_error
+        class NativeCall
+        {
+        public:
+            explicit NativeCall(Context& context);
+            ~NativeCall();
+
+            NativeCall(const NativeCall&) = delete;
+            NativeCall& operator=(const NativeCall&) = delete;
+
+        private:
+            Context& context_;
+        };
+
+        // Вывод команд print передаётся приёмнику output, который должен жить дольше контекста
+        explicit Context(OutputSink& output);
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        // Возвращает приёмник вывода команд print
+        [[nodiscard]] OutputSink& GetOutput() noexcept
+        {
+            return output_;
+        }
+
+        // Возвращает поток, передающий текст приёмнику GetOutput(), для вывода объектов методом Print
+        [[nodiscard]] std::ostream& GetOutputStream() noexcept
+        {
+            return output_stream_;
+        }
+
+        // Возвращает стек локальных переменных методов, выполняемых в этом контексте
+        [[nodiscard]] ValueStack& GetValueStack()
+        {
+            return value_stack_;
+        }
+
+        // Возвращает true, если выполнена инструкция return, а метод ещё не завершился.
+        // Составные инструкции в этом состоянии прекращают выполнение
+        [[nodiscard]] bool IsReturning() const noexcept
+        {
+            return returning_;
+        }
+
+        void SetReturning(bool returning) noexcept
+        {
+            returning_ = returning;
+        }
+
+        [[nodiscard]] CallLimits& GetCallLimits() noexcept
+        {
+            return call_limits_;
+        }
+
+        // Возвращает буфер форматирования значений для print и str()
+        [[nodiscard]] FormatBuffer& GetFormatBuffer() noexcept
+        {
+            return format_buffer_;
+        }
+
+        // Возвращает отложенный вызов выполняемого метода (см. TailCall) либо nullptr вне методов
+        [[nodiscard]] TailCall* GetTailCall() const noexcept
+        {
+            return tail_call_;
+        }
+
+        // Делает tail_call отложенным вызовом выполняемого метода и возвращает прежний
+        TailCall* ExchangeTailCall(TailCall* tail_call) noexcept
+        {
+            TailCall* previous = tail_call_;
+            tail_call_ = tail_call;
+            return previous;
+        }
+
+    protected:
+        ~Context() = default;
+
+    private:
+        OutputSink& output_;
+        SinkStream output_stream_;
+        ValueStack value_stack_;
+        bool returning_ = false;
+        CallLimits call_limits_;
+        // Количество выполняющихся вызовов NativeCall
+        size_t native_depth_ = 0;
+        // Граница стека потока для вызовов NativeCall, определяется при входе в первый из них
+        const char* stack_limit_ = nullptr;
+        TailCall* tail_call_ = nullptr;
+        FormatBuffer format_buffer_;
+    };
+
+
 
     // Проверяет, содержится ли в object значение, приводимое к True
     // Для отличных от нуля чисел, True и непустых строк возвращается true. В остальных случаях - false.
@@ -129,43 +599,200 @@ namespace runtime
 
 
 
-    // Строковое значение
-    class String : public ValueObject<std::string>
+    // Метод класса
+    struct Method
     {
-    public:
-        using ValueObject<std::string>::ValueObject;
-        void Print(std::ostream& os, Context& context) override;
+        // Имя метода
+        Symbol name;
+        // Имена формальных параметров метода
+        std::vector<Symbol> formal_params;
+        // Тело метода
+        std::unique_ptr<Executable> body;
+        // Число ячеек кадра метода: ячейка 0 - self, ячейки 1..n - параметры в порядке formal_params,
+        // далее - локальные переменные. Значение 0 означает, что кадр не используется,
+        // и тело метода получает self и параметры через Closure
+        size_t frame_size = 0;
     };
 
 
-    // Числовое значение
-    class Number : public ValueObject<int>
+
+    /*
+     * Вызов метода в инструкции return (хвостовой вызов), отложенный до выхода из выполняемого метода.
+     * ClassInstance::Call выполняет отложенные вызовы в цикле, поэтому хвостовая рекурсия
+     * не расходует стек процесса
+     */
+    struct TailCall
     {
-    public:
-        using ValueObject<int>::ValueObject;
-        void Print(std::ostream& os, Context& context) override;
+        // Объект, метод которого выполняется
+        const Object* self = nullptr;
+        ObjectHolder object;
+        const Method* method = nullptr;
+        std::vector<ObjectHolder> args;
     };
 
+    // Возвращает true, если вызов метода у object с аргументами [args_begin, args_end) может заменить
+    // выполняемый метод объекта self. Объект self после этого может быть разрушен,
+    // поэтому вызов не должен ссылаться на него через ObjectHolder::Share, если он не вызывается у самого self
+    [[nodiscard]] bool CanReplaceCall(const Object* self, const ObjectHolder& object,
+        const ObjectHolder* args_begin, const ObjectHolder* args_end);
 
-    // Логическое значение
-    class Bool : public ValueObject<bool>
+
+
+    /*
+     * Форма (скрытый класс) экземпляра класса: имена полей в порядке их появления у объекта.
+     * Экземпляры одного класса, получившие одинаковые поля в одинаковом порядке, разделяют одну
+     * форму. Номер поля в форме совпадает с номером ячейки его значения в экземпляре
+     */
+    class Shape
     {
     public:
-        using ValueObject<bool>::ValueObject;
-        void Print(std::ostream& os, Context& context) override;
+        // Номер, возвращаемый FindField для отсутствующего поля
+        static constexpr size_t NO_FIELD = static_cast<size_t>(-1);
+
+        // Создаёт пустую форму без полей
+        Shape();
+
+        Shape(const Shape&) = delete;
+        Shape& operator=(const Shape&) = delete;
+
+        // Возвращает уникальный номер формы. Номера не используются повторно,
+        // поэтому по ним можно проверять кеши, пережившие саму форму
+        [[nodiscard]] std::uint64_t GetId() const noexcept
+        {
+            return id_;
+        }
+
+        // Возвращает номер ячейки поля name либо NO_FIELD, если такого поля нет
+        [[nodiscard]] size_t FindField(Symbol name) const;
+
+        // Возвращает форму, которая получается из текущей добавлением поля name.
+        // Переходы запоминаются, поэтому одинаковые последовательности полей дают одну форму
+        [[nodiscard]] const Shape& AddField(Symbol name) const;
+
+        [[nodiscard]] size_t GetFieldCount() const noexcept
+        {
+            return fields_.size();
+        }
+
+        [[nodiscard]] Symbol GetFieldName(size_t index) const
+        {
+            return fields_[index];
+        }
+
+    private:
+        // Формы с большим числом полей ищут поле двоичным поиском, а не перебором
+        static constexpr size_t LINEAR_SEARCH_LIMIT = 8;
+
+        std::uint64_t id_;
+        std::vector<Symbol> fields_;
+        // Пары (номер символа имени поля, номер ячейки), упорядоченные по номеру символа
+        std::vector<std::pair<std::uint32_t, size_t>> sorted_fields_;
+        // Формы, получающиеся добавлением одного поля. Заполняются по мере появления полей у объектов
+        mutable std::unordered_map<Symbol, std::unique_ptr<Shape>, SymbolHasher> transitions_;
     };
 
 
 
-    // Метод класса
-    struct Method
+    // Поля экземпляра класса. Имена полей хранит форма объекта, а значения - непрерывный массив
+    // ячеек. Интерфейс повторяет интерфейс ассоциативного контейнера (как у Closure)
+    class InstanceFields
     {
-        // Имя метода
-        std::string name;
-        // Имена формальных параметров метода
-        std::vector<std::string> formal_params;
-        // Тело метода
-        std::unique_ptr<Executable> body;
+    public:
+        // Итератор по парам (имя поля, ссылка на значение)
+        template <typename Holder>
+        class Iterator
+        {
+        public:
+            Iterator(const Shape& shape, Holder* values, size_t index)
+                : shape_(&shape), values_(values), index_(index)
+            {
+            }
+
+            std::pair<Symbol, Holder&> operator*() const
+            {
+                return { shape_->GetFieldName(index_), values_[index_] };
+            }
+
+            Iterator& operator++()
+            {
+                ++index_;
+                return *this;
+            }
+
+            friend bool operator==(const Iterator& lhs, const Iterator& rhs)
+            {
+                return lhs.values_ == rhs.values_ && lhs.index_ == rhs.index_;
+            }
+
+            friend bool operator!=(const Iterator& lhs, const Iterator& rhs)
+            {
+                return !(lhs == rhs);
+            }
+
+        private:
+            const Shape* shape_;
+            Holder* values_;
+            size_t index_;
+        };
+
+        using iterator = Iterator<ObjectHolder>;
+        using const_iterator = Iterator<const ObjectHolder>;
+
+        explicit InstanceFields(const Shape& shape);
+
+        // Возвращает значение поля name. Если поля нет, добавляет его со значением None
+        ObjectHolder& operator[](Symbol name);
+
+        // Возвращает значение поля name. Если поля нет, выбрасывает исключение out_of_range
+        [[nodiscard]] ObjectHolder& at(Symbol name);
+        [[nodiscard]] const ObjectHolder& at(Symbol name) const;
+
+        [[nodiscard]] iterator find(Symbol name);
+        [[nodiscard]] const_iterator find(Symbol name) const;
+        [[nodiscard]] size_t count(Symbol name) const;
+
+        [[nodiscard]] iterator begin();
+        [[nodiscard]] iterator end();
+        [[nodiscard]] const_iterator begin() const;
+        [[nodiscard]] const_iterator end() const;
+
+        [[nodiscard]] size_t size() const noexcept
+        {
+            return values_.size();
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return values_.empty();
+        }
+
+        // Возвращает текущую форму объекта
+        [[nodiscard]] const Shape& GetShape() const noexcept
+        {
+            return *shape_;
+        }
+
+        // Возвращает значение из ячейки slot текущей формы
+        [[nodiscard]] ObjectHolder& GetSlot(size_t slot)
+        {
+            return values_[slot];
+        }
+
+        [[nodiscard]] const ObjectHolder& GetSlot(size_t slot) const
+        {
+            return values_[slot];
+        }
+
+        // Возвращает номер ячейки поля name, при необходимости добавляя поле (и меняя форму)
+        size_t Define(Symbol name);
+
+        // Переводит объект в форму shape, полученную из текущей добавлением полей.
+        // Новые поля получают значение None
+        void ExtendTo(const Shape& shape);
+
+    private:
+        const Shape* shape_;
+        std::vector<ObjectHolder> values_;
     };
 
 
@@ -174,29 +801,74 @@ namespace runtime
     class Class : public Object
     {
     public:
+        static constexpr Kind KIND = Kind::CLASS;
+
         // Создаёт класс с именем name и набором методов methods, унаследованный от класса parent
         // Если parent равен nullptr, то создаётся базовый класс
         explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
 
         // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-        [[nodiscard]] const Method* GetMethod(const std::string& name) const;
+        [[nodiscard]] const Method* GetMethod(Symbol name) const;
+
+        // Возвращает указатель на метод name, принимающий argument_count параметров,
+        // или nullptr, если такого метода нет
+        [[nodiscard]] const Method* GetMethod(Symbol name, size_t argument_count) const;
 
         // Возвращает имя класса
         [[nodiscard]] const std::string& GetName() const;
 
+        // Возвращает родительский класс либо nullptr для базового класса
+        [[nodiscard]] const Class* GetParent() const noexcept
+        {
+            return parent_;
+        }
+
+        // Возвращает форму только что созданного экземпляра класса, ещё не имеющего полей
+        [[nodiscard]] const Shape& GetRootShape() const
+        {
+            return *root_shape_;
+        }
+
+        // Вызывает action для каждого собственного (не унаследованного) метода класса.
+        // Позволяет заменить тело метода, не меняя его имени и параметров
+        template <typename Action>
+        void ForEachOwnMethod(Action action)
+        {
+            for (auto& [name, method] : methods_)
+            {
+                action(method);
+            }
+        }
+
+        template <typename Action>
+        void ForEachOwnMethod(Action action) const
+        {
+            for (const auto& [name, method] : methods_)
+            {
+                action(method);
+            }
+        }
+
         // Выводит в os строку "Class <имя класса>", например "Class cat"
         void Print(std::ostream& os, Context& context) override;
 
     private:
-        std::unordered_map<std::string, Method> methods_;
+        std::unordered_map<Symbol, Method, SymbolHasher> methods_;
+        // Методы класса вместе с унаследованными: для каждого имени - метод, который будет
+        // вызван у экземпляра. Заполняется при создании класса, поэтому поиск метода
+        // не зависит от глубины иерархии
+        std::unordered_map<Symbol, const Method*, SymbolHasher> method_table_;
         std::string name_;
         const Class* parent_;
+        std::unique_ptr<Shape> root_shape_;
     };
 
     // Экземпляр класса
     class ClassInstance : public Object
     {
     public:
+        static constexpr Kind KIND = Kind::CLASS_INSTANCE;
+
         explicit ClassInstance(const Class& cls);
 
         /*
@@ -211,78 +883,204 @@ namespace runtime
          * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
          * runtime_error
          */
-        ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+        ObjectHolder Call(Symbol method, const std::vector<ObjectHolder>& actual_args,
+            Context& context);
+
+        // Вызывает у объекта уже найденный метод method его класса.
+        // Количество аргументов должно совпадать с количеством параметров метода
+        ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
             Context& context);
 
         // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-        [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+        [[nodiscard]] bool HasMethod(Symbol method, size_t argument_count) const;
+
+        // Возвращает метод __str__ без параметров, которым выводится объект, либо nullptr
+        [[nodiscard]] const Method* GetStrMethod() const;
+
+        // Возвращает класс объекта
+        [[nodiscard]] const Class& GetClass() const noexcept
+        {
+            return class_;
+        }
 
-        // Возвращает ссылку на Closure, содержащий поля объекта
-        [[nodiscard]] Closure& Fields();
-        // Возвращает константную ссылку на Closure, содержащую поля объекта
-        [[nodiscard]] const Closure& Fields() const;
+        // Возвращает ссылку на поля объекта
+        [[nodiscard]] InstanceFields& Fields();
+        // Возвращает константную ссылку на поля объекта
+        [[nodiscard]] const InstanceFields& Fields() const;
 
     private:
+        friend class MethodCallScope;
+
+        // Выполняет тело метода method без учёта отложенных вызовов
+        ObjectHolder Execute(const Method& method, const std::vector<ObjectHolder>& actual_args,
+            Context& context);
+        // Выполняет тело метода, переменные которого хранятся в Closure, а не в ValueStack.
+        // Отделено от Execute, чтобы Closure не занимал стек процесса при вызовах с кадрами
+        ObjectHolder ExecuteInClosure(const Method& method, const std::vector<ObjectHolder>& actual_args,
+            Context& context);
+
         const Class& class_;
-        Closure class_field_;
+        InstanceFields class_field_;
+    };
+
+
+
+    /*
+     * Вызов метода рекурсией C++ (см. Context::NativeCall). Пока область существует, инструкции return
+     * вызванного метода откладывают в ней вызовы методов (см. TailCall), а Finish выполняет их в цикле.
+     * В такой области ClassInstance::Call выполняет тело метода, а программа, полученная
+     * транслятором (см. transpiled.h), - функцию C++, в которую переведён метод
+     */
+    class MethodCallScope
+    {
+    public:
+        MethodCallScope(Context& context, const ClassInstance& self);
+        ~MethodCallScope();
+
+        MethodCallScope(const MethodCallScope&) = delete;
+        MethodCallScope& operator=(const MethodCallScope&) = delete;
+
+        // Выполняет отложенные вызовы и заменяет result результатом последнего из них.
+        // Если вызовов не было, result не меняется
+        void Finish(ObjectHolder& result)
+        {
+            if (tail_call_.method != nullptr)
+                RunTailCalls(result);
+        }
+
+    private:
+        void RunTailCalls(ObjectHolder& result);
+
+        Context::NativeCall call_;
+        Context& context_;
+        TailCall tail_call_;
+        TailCall* outer_ = nullptr;
     };
 
     /*
-     * Возвращает true, если lhs и rhs содержат одинаковые числа, строки или значения типа Bool.
-     * Если lhs - объект с методом __eq__, функция возвращает результат вызова lhs.__eq__(rhs),
-     * приведённый к типу Bool. Если lhs и rhs имеют значение None, функция возвращает true.
-     * В остальных случаях функция выбрасывает исключение runtime_error.
+     * Сравнения объектов.
+     * Если среди lhs и rhs есть экземпляры классов, сравнение обходится одним вызовом
+     * самого прямого из доступных методов: lhs.__op__(rhs), затем трёхстороннего lhs.__cmp__(rhs),
+     * возвращающего число меньше, равное или больше нуля, затем отражённого метода rhs
+     * (например, rhs.__gt__(lhs) для lhs < rhs). Результат метода приводится к bool.
+     * Для __op__ используются методы __eq__, __ne__, __lt__, __gt__, __le__ и __ge__.
      *
-     * Параметр context задаёт контекст для выполнения метода __eq__
+     * Параметр context задаёт контекст для выполнения методов
+     */
+
+    /*
+     * Возвращает true, если lhs и rhs содержат одинаковые числа, строки или значения типа Bool,
+     * либо результат метода сравнения на равенство.
+     * Если lhs и rhs имеют значение None, функция возвращает true.
+     * В остальных случаях функция выбрасывает исключение runtime_error.
      */
     bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
     /*
      * Если lhs и rhs - числа, строки или значения bool, функция возвращает результат их сравнения
-     * оператором <.
-     * Если lhs - объект с методом __lt__, возвращает результат вызова lhs.__lt__(rhs),
-     * приведённый к типу bool. В остальных случаях функция выбрасывает исключение runtime_error.
-     *
-     * Параметр context задаёт контекст для выполнения метода __lt__
+     * оператором <. Иначе возвращает результат метода сравнения.
+     * В остальных случаях функция выбрасывает исключение runtime_error.
      */
     bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-    // Возвращает значение, противоположное Equal(lhs, rhs, context)
+    // Без метода __ne__ возвращает значение, противоположное Equal(lhs, rhs, context)
     bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-    // Возвращает значение lhs>rhs, используя функции Equal и Less
+    // Без метода __gt__ возвращает значение lhs>rhs, используя функции Equal и Less
     bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-    // Возвращает значение lhs<=rhs, используя функции Equal и Less
+    // Без метода __le__ возвращает значение lhs<=rhs, используя функции Equal и Less
     bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-    // Возвращает значение, противоположное Less(lhs, rhs, context)
+    // Без метода __ge__ возвращает значение, противоположное Less(lhs, rhs, context)
     bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
-    // Контекст-заглушка, применяется в тестах.
-    // В этом контексте весь вывод перенаправляется в строковый поток вывода output
-    struct DummyContext : Context
+    // Пользовательские методы, которыми вычисляется одно сравнение: lhs.direct(rhs),
+    // затем lhs.__cmp__(rhs), затем отражённый rhs.reflected(lhs)
+    struct ComparisonMethods
+    {
+        Symbol direct;
+        Symbol reflected;
+        bool (*from_cmp)(int sign);  // результат сравнения по знаку lhs.__cmp__(rhs)
+    };
+
+    extern const ComparisonMethods EQUAL_METHODS;
+    extern const ComparisonMethods NOT_EQUAL_METHODS;
+    extern const ComparisonMethods LESS_METHODS;
+    extern const ComparisonMethods GREATER_METHODS;
+    extern const ComparisonMethods LESS_OR_EQUAL_METHODS;
+    extern const ComparisonMethods GREATER_OR_EQUAL_METHODS;
+
+    // Вызов метода, которым функции сравнения вычисляют результат (см. FindComparisonCall)
+    struct ComparisonCall
+    {
+        // Объект, у которого вызывается метод, либо nullptr, если ни один из методов не определён
+        ClassInstance* object = nullptr;
+        const Method* method = nullptr;
+        // Метод вызывается у rhs с аргументом lhs
+        bool reflected = false;
+        // Вызывается __cmp__, его результат приводит к bool функция FromCmp
+        bool three_way = false;
+    };
+
+    // Возвращает вызов, которым сравнение lhs и rhs с методами methods вычисляется без
+    // выполнения самого метода. Так виртуальная машина вызывает метод в своём цикле
+    ComparisonCall FindComparisonCall(const ObjectHolder& lhs, const ObjectHolder& rhs,
+        const ComparisonMethods& methods);
+    // Возвращает результат сравнения по значению sign, которое вернул метод __cmp__.
+    // Если sign - не число, выбрасывает runtime_error
+    bool FromCmp(const ObjectHolder& sign, const ComparisonMethods& methods);
+
+    /*
+     * Приёмник вывода, которым владеет контекст. Контексты наследуют его раньше Context
+     * (идиома base-from-member): так приёмник создаётся до того, как его получает конструктор Context,
+     * и разрушается после Context
+     */
+    template <typename Sink>
+    struct ContextOutput
     {
-        std::ostream& GetOutputStream() override
+        template <typename... Args>
+        explicit ContextOutput(Args&&... args)
+            : output(std::forward<Args>(args)...)
         {
-            return output;
         }
 
-        std::ostringstream output;
+        Sink output;
+    };
+
+    // Контекст-заглушка, применяется в тестах.
+    // В этом контексте весь вывод сохраняется в памяти, в приёмнике output
+    struct DummyContext : ContextOutput<MemorySink>, Context
+    {
+        DummyContext()
+            : Context(output)
+        {
+        }
     };
 
     // Простой контекст, в нём вывод происходит в поток output, переданный в конструктор
-    class SimpleContext : public runtime::Context
+    class SimpleContext : private ContextOutput<StreamSink>, private ContextOutput<BufferedSink>, public Context
     {
+        using Stream = ContextOutput<StreamSink>;
+        using Buffered = ContextOutput<BufferedSink>;
+
     public:
-        explicit SimpleContext(std::ostream& output)
-            : output_(output)
+        // Вывод передаётся в поток output согласно policy. По умолчанию - после каждой команды print,
+        // как если бы контекст писал в поток напрямую
+        explicit SimpleContext(std::ostream& output, FlushPolicy policy = FlushPolicy::PER_LINE)
+            : Stream(output)
+            , Buffered(Stream::output, policy)
+            , Context(Buffered::output)
         {
         }
+    };
+
+
 
-        std::ostream& GetOutputStream() override
+    // Контекст, передающий вывод приёмнику output
+    class SinkContext : public runtime::Context
+    {
+    public:
+        explicit SinkContext(OutputSink& output)
+            : Context(output)
         {
-            return output_;
         }
-
-    private:
-        std::ostream& output_;
     };
 
 }  // namespace runtime
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "runtime.h"
 #include "test_runner.h"
 
+#include <cstdio>
 #include <functional>
 
 using namespace std;
@@ -57,8 +58,8 @@ void TestNumber() {
 
     DummyContext context;
 
-    num.Print(context.output, context);
-    ASSERT_EQUAL(context.output.str(), "127"s);
+    num.Print(context.GetOutputStream(), context);
+    ASSERT_EQUAL(context.output.View(), "127"s);
     ASSERT_EQUAL(num.GetValue(), 127);
 }
 
@@ -66,11 +67,43 @@ void TestString() {
     String word("hello!"s);
 
     DummyContext context;
-    word.Print(context.output, context);
-    ASSERT_EQUAL(context.output.str(), "hello!"s);
+    word.Print(context.GetOutputStream(), context);
+    ASSERT_EQUAL(context.output.View(), "hello!"s);
     ASSERT_EQUAL(word.GetValue(), "hello!"s);
 }
 
+void TestStringConcat() {
+    const String short_word("ab"s);
+    const String long_word(string(100, 'x'));
+
+    String small = String::Concat(short_word, short_word);
+    ASSERT_EQUAL(small.GetLength(), 4U);
+    ASSERT_EQUAL(small.GetValue(), "abab"s);
+
+    String joined = String::Concat(long_word, short_word);
+    ASSERT_EQUAL(joined.GetLength(), 102U);
+    ASSERT_EQUAL(joined.GetValue(), string(100, 'x') + "ab"s);
+    ASSERT_EQUAL(joined.GetHash(), String(string(100, 'x') + "ab"s).GetHash());
+
+    // Строка, построенная длинной цепочкой конкатенаций, склеивается и разрушается без рекурсии
+    String text(""s);
+    string expected;
+    for (int i = 0; i < 100'000; ++i) {
+        text = String::Concat(text, i % 2 == 0 ? short_word : long_word);
+        expected += i % 2 == 0 ? "ab"s : string(100, 'x');
+    }
+    ASSERT_EQUAL(text.GetLength(), expected.size());
+    String copy = text;
+    ASSERT_EQUAL(copy.GetValue(), expected);
+    ASSERT_EQUAL(text.GetValue(), expected);
+
+    DummyContext context;
+    ASSERT(Equal(ObjectHolder::Own(String(expected)), ObjectHolder::Own(move(text)), context));
+    ASSERT(!Equal(ObjectHolder::Own(String::Concat(long_word, short_word)),
+                  ObjectHolder::Own(String::Concat(short_word, long_word)), context));
+    ASSERT(!IsTrue(ObjectHolder::Own(String::Concat(String(""s), String(""s)))));
+}
+
 void TestBool() {
     Bool t(true);
     ASSERT_EQUAL(t.GetValue(), true);
@@ -87,7 +120,27 @@ void TestBool() {
     f.Print(out, context);
     ASSERT_EQUAL(out.str(), "False"s);
 
-    ASSERT(context.output.str().empty());
+    ASSERT(context.output.View().empty());
+}
+
+void TestSymbols() {
+    Symbol x{"x"s};
+    ASSERT_EQUAL(x, Symbol{"x"sv});
+    ASSERT_EQUAL(x.GetId(), Symbol{"x"}.GetId());
+    ASSERT_EQUAL(x.GetName(), "x"s);
+    ASSERT(x != Symbol{"y"s});
+
+    ASSERT_EQUAL(Symbol{}.GetName(), ""s);
+    ASSERT_EQUAL(Symbol{}, Symbol{""s});
+
+    ostringstream out;
+    out << Symbol{"value"s};
+    ASSERT_EQUAL(out.str(), "value"s);
+
+    Closure closure;
+    closure[x] = ObjectHolder::Own(Number{1});
+    ASSERT_EQUAL(closure.count("x"s), 1U);
+    ASSERT_EQUAL(closure.count("y"s), 0U);
 }
 
 struct TestMethodBody : Executable {
@@ -194,9 +247,9 @@ void TestNonowning() {
     ASSERT(oh.Get() == &logger);
 
     DummyContext context;
-    oh->Print(context.output, context);
+    oh->Print(context.GetOutputStream(), context);
 
-    ASSERT_EQUAL(context.output.str(), "784"sv);
+    ASSERT_EQUAL(context.output.View(), "784"sv);
 }
 
 void TestOwning() {
@@ -213,9 +266,9 @@ void TestOwning() {
     ASSERT_EQUAL(Logger::instance_count, 1);
 
     DummyContext context;
-    oh->Print(context.output, context);
+    oh->Print(context.GetOutputStream(), context);
 
-    ASSERT_EQUAL(context.output.str(), "312"sv);
+    ASSERT_EQUAL(context.output.View(), "312"sv);
 }
 
 void TestMove() {
@@ -248,6 +301,80 @@ void TestNullptr() {
     ASSERT(!oh.Get());
 }
 
+void TestInlineValues() {
+    auto number = ObjectHolder::Own(Number{42});
+    ASSERT(number);
+    ASSERT(number.TryAs<Number>() != nullptr);
+    ASSERT_EQUAL(number.TryAs<Number>()->GetValue(), 42);
+    ASSERT(number.Get() == number.TryAs<Number>());
+    ASSERT(number.TryAs<Bool>() == nullptr);
+    ASSERT(number.TryAs<String>() == nullptr);
+
+    // Copies of an inline value are independent objects with the same value
+    ObjectHolder copy = number;
+    ASSERT(copy.Get() != number.Get());
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42);
+
+    auto boolean = ObjectHolder::Own(Bool{true});
+    ASSERT(boolean.TryAs<Bool>() != nullptr && boolean.TryAs<Bool>()->GetValue());
+    ASSERT(boolean.TryAs<Number>() == nullptr);
+
+    DummyContext context;
+    number->Print(context.GetOutputStream(), context);
+    boolean->Print(context.GetOutputStream(), context);
+    ASSERT_EQUAL(context.output.View(), "42True"s);
+
+    // Shared values are still accessed by reference
+    Number shared_number{7};
+    ASSERT(ObjectHolder::Share(shared_number).TryAs<Number>() == &shared_number);
+}
+
+void TestBoolSingletons() {
+    auto true_value = ObjectHolder::FromBool(true);
+    auto false_value = ObjectHolder::FromBool(false);
+    ASSERT(true_value.TryAs<Bool>() != nullptr && true_value.TryAs<Bool>()->GetValue());
+    ASSERT(false_value.TryAs<Bool>() != nullptr && !false_value.TryAs<Bool>()->GetValue());
+    ASSERT(true_value.GetKind() == Object::Kind::BOOL);
+
+    // Все значения True (и все значения False) - один и тот же объект
+    ASSERT_EQUAL(true_value.Get(), ObjectHolder::FromBool(true).Get());
+    ASSERT_EQUAL(true_value.Get(), ObjectHolder::Own(Bool{true}).Get());
+    ASSERT_EQUAL(false_value.Get(), ObjectHolder::Own(Bool{false}).Get());
+    ASSERT(true_value.Get() != false_value.Get());
+
+    ObjectHolder copy = true_value;
+    true_value = ObjectHolder::None();
+    ASSERT(!true_value);
+    ASSERT(IsTrue(copy));
+}
+
+void TestKinds() {
+    ASSERT(ObjectHolder::None().GetKind() == Object::Kind::NONE);
+    ASSERT(ObjectHolder::Own(Number{1}).GetKind() == Object::Kind::NUMBER);
+    ASSERT(ObjectHolder::Own(Bool{false}).GetKind() == Object::Kind::BOOL);
+    ASSERT(ObjectHolder::Own(String{"1"s}).GetKind() == Object::Kind::STRING);
+
+    Number number{2};
+    ASSERT(ObjectHolder::Share(number).GetKind() == Object::Kind::NUMBER);
+
+    Class cls{"Test"s, {}, nullptr};
+    auto cls_holder = ObjectHolder::Share(cls);
+    ASSERT(cls_holder.GetKind() == Object::Kind::CLASS);
+    ASSERT(cls_holder.TryAs<Class>() == &cls);
+    ASSERT(cls_holder.TryAs<ClassInstance>() == nullptr);
+
+    auto instance = ObjectHolder::Own(ClassInstance{cls});
+    ASSERT(instance.GetKind() == Object::Kind::CLASS_INSTANCE);
+    ASSERT(instance.TryAs<ClassInstance>() != nullptr);
+    ASSERT(instance.TryAs<Class>() == nullptr);
+    ASSERT(instance.TryAs<String>() == nullptr);
+
+    auto logger = ObjectHolder::Own(Logger{});
+    ASSERT(logger.GetKind() == Object::Kind::OTHER);
+    ASSERT(logger.TryAs<Logger>() != nullptr);
+    ASSERT(logger.TryAs<Number>() == nullptr);
+}
+
 void TestIsTrue() {
     {
         ASSERT(!IsTrue(ObjectHolder::Own(Bool{false})));
@@ -474,6 +601,88 @@ void TestComparison() {
     }
 }
 
+void TestRichComparison() {
+    DummyContext context;
+    map<string, int> calls;
+
+    // Метод сравнения, который считает вызовы и возвращает result
+    auto counting_method = [&calls](string name, ObjectHolder result) {
+        return make_unique<TestMethodBody>([&calls, name, result](Closure&, Context&) {
+            ++calls[name];
+            return result;
+        });
+    };
+
+    Class plain{"Plain"s, {}, nullptr};
+    ClassInstance other{plain};
+    const ObjectHolder rhs = ObjectHolder::Share(other);
+
+    // Каждое сравнение вызывает ровно один метод
+    {
+        vector<Method> methods;
+        for (const char* name : {"__eq__", "__ne__", "__lt__", "__gt__", "__le__", "__ge__"}) {
+            methods.push_back({name, {"rhs"s}, counting_method(name, ObjectHolder::Own(Bool{true}))});
+        }
+        Class cls{"Rich"s, move(methods), nullptr};
+        ClassInstance instance{cls};
+        const ObjectHolder lhs = ObjectHolder::Share(instance);
+
+        ASSERT(Equal(lhs, rhs, context));
+        ASSERT(NotEqual(lhs, rhs, context));
+        ASSERT(Less(lhs, rhs, context));
+        ASSERT(Greater(lhs, rhs, context));
+        ASSERT(LessOrEqual(lhs, rhs, context));
+        ASSERT(GreaterOrEqual(lhs, rhs, context));
+
+        const map<string, int> expected{{"__eq__"s, 1}, {"__ne__"s, 1}, {"__lt__"s, 1},
+                                        {"__gt__"s, 1}, {"__le__"s, 1}, {"__ge__"s, 1}};
+        ASSERT_EQUAL(calls, expected);
+        calls.clear();
+    }
+
+    // Трёхстороннее сравнение
+    {
+        for (int sign : {-1, 0, 1}) {
+            vector<Method> methods;
+            methods.push_back({"__cmp__"s, {"rhs"s}, counting_method("__cmp__"s, ObjectHolder::Own(Number{sign}))});
+            Class cls{"Cmp"s, move(methods), nullptr};
+            ClassInstance instance{cls};
+            const ObjectHolder lhs = ObjectHolder::Share(instance);
+
+            ASSERT_EQUAL(Equal(lhs, rhs, context), sign == 0);
+            ASSERT_EQUAL(NotEqual(lhs, rhs, context), sign != 0);
+            ASSERT_EQUAL(Less(lhs, rhs, context), sign < 0);
+            ASSERT_EQUAL(Greater(lhs, rhs, context), sign > 0);
+            ASSERT_EQUAL(LessOrEqual(lhs, rhs, context), sign <= 0);
+            ASSERT_EQUAL(GreaterOrEqual(lhs, rhs, context), sign >= 0);
+            ASSERT_EQUAL(calls["__cmp__"s], 6);
+            calls.clear();
+        }
+
+        vector<Method> methods;
+        methods.push_back({"__cmp__"s, {"rhs"s}, counting_method("__cmp__"s, ObjectHolder::Own(String{"less"s}))});
+        Class cls{"BadCmp"s, move(methods), nullptr};
+        ClassInstance instance{cls};
+        try {
+            Less(ObjectHolder::Share(instance), rhs, context);
+            ASSERT(false);
+        } catch (const std::runtime_error&) {
+        }
+        calls.clear();
+    }
+
+    // Отражённый метод правого операнда: 1 < x вычисляется как x.__gt__(1)
+    {
+        vector<Method> methods;
+        methods.push_back({"__gt__"s, {"rhs"s}, counting_method("__gt__"s, ObjectHolder::Own(Bool{true}))});
+        Class cls{"Reflected"s, move(methods), nullptr};
+        ClassInstance instance{cls};
+
+        ASSERT(Less(ObjectHolder::Own(Number{1}), ObjectHolder::Share(instance), context));
+        ASSERT_EQUAL(calls["__gt__"s], 1);
+    }
+}
+
 void TestClass() {
     vector<Method> methods;
     Closure* passed_closure = nullptr;
@@ -500,7 +709,7 @@ void TestClass() {
 
     ostringstream out;
     cls.Print(out, ctx);
-    ASSERT(ctx.output.str().empty());
+    ASSERT(ctx.output.View().empty());
     ASSERT_EQUAL(out.str(), "Class Test"s);
 }
 
@@ -529,17 +738,182 @@ void TestClassInstance() {
     ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error);
 }
 
+void TestMethodTable() {
+    // Цепочка наследования: метод "base" объявлен в корне, "level" переопределяется
+    // в каждом классе, а "mid" появляется в середине иерархии с другим числом параметров
+    vector<unique_ptr<Class>> hierarchy;
+    for (int i = 0; i < 8; ++i) {
+        vector<Method> methods;
+        if (i == 0) {
+            methods.push_back({"base"s, {}, make_unique<TestMethodBody>(nullptr)});
+            methods.push_back({"mid"s, {}, make_unique<TestMethodBody>(nullptr)});
+        }
+        if (i == 4) {
+            methods.push_back({"mid"s, {"x"s}, make_unique<TestMethodBody>(nullptr)});
+        }
+        methods.push_back({"level"s, {}, make_unique<TestMethodBody>(nullptr)});
+        const Class* parent = hierarchy.empty() ? nullptr : hierarchy.back().get();
+        hierarchy.push_back(make_unique<Class>("C"s + to_string(i), move(methods), parent));
+    }
+
+    const Class& root = *hierarchy.front();
+    const Class& leaf = *hierarchy.back();
+    ASSERT_EQUAL(leaf.GetMethod("base"s), root.GetMethod("base"s));
+    ASSERT_EQUAL(leaf.GetMethod("base"s, 0), root.GetMethod("base"s));
+    ASSERT(leaf.GetMethod("base"s, 1) == nullptr);
+    ASSERT(leaf.GetMethod("level"s) != root.GetMethod("level"s));
+    ASSERT(leaf.GetMethod("missing"s) == nullptr);
+
+    // Переопределение скрывает родительский метод с любым числом параметров
+    ASSERT_EQUAL(leaf.GetMethod("mid"s), hierarchy[4]->GetMethod("mid"s));
+    ASSERT(leaf.GetMethod("mid"s, 0) == nullptr);
+    ASSERT(leaf.GetMethod("mid"s, 1) != nullptr);
+    ASSERT(hierarchy[3]->GetMethod("mid"s, 0) != nullptr);
+}
+
+void TestInstanceShapes() {
+    Class cls{"Point"s, {}, nullptr};
+    ClassInstance first{cls};
+    ClassInstance second{cls};
+    ClassInstance reversed{cls};
+    ASSERT_EQUAL(&first.Fields().GetShape(), &cls.GetRootShape());
+    ASSERT(first.Fields().empty());
+
+    first.Fields()["x"s] = ObjectHolder::Own(Number{1});
+    first.Fields()["y"s] = ObjectHolder::Own(Number{2});
+    second.Fields()["x"s] = ObjectHolder::Own(Number{3});
+    second.Fields()["y"s] = ObjectHolder::Own(Number{4});
+    reversed.Fields()["y"s] = ObjectHolder::Own(Number{5});
+    reversed.Fields()["x"s] = ObjectHolder::Own(Number{6});
+
+    // Одинаковый порядок полей даёт одну и ту же форму
+    ASSERT_EQUAL(&first.Fields().GetShape(), &second.Fields().GetShape());
+    ASSERT(&first.Fields().GetShape() != &reversed.Fields().GetShape());
+    ASSERT_EQUAL(first.Fields().GetShape().FindField("y"s), 1U);
+    ASSERT_EQUAL(reversed.Fields().GetShape().FindField("y"s), 0U);
+    ASSERT_EQUAL(first.Fields().GetShape().FindField("z"s), Shape::NO_FIELD);
+
+    // Повторное присваивание не меняет форму
+    const Shape* shape = &second.Fields().GetShape();
+    second.Fields()["x"s] = ObjectHolder::Own(Number{7});
+    ASSERT_EQUAL(&second.Fields().GetShape(), shape);
+    ASSERT_EQUAL(second.Fields().size(), 2U);
+    ASSERT_EQUAL(second.Fields().at("x"s).TryAs<Number>()->GetValue(), 7);
+    ASSERT_EQUAL(reversed.Fields().at("x"s).TryAs<Number>()->GetValue(), 6);
+
+    ASSERT_EQUAL(first.Fields().count("x"s), 1U);
+    ASSERT_EQUAL(first.Fields().count("z"s), 0U);
+    ASSERT(first.Fields().find("z"s) == first.Fields().end());
+    ASSERT_THROWS((void)first.Fields().at("z"s), out_of_range);
+
+    // Поиск поля в форме с большим числом полей
+    ClassInstance wide{cls};
+    for (int i = 0; i < 40; ++i) {
+        wide.Fields()["w"s + to_string((i * 7) % 40)] = ObjectHolder::Own(Number{i});
+    }
+    for (int i = 0; i < 40; ++i) {
+        const size_t slot = wide.Fields().GetShape().FindField("w"s + to_string((i * 7) % 40));
+        ASSERT_EQUAL(slot, static_cast<size_t>(i));
+    }
+    ASSERT_EQUAL(wide.Fields().GetShape().FindField("x"s), Shape::NO_FIELD);
+
+    vector<string> names;
+    for (const auto& [name, value] : reversed.Fields()) {
+        ASSERT(value);
+        names.push_back(name.GetName());
+    }
+    ASSERT_EQUAL(names, (vector<string>{"y"s, "x"s}));
+}
+
+void TestOutputSinks() {
+    // Построчная передача
+    {
+        MemorySink target;
+        BufferedSink sink(target, FlushPolicy::PER_LINE);
+        sink.Write("a"sv);
+        ASSERT(target.View().empty());
+        sink.Write("b\n"sv);
+        ASSERT_EQUAL(target.View(), "ab\n"s);
+    }
+    // Передача по заполнении буфера: фрагмент, не поместившийся в буфер, передаётся сразу
+    {
+        MemorySink target;
+        BufferedSink sink(target, FlushPolicy::THRESHOLD, 4);
+        sink.Write("ab\n"sv);
+        ASSERT(target.View().empty());
+        sink.Write("cdefgh"sv);
+        ASSERT_EQUAL(target.View(), "ab\ncdefgh"s);
+        sink.Write("i"sv);
+        ASSERT_EQUAL(target.View(), "ab\ncdefgh"s);
+    }
+    // Передача только при Flush и разрушении
+    {
+        MemorySink target;
+        {
+            BufferedSink sink(target, FlushPolicy::AT_EXIT, 2);
+            sink.Write("x\n"sv);
+            sink.Write("y\n"sv);
+            sink.Write("z"sv);
+            ASSERT(target.View().empty());
+            sink.Flush();
+            ASSERT_EQUAL(target.View(), "x\ny\nz"s);
+            sink.Write("!"sv);
+        }
+        ASSERT_EQUAL(target.View(), "x\ny\nz!"s);
+        target.Clear();
+        ASSERT(target.View().empty());
+    }
+    // Запись в файловый дескриптор
+    {
+        FILE* file = tmpfile();
+        ASSERT(file != nullptr);
+        {
+            FdSink fd_sink(fileno(file));
+            BufferedSink sink(fd_sink, FlushPolicy::THRESHOLD, 3);
+            sink.Write("ab"sv);
+            sink.Write("cdef"sv);
+            sink.Write("\n"sv);
+        }
+        rewind(file);
+        char text[16] = {};
+        const size_t size = fread(text, 1, sizeof(text), file);
+        fclose(file);
+        ASSERT_EQUAL(string(text, size), "abcdef\n"s);
+    }
+    // Вывод объектов через поток контекста
+    {
+        DummyContext context;
+        context.GetOutputStream() << 42 << ' ' << "text"sv;
+        ASSERT_EQUAL(context.output.View(), "42 text"s);
+    }
+    // SimpleContext по умолчанию передаёт в поток каждую выведенную строку сразу
+    {
+        ostringstream stream;
+        SimpleContext context(stream);
+        context.GetOutput().Write("first\n"sv);
+        stream << "direct\n"sv;
+        context.GetOutput().Write("second\n"sv);
+        ASSERT_EQUAL(stream.str(), "first\ndirect\nsecond\n"s);
+    }
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestNumber);
     RUN_TEST(tr, runtime::TestString);
+    RUN_TEST(tr, runtime::TestStringConcat);
     RUN_TEST(tr, runtime::TestBool);
+    RUN_TEST(tr, runtime::TestSymbols);
     RUN_TEST(tr, runtime::TestMethodInvocation);
     RUN_TEST(tr, runtime::TestIsTrue);
     RUN_TEST(tr, runtime::TestComparison);
+    RUN_TEST(tr, runtime::TestRichComparison);
     RUN_TEST(tr, runtime::TestClass);
+    RUN_TEST(tr, runtime::TestMethodTable);
     RUN_TEST(tr, runtime::TestClassInstance);
+    RUN_TEST(tr, runtime::TestInstanceShapes);
+    RUN_TEST(tr, runtime::TestOutputSinks);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
@@ -547,6 +921,9 @@ void RunObjectHolderTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestOwning);
     RUN_TEST(tr, runtime::TestMove);
     RUN_TEST(tr, runtime::TestNullptr);
+    RUN_TEST(tr, runtime::TestInlineValues);
+    RUN_TEST(tr, runtime::TestKinds);
+    RUN_TEST(tr, runtime::TestBoolSingletons);
 }
 
 }  // namespace runtime
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include "statement.h"
 
+#include "bytecode.h"
+#include "optimizer.h"
+#include "transpiler.h"
+
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 using namespace std;
@@ -15,63 +20,392 @@ namespace ast
 
     namespace
     {
-        const string ADD_METHOD = "__add__"s;
-        const string INIT_METHOD = "__init__"s;
+        const runtime::Symbol ADD_METHOD{ "__add__"sv };
+        const runtime::Symbol INIT_METHOD{ "__init__"sv };
+
+        // Возвращает true, если оба операнда - числа
+        bool AreNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs)
+        {
+            return lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr;
+        }
+
+        // Возвращает true, если оба операнда - строки
+        bool AreStrings(const ObjectHolder& lhs, const ObjectHolder& rhs)
+        {
+            return lhs.GetKind() == runtime::Object::Kind::STRING
+                && rhs.GetKind() == runtime::Object::Kind::STRING;
+        }
+
+        // Значение операнда, который уже проверен функцией AreNumbers
+        int NumberValue(const ObjectHolder& object)
+        {
+            return object.TryAs<runtime::Number>()->GetValue();
+        }
+
+        // Возвращает значение узла-числа либо nullopt, если node - не числовая константа
+        optional<int> NumericConstant(Statement* node)
+        {
+            const auto value = optimizer::Folder::GetConstant(node);
+            if (value && value->TryAs<runtime::Number>() != nullptr)
+                return NumberValue(*value);
+            return nullopt;
+        }
+
+        // Возвращает true, если value представимо числом Mython
+        bool FitsNumber(int64_t value)
+        {
+            return value >= numeric_limits<int>::min() && value <= numeric_limits<int>::max();
+        }
+
+        // Возвращает true, если node - составная инструкция без инструкций
+        bool IsEmptyBlock(Statement* node)
+        {
+            const auto* block = dynamic_cast<Compound*>(node);
+            return block != nullptr && block->IsEmpty();
+        }
+
+        // Заменяет операцию над числами её результатом value.
+        // Переполнение при выполнении не определено, поэтому такие операции остаются в дереве
+        unique_ptr<Statement> FoldNumbers(optimizer::Folder& folder, string_view rule, int64_t value)
+        {
+            if (!FitsNumber(value))
+                return nullptr;
+            return folder.ReplaceWithConstant(rule, ObjectHolder::Own(runtime::Number(static_cast<int>(value))));
+        }
+
+        // Вычисляет lhs op rhs для чисел, проверенных функцией AreNumbers. Делитель не равен 0
+        int ApplyToNumbers(ArithmeticOperator op, int lhs, int rhs)
+        {
+            switch (op)
+            {
+            case ArithmeticOperator::ADD:
+                return lhs + rhs;
+            case ArithmeticOperator::SUB:
+                return lhs - rhs;
+            case ArithmeticOperator::MULT:
+                return lhs * rhs;
+            default:
+                return lhs / rhs;
+            }
+        }
+
+        // Вычисляет lhs op rhs так же, как узлы Add, Sub, Mult и Div
+        ObjectHolder ApplyArithmetic(ArithmeticOperator op, const ObjectHolder& lhs, const ObjectHolder& rhs,
+            Context& context)
+        {
+            switch (op)
+            {
+            case ArithmeticOperator::ADD:
+                return Add::Apply(lhs, rhs, context);
+            case ArithmeticOperator::SUB:
+                return Sub::Apply(lhs, rhs);
+            case ArithmeticOperator::MULT:
+                return Mult::Apply(lhs, rhs);
+            default:
+                return Div::Apply(lhs, rhs);
+            }
+        }
+
+        // Значение присваивания вида target = target op operand (см. FieldUpdate и VariableUpdate)
+        struct UpdatePattern
+        {
+            ArithmeticOperator op;
+            BinaryOperation* operation;
+            VariableValue* target;
+        };
+
+        // Разбирает значение присваивания rv вида target op operand,
+        // где operand - константа или переменная
+        optional<UpdatePattern> MatchUpdate(Statement* rv)
+        {
+            optional<ArithmeticOperator> op;
+            if (dynamic_cast<Add*>(rv) != nullptr)
+                op = ArithmeticOperator::ADD;
+            else if (dynamic_cast<Sub*>(rv) != nullptr)
+                op = ArithmeticOperator::SUB;
+            else if (dynamic_cast<Mult*>(rv) != nullptr)
+                op = ArithmeticOperator::MULT;
+            else if (dynamic_cast<Div*>(rv) != nullptr)
+                op = ArithmeticOperator::DIV;
+            else
+                return nullopt;
+
+            auto* operation = static_cast<BinaryOperation*>(rv);
+            auto* target = dynamic_cast<VariableValue*>(operation->lhs_.get());
+            Statement* operand = operation->rhs_.get();
+            if (target == nullptr
+                || (!optimizer::Folder::GetConstant(operand) && dynamic_cast<VariableValue*>(operand) == nullptr))
+            {
+                return nullopt;
+            }
+            return UpdatePattern{ *op, operation, target };
+        }
+
+        // Имя арифметической операции в генерируемом коде (см. transpiler.h)
+        string OperatorName(ArithmeticOperator op)
+        {
+            switch (op)
+            {
+            case ArithmeticOperator::ADD:
+                return "ast::ArithmeticOperator::ADD"s;
+            case ArithmeticOperator::SUB:
+                return "ast::ArithmeticOperator::SUB"s;
+            case ArithmeticOperator::MULT:
+                return "ast::ArithmeticOperator::MULT"s;
+            default:
+                return "ast::ArithmeticOperator::DIV"s;
+            }
+        }
+
+        // Добавляет в emitter вычисление операндов operation и вызов function(lhs, rhs, context)
+        transpiler::Value TranspileOperation(transpiler::Emitter& emitter, const BinaryOperation& operation,
+            string_view function)
+        {
+            const transpiler::Value lhs = emitter.Emit(operation.lhs_.get());
+            const transpiler::Value rhs = emitter.Emit(operation.rhs_.get());
+            return { emitter.Temp(string(function) + "("s + lhs.code + ", "s + rhs.code + ", context)"s) };
+        }
+
+        // Ошибки чтения переменных и полей общие для VariableValue и слитых с ним узлов *Update,
+        // чтобы узел после свёртки сообщал о них тем же текстом, что и исходное выражение
+        [[noreturn]] void ThrowUndefinedVariable()
+        {
+            throw runtime_error("VariableValue::Execute: There is no value with the given name"s);
+        }
+
+        // Возвращает номер ячейки поля field объекта с полями fields, запоминая его в cache
+        size_t FindFieldSlot(const runtime::InstanceFields& fields, runtime::Symbol field, FieldCache& cache)
+        {
+            if (cache.shape_id != fields.GetShape().GetId())
+            {
+                const size_t slot = fields.GetShape().FindField(field);
+                if (slot == runtime::Shape::NO_FIELD)
+                    throw runtime_error("VariableValue::Execute: There is no field "s + field.GetName());
+                cache = { fields.GetShape().GetId(), slot };
+            }
+            return cache.slot;
+        }
+
+        // Возвращает экземпляр класса, поле которого присваивают FieldAssignment и FieldUpdate
+        runtime::ClassInstance& FieldOwner(const ObjectHolder& object)
+        {
+            runtime::ClassInstance* instance = object.TryAs<runtime::ClassInstance>();
+            if (instance == nullptr)
+                throw runtime_error("FieldAssignment::Execute: Assignment to a field of non-object"s);
+            return *instance;
+        }
+
+        // Возвращает строку, которую выводит метод Print объекта object
+        ObjectHolder PrintToString(const ObjectHolder& object, Context& context)
+        {
+            stringstream out;
+            object->Print(out, context);
+            return ObjectHolder::Own(runtime::String(out.str()));
+        }
     }  // namespace
 
 
 
+    /***************   Statement   ***************/
+
+    unique_ptr<Statement> Statement::Fold(optimizer::Folder& /*folder*/)
+    {
+        return nullptr;
+    }
+
+
+
+    /***************   ValueStatement   ***************/
+
+    template <typename T>
+    void ValueStatement<T>::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.EmitConstant(GetValue());
+    }
+
+
+    template <typename T>
+    transpiler::Value ValueStatement<T>::Transpile(transpiler::Emitter& emitter)
+    {
+        if constexpr (std::is_same_v<T, runtime::Bool>)
+            return { value_.GetValue() ? "ObjectHolder::FromBool(true)"s : "ObjectHolder::FromBool(false)"s };
+        else if constexpr (std::is_same_v<T, runtime::Number>)
+            return { "ObjectHolder::Own(runtime::Number("s + to_string(value_.GetValue()) + "))"s };
+        else
+            return { emitter.String(value_.GetValue()) };
+    }
+
+
+    template class ValueStatement<runtime::Number>;
+    template class ValueStatement<runtime::String>;
+    template class ValueStatement<runtime::Bool>;
+
+
+
+    /***************   None   ***************/
+
+    void None::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Emit(bytecode::OpCode::PUSH_NONE);
+    }
+
+
+    transpiler::Value None::Transpile(transpiler::Emitter& /*emitter*/)
+    {
+        return { "ObjectHolder::None()"s };
+    }
+
+
+
     /***************   VariableValue   ***************/
 
-    VariableValue::VariableValue(const string& var_name)
+    VariableValue::VariableValue(runtime::Symbol var_name)
         : name_(var_name)
     {
     }
 
 
-    VariableValue::VariableValue(vector<string> dotted_ids)
-        : dotted_ids_(move(dotted_ids))
+    VariableValue::VariableValue(vector<runtime::Symbol> dotted_ids)
+    {
+        // Цепочка из одного имени - это обычная переменная
+        if (dotted_ids.size() == 1)
+        {
+            name_ = dotted_ids.front();
+        }
+        else
+        {
+            dotted_ids_ = move(dotted_ids);
+            field_caches_.resize(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1);
+        }
+    }
+
+
+    VariableValue::VariableValue(const vector<string>& dotted_ids)
+        : VariableValue(vector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end()))
+    {
+    }
+
+
+    VariableValue::VariableValue(vector<runtime::Symbol> dotted_ids, size_t slot)
+        : VariableValue(move(dotted_ids))
+    {
+        slot_ = slot;
+    }
+
+
+    ObjectHolder* VariableValue::FindRoot(Closure& closure, Context& context) const
     {
+        if (slot_)
+        {
+            ObjectHolder& local = context.GetValueStack().Local(*slot_);
+            return local.IsUnassigned() ? nullptr : &local;
+        }
+
+        auto it = closure.find(dotted_ids_.empty() ? name_ : dotted_ids_.front());
+        return it != closure.end() ? &it->second : nullptr;
     }
 
 
     ObjectHolder VariableValue::Execute(Closure& closure, Context& context)
     {
-        if (!name_.empty() && closure.count(name_))
+        ObjectHolder* root = FindRoot(closure, context);
+        if (root == nullptr)
+            ThrowUndefinedVariable();
+
+        if (dotted_ids_.empty())
         {
-            return closure.at(name_); // Вычисляем значение переменной
+            return *root; // Вычисляем значение переменной
         }
-        else if (!dotted_ids_.empty() && closure.count(dotted_ids_.at(0))) 
+
+        // Проходим по цепочке полей объектов, начиная со второго имени
+        ObjectHolder out = *root;
+        for (size_t i = 1; i < dotted_ids_.size(); i++)
         {
-            // Если цепочка вызовов полей объектов не пуста и начальный обьект в цепи присутствует
+            // out может быть единственным владельцем объекта, которому принадлежит поле
+            ObjectHolder field = ReadField(out, i);
+            out = move(field);
+        }
+        return out;
+    }
 
-            // Запрашиваем обьект с первым именем в цепочке и начальным полем обьетов closure
-            ObjectHolder out = VariableValue(dotted_ids_.at(0)).Execute(closure, context);
-            Closure c(closure);
-            // Итерируемся по цепочке полей обьектов, начиная со второго обьекта
-            for (size_t i = 1; i < dotted_ids_.size(); i++)
-            {
-                // Обьектом, у которого есть поля являются только экземпляры класса
-                runtime::ClassInstance* cls_instance = dynamic_cast<runtime::ClassInstance*>(out.Get());
-                // Запрашиваем обьект с i именем в цепочке и в качестве полей обьектов передаём поля экземпляра класса
-                c.insert(cls_instance->Fields().begin(), cls_instance->Fields().end());
 
-                out = VariableValue(dotted_ids_.at(i)).Execute(c, context);
-            }
-            return out;
+    ObjectHolder VariableValue::ReadField(const ObjectHolder& object, size_t index)
+    {
+        // Обьектом, у которого есть поля являются только экземпляры класса
+        const auto* cls_instance = object.TryAs<runtime::ClassInstance>();
+        if (cls_instance == nullptr)
+        {
+            throw runtime_error("VariableValue::Execute: "s + dotted_ids_[index - 1].GetName()
+                + " is not a class instance"s);
+        }
+
+        const runtime::InstanceFields& fields = cls_instance->Fields();
+        return fields.GetSlot(FindFieldSlot(fields, dotted_ids_[index], field_caches_[index - 1]));
+    }
+
+
+    bool VariableValue::IsVariable(runtime::Symbol var, optional<size_t> slot) const
+    {
+        return dotted_ids_.empty() && name_ == var && slot_ == slot;
+    }
+
+
+    bool VariableValue::IsFieldOf(const VariableValue& object, runtime::Symbol field) const
+    {
+        if (slot_ != object.slot_ || dotted_ids_.size() < 2 || !(dotted_ids_.back() == field))
+            return false;
+
+        // Цепочка объекта из одного имени хранится в name_
+        if (object.dotted_ids_.empty())
+            return dotted_ids_.size() == 2 && dotted_ids_.front() == object.name_;
+        return dotted_ids_.size() == object.dotted_ids_.size() + 1
+            && equal(object.dotted_ids_.begin(), object.dotted_ids_.end(), dotted_ids_.begin());
+    }
+
+
+    void VariableValue::Compile(bytecode::Compiler& compiler)
+    {
+        if (slot_)
+        {
+            compiler.Emit(bytecode::OpCode::LOAD_LOCAL, static_cast<uint32_t>(*slot_));
         }
         else
         {
-            throw runtime_error("VariableValue::Execute: There is no value with the given name"s);
+            compiler.Emit(bytecode::OpCode::LOAD_GLOBAL,
+                compiler.AddName(dotted_ids_.empty() ? name_ : dotted_ids_.front()));
+        }
+
+        for (size_t i = 1; i < dotted_ids_.size(); i++)
+        {
+            compiler.Emit(bytecode::OpCode::READ_FIELD, compiler.AddFieldRead(*this, i));
+        }
+    }
+
+
+    transpiler::Value VariableValue::Transpile(transpiler::Emitter& emitter)
+    {
+        transpiler::Value value = emitter.ReadVariable(dotted_ids_.empty() ? name_ : dotted_ids_.front(), slot_);
+        for (size_t i = 1; i < dotted_ids_.size(); i++)
+        {
+            value = { emitter.Temp("transpiled::ReadField("s + value.code + ", "s
+                + emitter.Symbol(dotted_ids_[i - 1]) + ", "s + emitter.Symbol(dotted_ids_[i]) + ", "s
+                + emitter.Cache("ast::FieldCache"sv) + ")"s) };
         }
+        return value;
     }
 
 
 
     /***************   Assignment   ***************/
 
-    Assignment::Assignment(string var, unique_ptr<Statement> rv)
-        : name_(move(var)), rv_(move(rv))
+    Assignment::Assignment(runtime::Symbol var, unique_ptr<Statement> rv)
+        : name_(var), rv_(move(rv))
+    {
+    }
+
+
+    Assignment::Assignment(runtime::Symbol var, size_t slot, unique_ptr<Statement> rv)
+        : name_(var), slot_(slot), rv_(move(rv))
     {
     }
 
@@ -81,8 +415,40 @@ namespace ast
         if (!rv_)
             throw runtime_error("Print::Execute: Null pointer");
 
-        closure[name_] = rv_->Execute(closure, context); // Присвиваем имя переменной. Если данной переменной нет в closure, то создаём
-        return closure.at(name_);
+        ObjectHolder value = rv_->Execute(closure, context);
+        if (slot_)
+            return context.GetValueStack().Local(*slot_) = move(value);
+        return closure[name_] = move(value); // Присвиваем имя переменной. Если данной переменной нет в closure, то создаём
+    }
+
+
+    void Assignment::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(rv_.get());
+        if (slot_)
+            compiler.Emit(bytecode::OpCode::STORE_LOCAL, static_cast<uint32_t>(*slot_));
+        else
+            compiler.Emit(bytecode::OpCode::STORE_GLOBAL, compiler.AddName(name_));
+    }
+
+
+    transpiler::Value Assignment::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value value = emitter.Emit(rv_.get());
+        emitter.Assign(name_, slot_, value);
+        return value;
+    }
+
+
+    unique_ptr<Statement> Assignment::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(rv_);
+
+        const auto update = MatchUpdate(rv_.get());
+        if (!update || !update->target->IsVariable(name_, slot_))
+            return nullptr;
+        return folder.Replace("x = x op e -> update"sv,
+            make_unique<VariableUpdate>(name_, slot_, update->op, move(update->operation->rhs_)));
     }
 
 
@@ -101,7 +467,7 @@ namespace ast
     }
 
 
-    unique_ptr<Print> Print::Variable(const string& name)
+    unique_ptr<Print> Print::Variable(runtime::Symbol name)
     {
         return make_unique<Print>(move(make_unique<VariableValue>(name)));
     }
@@ -109,250 +475,1087 @@ namespace ast
 
     ObjectHolder Print::Execute(Closure& closure, Context& context)
     {
-        bool b = false;
-        for (unique_ptr<Statement>& arg : args_)
+        // Строка собирается в буфере контекста и выводится целиком. Вложенные print
+        // (например, в методах, вызванных при вычислении аргументов) выводят и её начало,
+        // поэтому порядок вывода не меняется
+        runtime::FormatBuffer& buffer = context.GetFormatBuffer();
+        try
         {
-            if (!arg)
-                throw runtime_error("Print::Execute: Null pointer");
+            bool b = false;
+            for (unique_ptr<Statement>& arg : args_)
+            {
+                if (!arg)
+                    throw runtime_error("Print::Execute: Null pointer");
 
-            if (b)
-                context.GetOutputStream() << " "s;
+                if (b)
+                    buffer.Append(' ');
 
-            ObjectHolder obj = arg->Execute(closure, context);
-            if (obj)
-                obj->Print(context.GetOutputStream(), context);
-            else
-                context.GetOutputStream() << "None"s;
+                ObjectHolder obj = arg->Execute(closure, context);
+                if (!buffer.TryAppend(obj))
+                {
+                    buffer.WriteTo(context.GetOutput());
+                    obj->Print(context.GetOutputStream(), context);
+                }
 
-            b = true;
+                b = true;
+            }
+            buffer.Append('\n');
         }
-
-        context.GetOutputStream() << endl;
+        catch (...)
+        {
+            // Начало строки выводится и при ошибке
+            buffer.WriteTo(context.GetOutput());
+            throw;
+        }
+        buffer.WriteTo(context.GetOutput());
 
         return {};
     }
 
 
+    void Print::Compile(bytecode::Compiler& compiler)
+    {
+        for (size_t i = 0; i < args_.size(); ++i)
+        {
+            if (i != 0)
+                compiler.Emit(bytecode::OpCode::PRINT_SEPARATOR);
+            compiler.Compile(args_[i].get());
+            compiler.Emit(bytecode::OpCode::PRINT_VALUE);
+        }
+        compiler.Emit(bytecode::OpCode::PRINT_NEWLINE);
+    }
+
+
+    transpiler::Value Print::Transpile(transpiler::Emitter& emitter)
+    {
+        emitter.Open();
+        const string line = emitter.Name("line"sv);
+        emitter.Line("transpiled::PrintLine "s + line + "(context);"s);
+        for (size_t i = 0; i < args_.size(); ++i)
+        {
+            if (i != 0)
+                emitter.Line(line + ".Separator();"s);
+            const transpiler::Value value = emitter.Emit(args_[i].get());
+            emitter.Line(line + ".Append("s + value.code + ");"s);
+        }
+        emitter.Line(line + ".End();"s);
+        emitter.Close();
+        return { "ObjectHolder::None()"s };
+    }
+
+
+    unique_ptr<Statement> Print::Fold(optimizer::Folder& folder)
+    {
+        for (auto& arg : args_)
+            folder.Fold(arg);
+        return nullptr;
+    }
+
+
 
     /***************   MethodCall   ***************/
 
-    MethodCall::MethodCall(unique_ptr<Statement> object, string method,
+    MethodCall::MethodCall(unique_ptr<Statement> object, runtime::Symbol method,
         vector<unique_ptr<Statement>> args)
         : object_(move(object))
-        , method_name_(move(method))
+        , method_name_(method)
         , method_args_(move(args))
     {
     }
 
 
-    ObjectHolder MethodCall::Execute(Closure& closure, Context& context)
+#ifdef MYTHON_STATS
+    MethodCall::CacheStats MethodCall::cache_stats_;
+
+
+    const MethodCall::CacheStats& MethodCall::GetCacheStats()
+    {
+        return cache_stats_;
+    }
+
+
+    void MethodCall::ResetCacheStats()
+    {
+        cache_stats_ = {};
+    }
+#endif
+
+
+    const runtime::Method& MethodCall::FindMethod(const runtime::Class& cls)
+    {
+        for (const CacheEntry& entry : cache_)
+        {
+            if (entry.cls == &cls)
+            {
+#ifdef MYTHON_STATS
+                ++cache_stats_.hits;
+#endif
+                return *entry.method;
+            }
+        }
+
+#ifdef MYTHON_STATS
+        ++cache_stats_.misses;
+#endif
+        const runtime::Method* method = cls.GetMethod(method_name_, method_args_.size());
+        if (method == nullptr)
+        {
+            throw runtime_error("MethodCall::Execute: No method "s + method_name_.GetName()
+                + " with passed parameters"s);
+        }
+
+        // Занимаем свободную запись. Если свободных нет, место в кеше уже не меняется
+        for (CacheEntry& entry : cache_)
+        {
+            if (entry.cls == nullptr)
+            {
+                entry = { &cls, method };
+                break;
+            }
+        }
+        return *method;
+    }
+
+
+    runtime::ClassInstance& MethodCall::Evaluate(Closure& closure, Context& context, ObjectHolder& object,
+        vector<ObjectHolder>& args)
     {
         if (!object_)
             throw runtime_error("MethodCall::Execute: Null pointer");
 
         // Запрашиваем интерфейс класса, который передан в переменной-объекте
-        runtime::ClassInstance* cls_instance =
-            dynamic_cast<runtime::ClassInstance*>(object_->Execute(closure, context).Get());
-
-        // Создаём массив аргументов-обьектов
-        vector<runtime::ObjectHolder> method_args;
+        object = object_->Execute(closure, context);
+        runtime::ClassInstance* cls_instance = object.TryAs<runtime::ClassInstance>();
+        if (cls_instance == nullptr)
+            throw runtime_error("MethodCall::Execute: Method call on non-object"s);
 
         // Получаем обьекты из переданных Statement'ов
+        args.reserve(method_args_.size());
         for (auto& arg : method_args_)
         {
             if (!arg)
                 throw runtime_error("MethodCall::Execute: Null pointer");
-            method_args.push_back(arg->Execute(closure, context));
+            args.push_back(arg->Execute(closure, context));
         }
-        // Вызываем метод
-        return cls_instance->Call(method_name_, method_args, context);
+        return *cls_instance;
     }
 
 
+    ObjectHolder MethodCall::Execute(Closure& closure, Context& context)
+    {
+        ObjectHolder object;
+        vector<runtime::ObjectHolder> method_args;
+        runtime::ClassInstance& cls_instance = Evaluate(closure, context, object, method_args);
 
-    /***************   Stringify   ***************/
+        // Вызываем метод
+        return cls_instance.Call(FindMethod(cls_instance.GetClass()), method_args, context);
+    }
 
-    ObjectHolder Stringify::Execute(Closure& closure, Context& context)
+
+    ObjectHolder MethodCall::Invoke(const ObjectHolder& object, const vector<ObjectHolder>& args,
+        Context& context)
     {
-        if (!argument_)
-            throw runtime_error("Stringify::Execute: Null pointer");
+        runtime::ClassInstance* cls_instance = object.TryAs<runtime::ClassInstance>();
+        if (cls_instance == nullptr)
+            throw runtime_error("MethodCall::Execute: Method call on non-object"s);
 
-        stringstream out;
-        // Получаем обьект из Statement'а
-        auto arg = argument_->Execute(closure, context);
+        return cls_instance->Call(FindMethod(cls_instance->GetClass()), args, context);
+    }
+
+
+    ObjectHolder MethodCall::Defer(Closure& closure, Context& context, runtime::TailCall& tail_call)
+    {
+        ObjectHolder object;
+        vector<runtime::ObjectHolder> method_args;
+        runtime::ClassInstance& cls_instance = Evaluate(closure, context, object, method_args);
+        const runtime::Method& method = FindMethod(cls_instance.GetClass());
 
-        if (arg) // Если имеется обьект
-            arg->Print(out, context);
-        else     // Если обьект отсутствует, то это None
-            out << "None"s;
+        if (!runtime::CanReplaceCall(tail_call.self, object, method_args.data(),
+                method_args.data() + method_args.size()))
+            return cls_instance.Call(method, method_args, context);
 
-        return ObjectHolder::Own(runtime::String(out.str()));
+        tail_call.object = move(object);
+        tail_call.method = &method;
+        tail_call.args = move(method_args);
+        return ObjectHolder::None();
     }
 
 
+    void MethodCall::Compile(bytecode::Compiler& compiler)
+    {
+        EmitCall(compiler, bytecode::OpCode::CALL_METHOD);
+    }
 
-    /***************   Add   ***************/
 
-    ObjectHolder Add::Execute(Closure& closure, Context& context)
+    void MethodCall::CompileTail(bytecode::Compiler& compiler)
     {
-        if (!lhs_ || !rhs_)
-            throw runtime_error("Add::Execute: Null pointer");
+        EmitCall(compiler, bytecode::OpCode::TAIL_CALL);
+    }
 
-        ObjectHolder lhs = lhs_->Execute(closure, context);
-        ObjectHolder rhs = rhs_->Execute(closure, context);
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>())
-        {
-            return ObjectHolder::Own(runtime::Number(lhs.TryAs<runtime::Number>()->GetValue()
-                + rhs.TryAs<runtime::Number>()->GetValue()));
-        }
-        else if (lhs.TryAs<runtime::String>() && rhs.TryAs<runtime::String>())
-        {
-            return ObjectHolder::Own(runtime::String(lhs.TryAs<runtime::String>()->GetValue()
-                + rhs.TryAs<runtime::String>()->GetValue()));
-        }
-        else if (lhs.TryAs<runtime::ClassInstance>() &&
-            lhs.TryAs<runtime::ClassInstance>()->HasMethod(ADD_METHOD, 1))
-        {
-            return lhs.TryAs<runtime::ClassInstance>()->Call(ADD_METHOD, { rhs }, context);
-        }
-        else
+    void MethodCall::EmitCall(bytecode::Compiler& compiler, bytecode::OpCode op)
+    {
+        compiler.Compile(object_.get());
+        for (auto& arg : method_args_)
         {
-            throw runtime_error("Add: Error when adding two values."s);
+            compiler.Compile(arg.get());
         }
+        compiler.Emit(op, compiler.AddCall(*this, method_args_.size()), method_args_.size());
     }
 
 
+    transpiler::Value MethodCall::Transpile(transpiler::Emitter& emitter)
+    {
+        return emitter.Invoke(TranspileCall(emitter));
+    }
 
-    /***************   Sub   ***************/
 
-    ObjectHolder Sub::Execute(Closure& closure, Context& context)
+    transpiler::Call MethodCall::TranspileCall(transpiler::Emitter& emitter)
     {
-        if (!lhs_ || !rhs_)
+        transpiler::Call call{ emitter.Emit(object_.get()), method_name_, {} };
+        // Экземпляр известного класса проверять не нужно
+        if (call.object.cls == nullptr)
+            emitter.Line("transpiled::CheckObject("s + call.object.code + ");"s);
+        for (auto& arg : method_args_)
+            call.args.push_back(emitter.Emit(arg.get()).code);
+        return call;
+    }
+
+
+    unique_ptr<Statement> MethodCall::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(object_);
+        for (auto& arg : method_args_)
+            folder.Fold(arg);
+        return nullptr;
+    }
+
+
+
+    /***************   Stringify   ***************/
+
+    ObjectHolder Stringify::Execute(Closure& closure, Context& context)
+    {
+        if (!argument_)
+            throw runtime_error("Stringify::Execute: Null pointer");
+
+        // Получаем обьект из Statement'а
+        return Apply(argument_->Execute(closure, context), context);
+    }
+
+
+    ObjectHolder Stringify::Apply(const ObjectHolder& arg, Context& context)
+    {
+        runtime::FormatBuffer& buffer = context.GetFormatBuffer();
+        const size_t start = buffer.GetSize();
+        if (buffer.TryAppend(arg))
+        {
+            runtime::String result(string(buffer.View(start)));
+            buffer.Truncate(start);
+            return ObjectHolder::Own(move(result));
+        }
+
+        // Результат __str__ форматируется заново, а не печатается в поток: иначе каждый уровень
+        // рекурсии через __str__ держал бы в стеке процесса собственный stringstream
+        if (auto* instance = arg.TryAs<runtime::ClassInstance>())
+        {
+            if (const runtime::Method* str = instance->GetStrMethod())
+                return Apply(instance->Call(*str, {}, context), context);
+        }
+        return PrintToString(arg, context);
+    }
+
+
+    void Stringify::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(argument_.get());
+        compiler.Emit(bytecode::OpCode::STRINGIFY);
+    }
+
+
+    transpiler::Value Stringify::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value arg = emitter.Emit(argument_.get());
+        return { emitter.Temp("ast::Stringify::Apply("s + arg.code + ", context)"s) };
+    }
+
+
+    unique_ptr<Statement> Stringify::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(argument_);
+        if (!optimizer::Folder::GetConstant(argument_.get()))
+            return nullptr;
+
+        auto value = folder.Evaluate(*this);
+        return value ? folder.ReplaceWithConstant("constant str()"sv, *value) : nullptr;
+    }
+
+
+
+    /***************   SpecializingOperation   ***************/
+
+#ifdef MYTHON_STATS
+    SpecializingOperation::QuickeningStats SpecializingOperation::quickening_stats_;
+
+
+    const SpecializingOperation::QuickeningStats& SpecializingOperation::GetQuickeningStats()
+    {
+        return quickening_stats_;
+    }
+
+
+    void SpecializingOperation::ResetQuickeningStats()
+    {
+        quickening_stats_ = {};
+    }
+#endif
+
+
+    void SpecializingOperation::Specialize(Specialization specialization)
+    {
+        specialization_ = specialization;
+#ifdef MYTHON_STATS
+        if (specialization != Specialization::GENERIC)
+            ++quickening_stats_.specializations;
+#endif
+    }
+
+
+    void SpecializingOperation::Deoptimize()
+    {
+        specialization_ = Specialization::GENERIC;
+#ifdef MYTHON_STATS
+        ++quickening_stats_.deoptimizations;
+#endif
+    }
+
+
+
+    /***************   Add   ***************/
+
+    ObjectHolder Add::Execute(Closure& closure, Context& context)
+    {
+        if (!lhs_ || !rhs_)
+            throw runtime_error("Add::Execute: Null pointer");
+
+        ObjectHolder lhs = lhs_->Execute(closure, context);
+        ObjectHolder rhs = rhs_->Execute(closure, context);
+
+        if (specialization_ == Specialization::NUMBERS && AreNumbers(lhs, rhs))
+            return ObjectHolder::Own(runtime::Number(NumberValue(lhs) + NumberValue(rhs)));
+        return Dispatch(lhs, rhs, context);
+    }
+
+
+    ObjectHolder Add::Dispatch(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+    {
+        if (specialization_ == Specialization::NONE)
+        {
+            auto* cls_instance = lhs.TryAs<runtime::ClassInstance>();
+            if (AreNumbers(lhs, rhs))
+            {
+                Specialize(Specialization::NUMBERS);
+            }
+            else if (AreStrings(lhs, rhs))
+            {
+                Specialize(Specialization::STRINGS);
+            }
+            else if (cls_instance != nullptr && cls_instance->HasMethod(ADD_METHOD, 1))
+            {
+                method_class_ = &cls_instance->GetClass();
+                method_ = method_class_->GetMethod(ADD_METHOD);
+                Specialize(Specialization::METHOD);
+            }
+            else
+            {
+                Specialize(Specialization::GENERIC);
+            }
+        }
+
+        switch (specialization_)
+        {
+        case Specialization::NUMBERS:
+            if (AreNumbers(lhs, rhs))
+                return ObjectHolder::Own(runtime::Number(NumberValue(lhs) + NumberValue(rhs)));
+            break;
+        case Specialization::STRINGS:
+            if (AreStrings(lhs, rhs))
+                return ObjectHolder::Own(runtime::String::Concat(*lhs.TryAs<runtime::String>(),
+                    *rhs.TryAs<runtime::String>()));
+            break;
+        case Specialization::METHOD:
+            if (auto* cls_instance = lhs.TryAs<runtime::ClassInstance>();
+                cls_instance != nullptr && &cls_instance->GetClass() == method_class_)
+                return cls_instance->Call(*method_, { rhs }, context);
+            break;
+        default:
+            return Apply(lhs, rhs, context);
+        }
+
+        Deoptimize();
+        return Apply(lhs, rhs, context);
+    }
+
+
+    ObjectHolder Add::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+    {
+        const runtime::Object::Kind kind = lhs.GetKind();
+        if (kind == rhs.GetKind())
+        {
+            switch (kind)
+            {
+            case runtime::Object::Kind::NUMBER:
+                return ObjectHolder::Own(runtime::Number(NumberValue(lhs) + NumberValue(rhs)));
+            case runtime::Object::Kind::STRING:
+                return ObjectHolder::Own(runtime::String::Concat(*lhs.TryAs<runtime::String>(),
+                    *rhs.TryAs<runtime::String>()));
+            default:
+                break;
+            }
+        }
+
+        if (kind == runtime::Object::Kind::CLASS_INSTANCE)
+        {
+            auto* cls_instance = lhs.TryAs<runtime::ClassInstance>();
+            if (cls_instance->HasMethod(ADD_METHOD, 1))
+                return cls_instance->Call(ADD_METHOD, { rhs }, context);
+        }
+
+        throw runtime_error("Add: Error when adding two values."s);
+    }
+
+
+    void Add::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::ADD);
+    }
+
+
+    transpiler::Value Add::Transpile(transpiler::Emitter& emitter)
+    {
+        return TranspileOperation(emitter, *this, "transpiled::Add"sv);
+    }
+
+
+    unique_ptr<Statement> Add::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = NumericConstant(lhs_.get());
+        const auto rhs = NumericConstant(rhs_.get());
+        if (lhs && rhs)
+            return FoldNumbers(folder, "constant +"sv, int64_t{ *lhs } + *rhs);
+
+        // Сложение строк и ошибки вычисляет сама операция
+        if (optimizer::Folder::GetConstant(lhs_.get()) && optimizer::Folder::GetConstant(rhs_.get()))
+        {
+            auto value = folder.Evaluate(*this);
+            return value ? folder.ReplaceWithConstant("constant +"sv, *value) : nullptr;
+        }
+
+        // Для нечисловых e сложение с 0 выбрасывает исключение, поэтому тождество для них неприменимо
+        if (rhs == 0 && optimizer::Folder::IsNumeric(lhs_.get()))
+            return folder.Replace("e + 0 -> e"sv, move(lhs_));
+        if (lhs == 0 && optimizer::Folder::IsNumeric(rhs_.get()))
+            return folder.Replace("0 + e -> e"sv, move(rhs_));
+        return nullptr;
+    }
+
+
+
+    /***************   Sub   ***************/
+
+    ObjectHolder Sub::Execute(Closure& closure, Context& context)
+    {
+        if (!lhs_ || !rhs_)
             throw runtime_error("Sub::Execute: Null pointer");
 
         ObjectHolder lhs = lhs_->Execute(closure, context);
         ObjectHolder rhs = rhs_->Execute(closure, context);
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>())
+        if (specialization_ == Specialization::NONE)
+            Specialize(AreNumbers(lhs, rhs) ? Specialization::NUMBERS : Specialization::GENERIC);
+
+        if (specialization_ == Specialization::NUMBERS)
         {
-            return ObjectHolder::Own(runtime::Number(lhs.TryAs<runtime::Number>()->GetValue()
-                - rhs.TryAs<runtime::Number>()->GetValue()));
+            if (AreNumbers(lhs, rhs))
+                return ObjectHolder::Own(runtime::Number(NumberValue(lhs) - NumberValue(rhs)));
+            Deoptimize();
         }
+        return Apply(lhs, rhs);
+    }
+
+
+    ObjectHolder Sub::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs)
+    {
+        if (AreNumbers(lhs, rhs))
+            return ObjectHolder::Own(runtime::Number(NumberValue(lhs) - NumberValue(rhs)));
+
+        throw runtime_error("Sub: Error when subtracting two values."s);
+    }
+
+
+    void Sub::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::SUB);
+    }
+
+
+    transpiler::Value Sub::Transpile(transpiler::Emitter& emitter)
+    {
+        return TranspileOperation(emitter, *this, "transpiled::Sub"sv);
+    }
+
+
+    unique_ptr<Statement> Sub::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = NumericConstant(lhs_.get());
+        const auto rhs = NumericConstant(rhs_.get());
+        if (lhs && rhs)
+            return FoldNumbers(folder, "constant -"sv, int64_t{ *lhs } - *rhs);
+        if (rhs == 0 && optimizer::Folder::IsNumeric(lhs_.get()))
+            return folder.Replace("e - 0 -> e"sv, move(lhs_));
+        return nullptr;
+    }
+
+
+
+    /***************   Mult   ***************/
+
+    ObjectHolder Mult::Execute(Closure& closure, Context& context)
+    {
+        if (!lhs_ || !rhs_)
+            throw runtime_error("Mult::Execute: Null pointer");
+
+        ObjectHolder lhs = lhs_->Execute(closure, context);
+        ObjectHolder rhs = rhs_->Execute(closure, context);
+
+        if (specialization_ == Specialization::NONE)
+            Specialize(AreNumbers(lhs, rhs) ? Specialization::NUMBERS : Specialization::GENERIC);
+
+        if (specialization_ == Specialization::NUMBERS)
+        {
+            if (AreNumbers(lhs, rhs))
+                return ObjectHolder::Own(runtime::Number(NumberValue(lhs) * NumberValue(rhs)));
+            Deoptimize();
+        }
+        return Apply(lhs, rhs);
+    }
+
+
+    ObjectHolder Mult::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs)
+    {
+        if (AreNumbers(lhs, rhs))
+            return ObjectHolder::Own(runtime::Number(NumberValue(lhs) * NumberValue(rhs)));
+
+        throw runtime_error("Mult: Error while multiplying two numbers."s);
+    }
+
+
+    void Mult::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::MULT);
+    }
+
+
+    transpiler::Value Mult::Transpile(transpiler::Emitter& emitter)
+    {
+        return TranspileOperation(emitter, *this, "transpiled::Mult"sv);
+    }
+
+
+    unique_ptr<Statement> Mult::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = NumericConstant(lhs_.get());
+        const auto rhs = NumericConstant(rhs_.get());
+        if (lhs && rhs)
+            return FoldNumbers(folder, "constant *"sv, int64_t{ *lhs } * *rhs);
+
+        // Унарный минус разбирается в e * -1, поэтому -(-e) = (e * -1) * -1.
+        // (e * c1) * c2 заменяется на e * (c1 * c2): обе формы выбрасывают одно и то же исключение,
+        // если e - не число
+        auto* inner = dynamic_cast<Mult*>(lhs_.get());
+        const auto factor = inner ? NumericConstant(inner->rhs_.get()) : nullopt;
+        if (rhs && factor)
+        {
+            const int64_t product = int64_t{ *factor } * *rhs;
+            if (FitsNumber(product))
+            {
+                inner->rhs_ = make_unique<NumericConst>(runtime::Number(static_cast<int>(product)));
+                if (product == 1 && optimizer::Folder::IsNumeric(inner->lhs_.get()))
+                    return folder.Replace("(e * c1) * c2 -> e"sv, move(inner->lhs_));
+                return folder.Replace("(e * c1) * c2 -> e * (c1 * c2)"sv, move(lhs_));
+            }
+        }
+
+        if (rhs == 1 && optimizer::Folder::IsNumeric(lhs_.get()))
+            return folder.Replace("e * 1 -> e"sv, move(lhs_));
+        if (lhs == 1 && optimizer::Folder::IsNumeric(rhs_.get()))
+            return folder.Replace("1 * e -> e"sv, move(rhs_));
+        return nullptr;
+    }
+
+
+
+    /***************   Div   ***************/
+
+    ObjectHolder Div::Execute(Closure& closure, Context& context)
+    {
+        if (!lhs_ || !rhs_)
+            throw runtime_error("Div::Execute: Null pointer");
+
+        ObjectHolder lhs = lhs_->Execute(closure, context);
+        ObjectHolder rhs = rhs_->Execute(closure, context);
+
+        if (specialization_ == Specialization::NONE)
+            Specialize(AreNumbers(lhs, rhs) ? Specialization::NUMBERS : Specialization::GENERIC);
+
+        if (specialization_ == Specialization::NUMBERS)
+        {
+            if (AreNumbers(lhs, rhs))
+            {
+                // Деление на ноль не отменяет специализацию: ошибку выбрасывает Apply
+                if (NumberValue(rhs) != 0)
+                    return ObjectHolder::Own(runtime::Number(NumberValue(lhs) / NumberValue(rhs)));
+            }
+            else
+            {
+                Deoptimize();
+            }
+        }
+        return Apply(lhs, rhs);
+    }
+
+
+    ObjectHolder Div::Apply(const ObjectHolder& lhs, const ObjectHolder& rhs)
+    {
+        if (AreNumbers(lhs, rhs) && NumberValue(rhs) != 0)
+            return ObjectHolder::Own(runtime::Number(NumberValue(lhs) / NumberValue(rhs)));
+
+        throw runtime_error("Div: Error when dividing two values."s);
+    }
+
+
+    void Div::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::DIV);
+    }
+
+
+    transpiler::Value Div::Transpile(transpiler::Emitter& emitter)
+    {
+        return TranspileOperation(emitter, *this, "transpiled::Div"sv);
+    }
+
+
+    unique_ptr<Statement> Div::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = NumericConstant(lhs_.get());
+        const auto rhs = NumericConstant(rhs_.get());
+        // Деление на 0 остаётся в дереве и выбросит исключение при выполнении
+        if (lhs && rhs && *rhs != 0)
+            return FoldNumbers(folder, "constant /"sv, int64_t{ *lhs } / *rhs);
+        if (rhs == 1 && optimizer::Folder::IsNumeric(lhs_.get()))
+            return folder.Replace("e / 1 -> e"sv, move(lhs_));
+        return nullptr;
+    }
+
+
+
+    /***************   Compound   ***************/
+
+    ObjectHolder Compound::Execute(Closure& closure, Context& context)
+    {
+        for (unique_ptr<Statement>& instruction : instructions_)
+        {
+            if (!instruction)
+                throw runtime_error("Compound::Execute: Null pointer");
+            ObjectHolder result = instruction->Execute(closure, context);
+            if (context.IsReturning())
+                return result;
+        }
+        return {};
+    }
+
+
+    void Compound::Compile(bytecode::Compiler& compiler)
+    {
+        for (unique_ptr<Statement>& instruction : instructions_)
+        {
+            compiler.Compile(instruction.get());
+            compiler.Emit(bytecode::OpCode::POP);
+        }
+        compiler.Emit(bytecode::OpCode::PUSH_NONE);
+    }
+
+
+    transpiler::Value Compound::Transpile(transpiler::Emitter& emitter)
+    {
+        for (unique_ptr<Statement>& instruction : instructions_)
+            emitter.Emit(instruction.get());
+        return { "ObjectHolder::None()"s };
+    }
+
+
+    unique_ptr<Statement> Compound::Fold(optimizer::Folder& folder)
+    {
+        vector<unique_ptr<Statement>> instructions;
+        instructions.reserve(instructions_.size());
+
+        // Добавляет инструкцию, пока не встретилась инструкция return
+        const auto append = [&instructions](unique_ptr<Statement> stmt) {
+            if (instructions.empty() || !dynamic_cast<Return*>(instructions.back().get()))
+            {
+                instructions.push_back(move(stmt));
+                return true;
+            }
+            return false;
+        };
+
+        bool unreachable = false;
+        for (auto& stmt : instructions_)
+        {
+            folder.Fold(stmt);
+
+            // Значение инструкции отбрасывается, поэтому константы не влияют на выполнение
+            if (optimizer::Folder::GetConstant(stmt.get()))
+            {
+                folder.Drop("unused constant"sv);
+                continue;
+            }
+
+            // Вложенный блок выполняется так же, как его инструкции на его месте
+            if (auto* block = dynamic_cast<Compound*>(stmt.get()))
+            {
+                folder.Drop("nested block"sv);
+                for (auto& nested : block->instructions_)
+                    unreachable = !append(move(nested)) || unreachable;
+                continue;
+            }
+
+            unreachable = !append(move(stmt)) || unreachable;
+        }
+
+        if (unreachable)
+            folder.Drop("unreachable code after return"sv);
+        instructions_ = move(instructions);
+        return nullptr;
+    }
+
+
+
+    /***************   Return   ***************/
+
+    Return::Return(unique_ptr<Statement> statement)
+        : expr_(move(statement))
+        , tail_call_(dynamic_cast<MethodCall*>(expr_.get()))
+    {
+    }
+
+
+    ObjectHolder Return::Execute(Closure& closure, Context& context)
+    {
+        ObjectHolder result;
+        runtime::TailCall* tail_call = context.GetTailCall();
+        if (tail_call_ != nullptr && tail_call != nullptr)
+            result = tail_call_->Defer(closure, context, *tail_call);
+        else if (expr_)
+            result = expr_->Execute(closure, context);
+        context.SetReturning(true);
+        return result;
+    }
+
+
+    void Return::Compile(bytecode::Compiler& compiler)
+    {
+        if (tail_call_ != nullptr)
+            tail_call_->CompileTail(compiler);
+        else if (expr_)
+            compiler.Compile(expr_.get());
+        else
+            compiler.Emit(bytecode::OpCode::PUSH_NONE);
+        compiler.Emit(bytecode::OpCode::RETURN);
+    }
+
+
+    transpiler::Value Return::Transpile(transpiler::Emitter& emitter)
+    {
+        if (tail_call_ != nullptr)
+            emitter.ReturnCall(tail_call_->TranspileCall(emitter));
+        else if (expr_)
+            emitter.Return(emitter.Emit(expr_.get()));
         else
+            emitter.Return({ "ObjectHolder::None()"s });
+        return { "ObjectHolder::None()"s };
+    }
+
+
+    unique_ptr<Statement> Return::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(expr_);
+        tail_call_ = dynamic_cast<MethodCall*>(expr_.get());
+        return nullptr;
+    }
+
+
+
+    /***************   ClassDefinition   ***************/
+
+    ClassDefinition::ClassDefinition(ObjectHolder cls)
+        : class_(move(cls))
+    {
+    }
+
+
+    ClassDefinition::ClassDefinition(ObjectHolder cls, size_t slot)
+        : class_(move(cls)), slot_(slot)
+    {
+    }
+
+
+    ObjectHolder ClassDefinition::Execute(Closure& closure, Context& context)
+    {
+        if (slot_)
         {
-            throw runtime_error("Sub: Error when subtracting two values."s);
+            ObjectHolder& local = context.GetValueStack().Local(*slot_);
+            if (local.IsUnassigned())
+                local = class_;
+            return local;
         }
+        return closure.emplace(class_.TryAs<runtime::Class>()->GetName(), class_).first->second;
+    }
+
+
+    void ClassDefinition::Compile(bytecode::Compiler& compiler)
+    {
+        runtime::Class& cls = *class_.TryAs<runtime::Class>();
+        bytecode::Compiler::CompileMethods(cls);
+
+        compiler.EmitConstant(class_);
+        if (slot_)
+            compiler.Emit(bytecode::OpCode::DEFINE_CLASS_LOCAL, static_cast<uint32_t>(*slot_));
+        else
+            compiler.Emit(bytecode::OpCode::DEFINE_CLASS_GLOBAL, compiler.AddName(cls.GetName()));
     }
 
 
+    transpiler::Value ClassDefinition::Transpile(transpiler::Emitter& emitter)
+    {
+        emitter.DefineClass(*class_.TryAs<runtime::Class>(), slot_);
+        return { "ObjectHolder::None()"s };
+    }
+
+
+    unique_ptr<Statement> ClassDefinition::Fold(optimizer::Folder& folder)
+    {
+        folder.FoldMethods(*class_.TryAs<runtime::Class>());
+        return nullptr;
+    }
+
+
+
+    /***************   FieldAssignment   ***************/
+
+    FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name,
+        unique_ptr<Statement> rv)
+        : object_(move(object))
+        , field_name_(field_name)
+        , rv_(move(rv))
+    {
+    }
 
-    /***************   Mult   ***************/
 
-    ObjectHolder Mult::Execute(Closure& closure, Context& context)
+    ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context)
     {
-        if (!lhs_ || !rhs_)
-            throw runtime_error("Mult::Execute: Null pointer");
+        if (!rv_)
+            throw runtime_error("FieldAssignment::Execute: Null pointer");
+        ObjectHolder object = object_.Execute(closure, context);
+        // Объект проверяем до вычисления rv, Assign повторит проверку
+        FieldOwner(object);
 
-        ObjectHolder lhs = lhs_->Execute(closure, context);
-        ObjectHolder rhs = rhs_->Execute(closure, context);
+        return Assign(object, rv_->Execute(closure, context));
+    }
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>())
+
+    ObjectHolder FieldAssignment::Assign(const ObjectHolder& object, ObjectHolder value)
+    {
+        // Форму проверяем после вычисления rv: оно могло добавить объекту поля
+        runtime::InstanceFields& fields = FieldOwner(object).Fields();
+        if (cache_.shape_id == fields.GetShape().GetId())
         {
-            return ObjectHolder::Own(runtime::Number(lhs.TryAs<runtime::Number>()->GetValue()
-                * rhs.TryAs<runtime::Number>()->GetValue()));
+            fields.ExtendTo(*new_shape_);
         }
         else
         {
-            throw runtime_error("Mult: Error while multiplying two numbers."s);
+            cache_.shape_id = fields.GetShape().GetId();
+            cache_.slot = fields.Define(field_name_);
+            new_shape_ = &fields.GetShape();
         }
+        return fields.GetSlot(cache_.slot) = move(value);
     }
 
 
+    void FieldAssignment::Compile(bytecode::Compiler& compiler)
+    {
+        object_.Compile(compiler);
+        compiler.Compile(rv_.get());
+        compiler.Emit(bytecode::OpCode::STORE_FIELD, compiler.AddNode(*this));
+    }
 
-    /***************   Div   ***************/
 
-    ObjectHolder Div::Execute(Closure& closure, Context& context)
+    transpiler::Value FieldAssignment::Transpile(transpiler::Emitter& emitter)
     {
-        if (!lhs_ || !rhs_)
-            throw runtime_error("Div::Execute: Null pointer");
+        const transpiler::Value object = object_.Transpile(emitter);
+        // Объект проверяется до вычисления rv, как при выполнении узла
+        if (object.cls == nullptr)
+            emitter.Line("transpiled::CheckFieldObject("s + object.code + ");"s);
+        const transpiler::Value value = emitter.Emit(rv_.get());
+        emitter.Line("transpiled::AssignField("s + object.code + ", "s + emitter.Symbol(field_name_) + ", "s
+            + value.code + ", "s + emitter.Cache("transpiled::FieldStoreCache"sv) + ");"s);
+        return { "ObjectHolder::None()"s };
+    }
 
-        ObjectHolder lhs = lhs_->Execute(closure, context);
-        ObjectHolder rhs = rhs_->Execute(closure, context);
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>() &&
-            (rhs.TryAs<runtime::Number>()->GetValue() != 0))
-        {
-            return ObjectHolder::Own(runtime::Number(lhs.TryAs<runtime::Number>()->GetValue()
-                / rhs.TryAs<runtime::Number>()->GetValue()));
-        }
-        else
-        {
-            throw runtime_error("Div: Error when dividing two values."s);
-        }
+    unique_ptr<Statement> FieldAssignment::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(rv_);
+
+        const auto update = MatchUpdate(rv_.get());
+        if (!update || !update->target->IsFieldOf(object_, field_name_))
+            return nullptr;
+        return folder.Replace("o.f = o.f op e -> update"sv,
+            make_unique<FieldUpdate>(move(object_), field_name_, update->op, move(update->operation->rhs_)));
     }
 
 
 
-    /***************   Compound   ***************/
+    /***************   FieldUpdate   ***************/
 
-    ObjectHolder Compound::Execute(Closure& closure, Context& context)
+    FieldUpdate::FieldUpdate(VariableValue object, runtime::Symbol field_name, ArithmeticOperator op,
+        unique_ptr<Statement> operand)
+        : object_(move(object))
+        , field_name_(field_name)
+        , op_(op)
+        , operand_(move(operand))
     {
-        for (unique_ptr<Statement>& instruction : instructions_)
+    }
+
+
+    ObjectHolder FieldUpdate::Execute(Closure& closure, Context& context)
+    {
+        ObjectHolder object = object_.Execute(closure, context);
+        runtime::InstanceFields& fields = FieldOwner(object).Fields();
+        ObjectHolder& field = fields.GetSlot(FindFieldSlot(fields, field_name_, cache_));
+        const ObjectHolder operand = operand_->Execute(closure, context);
+
+        if (AreNumbers(field, operand) && (op_ != ArithmeticOperator::DIV || NumberValue(operand) != 0))
         {
-            if (!instruction)
-                throw runtime_error("Compound::Execute: Null pointer");
-            instruction->Execute(closure, context);
+            field = ObjectHolder::Own(runtime::Number(ApplyToNumbers(op_, NumberValue(field),
+                NumberValue(operand))));
+            return field;
         }
-        return {};
+
+        // Метод __add__ может добавить объекту поля, поэтому ячейка находится заново
+        ObjectHolder result = ApplyArithmetic(op_, ObjectHolder(field), operand, context);
+        return fields.GetSlot(FindFieldSlot(fields, field_name_, cache_)) = move(result);
     }
 
 
+    void FieldUpdate::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Emit(bytecode::OpCode::UPDATE, compiler.AddNode(*this));
+    }
 
-    /***************   Return   ***************/
 
-    ObjectHolder Return::Execute(Closure& closure, Context& context)
+    transpiler::Value FieldUpdate::Transpile(transpiler::Emitter& emitter)
     {
-        if(expr_)
-            throw ReturnValue(expr_->Execute(closure, context));
-        return {};
+        const transpiler::Value object = object_.Transpile(emitter);
+        const string field = emitter.Symbol(field_name_);
+        const string cache = emitter.Cache("ast::FieldCache"sv);
+        emitter.Line("transpiled::FindField("s + object.code + ", "s + field + ", "s + cache + ");"s);
+        const transpiler::Value operand = emitter.Emit(operand_.get());
+        emitter.Line("transpiled::UpdateField(context, "s + object.code + ", "s + field + ", "s + OperatorName(op_)
+            + ", "s + operand.code + ", "s + cache + ");"s);
+        return { "ObjectHolder::None()"s };
     }
 
 
 
-    /***************   ClassDefinition   ***************/
+    /***************   VariableUpdate   ***************/
 
-    ClassDefinition::ClassDefinition(ObjectHolder cls)
-        : class_(move(cls))
+    VariableUpdate::VariableUpdate(runtime::Symbol var, optional<size_t> slot, ArithmeticOperator op,
+        unique_ptr<Statement> operand)
+        : name_(var)
+        , slot_(slot)
+        , op_(op)
+        , operand_(move(operand))
     {
     }
 
 
-    ObjectHolder ClassDefinition::Execute(Closure& closure, Context& /*context*/)
+    ObjectHolder VariableUpdate::Execute(Closure& closure, Context& context)
     {
-        return closure.emplace(dynamic_cast<runtime::Class*>(class_.Get())->GetName(), class_).first->second;
-    }
+        ObjectHolder* variable = nullptr;
+        if (slot_)
+        {
+            ObjectHolder& local = context.GetValueStack().Local(*slot_);
+            variable = local.IsUnassigned() ? nullptr : &local;
+        }
+        else if (auto it = closure.find(name_); it != closure.end())
+        {
+            variable = &it->second;
+        }
+        if (variable == nullptr)
+            ThrowUndefinedVariable();
 
+        const ObjectHolder operand = operand_->Execute(closure, context);
+        if (AreNumbers(*variable, operand) && (op_ != ArithmeticOperator::DIV || NumberValue(operand) != 0))
+        {
+            *variable = ObjectHolder::Own(runtime::Number(ApplyToNumbers(op_, NumberValue(*variable),
+                NumberValue(operand))));
+            return *variable;
+        }
 
+        // Вызов метода __add__ может переместить кадры стека значений
+        ObjectHolder result = ApplyArithmetic(op_, ObjectHolder(*variable), operand, context);
+        if (slot_)
+            return context.GetValueStack().Local(*slot_) = move(result);
+        return *variable = move(result);
+    }
 
-    /***************   FieldAssignment   ***************/
 
-    FieldAssignment::FieldAssignment(VariableValue object, string field_name,
-        unique_ptr<Statement> rv)
-        : object_(move(object))
-        , field_name_(move(field_name))
-        , rv_(move(rv))
+    void VariableUpdate::Compile(bytecode::Compiler& compiler)
     {
+        compiler.Emit(bytecode::OpCode::UPDATE, compiler.AddNode(*this));
     }
 
 
-    ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context)
+    transpiler::Value VariableUpdate::Transpile(transpiler::Emitter& emitter)
     {
-        if (!rv_)
-            throw runtime_error("FieldAssignment::Execute: Null pointer");
-        runtime::ClassInstance* obj = dynamic_cast<runtime::ClassInstance*>(object_.Execute(closure, context).Get());
-        obj->Fields()[field_name_] = rv_->Execute(closure, context);
-        return obj->Fields().at(field_name_);
+        const transpiler::Value variable = emitter.ReadVariable(name_, slot_);
+        const transpiler::Value operand = emitter.Emit(operand_.get());
+        const transpiler::Value value{ emitter.Temp("transpiled::Apply("s + OperatorName(op_) + ", "s
+            + variable.code + ", "s + operand.code + ", context)"s) };
+        emitter.Assign(name_, slot_, value);
+        return value;
     }
 
 
@@ -389,6 +1592,66 @@ namespace ast
     }
 
 
+    void IfElse::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(condition_.get());
+        const size_t to_else = compiler.EmitJump(bytecode::OpCode::JUMP_IF_FALSE);
+        const size_t depth = compiler.GetStackDepth();
+
+        compiler.Compile(if_body_.get());
+        const size_t to_end = compiler.EmitJump(bytecode::OpCode::JUMP);
+
+        compiler.PatchJump(to_else);
+        compiler.SetStackDepth(depth);
+        if (else_body_)
+            compiler.Compile(else_body_.get());
+        else
+            compiler.Emit(bytecode::OpCode::PUSH_NONE);
+        compiler.PatchJump(to_end);
+    }
+
+
+    transpiler::Value IfElse::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value condition = emitter.Emit(condition_.get());
+        emitter.Open("if (runtime::IsTrue("s + condition.code + "))"s);
+        emitter.Emit(if_body_.get());
+        emitter.Close();
+        if (else_body_)
+        {
+            emitter.Open("else"sv);
+            emitter.Emit(else_body_.get());
+            emitter.Close();
+        }
+        return { "ObjectHolder::None()"s };
+    }
+
+
+    unique_ptr<Statement> IfElse::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(condition_);
+        folder.Fold(if_body_);
+        folder.Fold(else_body_);
+
+        const auto condition = optimizer::Folder::GetConstant(condition_.get());
+        if (!condition)
+        {
+            // Условие вычисляется ради побочных эффектов, а значение if с пустыми ветками - None,
+            // как у составной инструкции
+            if (IsEmptyBlock(if_body_.get()) && (!else_body_ || IsEmptyBlock(else_body_.get())))
+                return folder.Replace("if with empty branches -> condition"sv,
+                    make_unique<Compound>(move(condition_)));
+            return nullptr;
+        }
+
+        if (IsTrue(*condition))
+            return folder.Replace("if True -> if body"sv, move(if_body_));
+        if (else_body_)
+            return folder.Replace("if False -> else body"sv, move(else_body_));
+        return folder.Replace("if False -> None"sv, make_unique<None>());
+    }
+
+
 
     /***************   Or   ***************/
 
@@ -399,16 +1662,69 @@ namespace ast
         ObjectHolder lhs = lhs_->Execute(closure, context);
 
         if (IsTrue(lhs))
-            return ObjectHolder::Own(runtime::Bool(true));
+            return ObjectHolder::FromBool(true);
 
         if (!rhs_)
             throw runtime_error("Or::Execute: Null pointer");
         ObjectHolder rhs = rhs_->Execute(closure, context);
 
-        if (IsTrue(rhs))
-            return ObjectHolder::Own(runtime::Bool(true));
-        else
-            return ObjectHolder::Own(runtime::Bool(false));
+        return ObjectHolder::FromBool(IsTrue(rhs));
+    }
+
+
+    void Or::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        const size_t to_true = compiler.EmitJump(bytecode::OpCode::JUMP_IF_TRUE);
+        const size_t depth = compiler.GetStackDepth();
+
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::TO_BOOL);
+        const size_t to_end = compiler.EmitJump(bytecode::OpCode::JUMP);
+
+        compiler.PatchJump(to_true);
+        compiler.SetStackDepth(depth);
+        compiler.EmitConstant(ObjectHolder::FromBool(true));
+        compiler.PatchJump(to_end);
+    }
+
+
+    transpiler::Value Or::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value lhs = emitter.Emit(lhs_.get());
+        const string result = emitter.Declare();
+        emitter.Open("if (runtime::IsTrue("s + lhs.code + "))"s);
+        emitter.Line(result + " = ObjectHolder::FromBool(true);"s);
+        emitter.Close();
+        emitter.Open("else"sv);
+        const transpiler::Value rhs = emitter.Emit(rhs_.get());
+        emitter.Line(result + " = ObjectHolder::FromBool(runtime::IsTrue("s + rhs.code + "));"s);
+        emitter.Close();
+        return { result };
+    }
+
+
+    unique_ptr<Statement> Or::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = optimizer::Folder::GetConstant(lhs_.get());
+        if (!lhs)
+        {
+            const auto rhs = optimizer::Folder::GetConstant(rhs_.get());
+            if (rhs && !IsTrue(*rhs) && optimizer::Folder::IsBoolean(lhs_.get()))
+                return folder.Replace("e or False -> e"sv, move(lhs_));
+            return nullptr;
+        }
+
+        if (IsTrue(*lhs))
+            return folder.ReplaceWithConstant("True or e"sv, ObjectHolder::FromBool(true));
+        if (const auto rhs = optimizer::Folder::GetConstant(rhs_.get()))
+            return folder.ReplaceWithConstant("constant or"sv, ObjectHolder::FromBool(IsTrue(*rhs)));
+        if (optimizer::Folder::IsBoolean(rhs_.get()))
+            return folder.Replace("False or e -> e"sv, move(rhs_));
+        return nullptr;
     }
 
 
@@ -420,13 +1736,66 @@ namespace ast
         ObjectHolder lhs = lhs_->Execute(closure, context);
 
         if (!IsTrue(lhs))
-            return ObjectHolder::Own(runtime::Bool(false));
+            return ObjectHolder::FromBool(false);
 
         ObjectHolder rhs = rhs_->Execute(closure, context);
-        if (IsTrue(rhs))
-            return ObjectHolder::Own(runtime::Bool(true));
-        else
-            return ObjectHolder::Own(runtime::Bool(false));
+        return ObjectHolder::FromBool(IsTrue(rhs));
+    }
+
+
+    void And::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        const size_t to_false = compiler.EmitJump(bytecode::OpCode::JUMP_IF_FALSE);
+        const size_t depth = compiler.GetStackDepth();
+
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::TO_BOOL);
+        const size_t to_end = compiler.EmitJump(bytecode::OpCode::JUMP);
+
+        compiler.PatchJump(to_false);
+        compiler.SetStackDepth(depth);
+        compiler.EmitConstant(ObjectHolder::FromBool(false));
+        compiler.PatchJump(to_end);
+    }
+
+
+    transpiler::Value And::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value lhs = emitter.Emit(lhs_.get());
+        const string result = emitter.Declare();
+        emitter.Open("if (!runtime::IsTrue("s + lhs.code + "))"s);
+        emitter.Line(result + " = ObjectHolder::FromBool(false);"s);
+        emitter.Close();
+        emitter.Open("else"sv);
+        const transpiler::Value rhs = emitter.Emit(rhs_.get());
+        emitter.Line(result + " = ObjectHolder::FromBool(runtime::IsTrue("s + rhs.code + "));"s);
+        emitter.Close();
+        return { result };
+    }
+
+
+    unique_ptr<Statement> And::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+
+        const auto lhs = optimizer::Folder::GetConstant(lhs_.get());
+        if (!lhs)
+        {
+            const auto rhs = optimizer::Folder::GetConstant(rhs_.get());
+            if (rhs && IsTrue(*rhs) && optimizer::Folder::IsBoolean(lhs_.get()))
+                return folder.Replace("e and True -> e"sv, move(lhs_));
+            return nullptr;
+        }
+
+        if (!IsTrue(*lhs))
+            return folder.ReplaceWithConstant("False and e"sv, ObjectHolder::FromBool(false));
+        if (const auto rhs = optimizer::Folder::GetConstant(rhs_.get()))
+            return folder.ReplaceWithConstant("constant and"sv, ObjectHolder::FromBool(IsTrue(*rhs)));
+        if (optimizer::Folder::IsBoolean(rhs_.get()))
+            return folder.Replace("True and e -> e"sv, move(rhs_));
+        return nullptr;
     }
 
 
@@ -439,10 +1808,36 @@ namespace ast
             throw runtime_error("Not::Execute: Null pointer");
 
         ObjectHolder arg = argument_->Execute(closure, context);
-        if (IsTrue(arg))
-            return ObjectHolder::Own(runtime::Bool(false));
-        else
-            return ObjectHolder::Own(runtime::Bool(true));
+        return ObjectHolder::FromBool(!IsTrue(arg));
+    }
+
+
+    void Not::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(argument_.get());
+        compiler.Emit(bytecode::OpCode::NOT);
+    }
+
+
+    transpiler::Value Not::Transpile(transpiler::Emitter& emitter)
+    {
+        const transpiler::Value arg = emitter.Emit(argument_.get());
+        return { emitter.Temp("ObjectHolder::FromBool(!runtime::IsTrue("s + arg.code + "))"s) };
+    }
+
+
+    unique_ptr<Statement> Not::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(argument_);
+
+        if (const auto arg = optimizer::Folder::GetConstant(argument_.get()))
+            return folder.ReplaceWithConstant("constant not"sv, ObjectHolder::FromBool(!IsTrue(*arg)));
+
+        // not not e равно e, только если e - уже логическое значение
+        auto* inner = dynamic_cast<Not*>(argument_.get());
+        if (inner && optimizer::Folder::IsBoolean(inner->argument_.get()))
+            return folder.Replace("not not e -> e"sv, move(inner->argument_));
+        return nullptr;
     }
 
 
@@ -463,13 +1858,189 @@ namespace ast
         ObjectHolder lhs = lhs_->Execute(closure, context);
         ObjectHolder rhs = rhs_->Execute(closure, context);
 
-        if (comparator_(lhs, rhs, context))
-            return ObjectHolder::Own(runtime::Bool(true));
+        return ObjectHolder::FromBool(comparator_(lhs, rhs, context));
+    }
+
+
+    void Comparison::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        compiler.Emit(bytecode::OpCode::COMPARE_WITH, compiler.AddNode(*this));
+    }
+
+
+    transpiler::Value Comparison::Transpile(transpiler::Emitter& /*emitter*/)
+    {
+        // Произвольную функцию сравнения нельзя записать в исходном тексте
+        throw runtime_error("Comparison::Transpile: Comparator can't be translated to C++"s);
+    }
+
+
+    unique_ptr<Statement> Comparison::Fold(optimizer::Folder& folder)
+    {
+        // Функция сравнения может зависеть от контекста, поэтому упрощаются только операнды
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+        return nullptr;
+    }
+
+
+
+    /***************   ComparisonOf   ***************/
+
+    namespace
+    {
+        template <ComparisonOperator Op, typename T>
+        bool Compare(const T& lhs, const T& rhs)
+        {
+            if constexpr (Op == ComparisonOperator::LESS)
+                return lhs < rhs;
+            else if constexpr (Op == ComparisonOperator::GREATER)
+                return lhs > rhs;
+            else if constexpr (Op == ComparisonOperator::EQUAL)
+                return lhs == rhs;
+            else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+                return lhs != rhs;
+            else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+                return lhs <= rhs;
+            else
+                return lhs >= rhs;
+        }
+
+        template <ComparisonOperator Op>
+        bool CompareStrings(const runtime::String& lhs, const runtime::String& rhs)
+        {
+            // Строки разной длины не равны, и сравнивать их текст не нужно
+            if constexpr (Op == ComparisonOperator::EQUAL || Op == ComparisonOperator::NOT_EQUAL)
+            {
+                if (lhs.GetLength() != rhs.GetLength())
+                    return Op == ComparisonOperator::NOT_EQUAL;
+            }
+            return Compare<Op>(lhs.GetValue(), rhs.GetValue());
+        }
+
+        template <ComparisonOperator Op>
+        bool CompareObjects(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+        {
+            if constexpr (Op == ComparisonOperator::LESS)
+                return runtime::Less(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::GREATER)
+                return runtime::Greater(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::EQUAL)
+                return runtime::Equal(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+                return runtime::NotEqual(lhs, rhs, context);
+            else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+                return runtime::LessOrEqual(lhs, rhs, context);
+            else
+                return runtime::GreaterOrEqual(lhs, rhs, context);
+        }
+    }  // namespace
+
+
+    template <ComparisonOperator Op>
+    ObjectHolder ComparisonOf<Op>::Execute(Closure& closure, Context& context)
+    {
+        if (!lhs_ || !rhs_)
+            throw runtime_error("Comparison::Execute: Null pointer");
+
+        ObjectHolder lhs = lhs_->Execute(closure, context);
+        ObjectHolder rhs = rhs_->Execute(closure, context);
+
+        if (specialization_ == Specialization::NONE)
+        {
+            if (AreNumbers(lhs, rhs))
+                Specialize(Specialization::NUMBERS);
+            else if (AreStrings(lhs, rhs))
+                Specialize(Specialization::STRINGS);
+            else
+                Specialize(Specialization::GENERIC);
+        }
+
+        switch (specialization_)
+        {
+        case Specialization::NUMBERS:
+            if (AreNumbers(lhs, rhs))
+                return ObjectHolder::FromBool(Compare<Op>(NumberValue(lhs), NumberValue(rhs)));
+            Deoptimize();
+            break;
+        case Specialization::STRINGS:
+            if (AreStrings(lhs, rhs))
+                return ObjectHolder::FromBool(CompareStrings<Op>(*lhs.TryAs<runtime::String>(),
+                    *rhs.TryAs<runtime::String>()));
+            Deoptimize();
+            break;
+        default:
+            break;
+        }
+
+        return ObjectHolder::FromBool(CompareObjects<Op>(lhs, rhs, context));
+    }
+
+
+    template <ComparisonOperator Op>
+    void ComparisonOf<Op>::Compile(bytecode::Compiler& compiler)
+    {
+        compiler.Compile(lhs_.get());
+        compiler.Compile(rhs_.get());
+        if constexpr (Op == ComparisonOperator::LESS)
+            compiler.Emit(bytecode::OpCode::LESS);
+        else if constexpr (Op == ComparisonOperator::GREATER)
+            compiler.Emit(bytecode::OpCode::GREATER);
+        else if constexpr (Op == ComparisonOperator::EQUAL)
+            compiler.Emit(bytecode::OpCode::EQUAL);
+        else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+            compiler.Emit(bytecode::OpCode::NOT_EQUAL);
+        else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+            compiler.Emit(bytecode::OpCode::LESS_OR_EQUAL);
+        else
+            compiler.Emit(bytecode::OpCode::GREATER_OR_EQUAL);
+    }
+
+
+    template <ComparisonOperator Op>
+    transpiler::Value ComparisonOf<Op>::Transpile(transpiler::Emitter& emitter)
+    {
+        if constexpr (Op == ComparisonOperator::LESS)
+            return TranspileOperation(emitter, *this, "transpiled::Compare<ast::ComparisonOperator::LESS>"sv);
+        else if constexpr (Op == ComparisonOperator::GREATER)
+            return TranspileOperation(emitter, *this, "transpiled::Compare<ast::ComparisonOperator::GREATER>"sv);
+        else if constexpr (Op == ComparisonOperator::EQUAL)
+            return TranspileOperation(emitter, *this, "transpiled::Compare<ast::ComparisonOperator::EQUAL>"sv);
+        else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+            return TranspileOperation(emitter, *this, "transpiled::Compare<ast::ComparisonOperator::NOT_EQUAL>"sv);
+        else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+            return TranspileOperation(emitter, *this,
+                "transpiled::Compare<ast::ComparisonOperator::LESS_OR_EQUAL>"sv);
         else
-            return ObjectHolder::Own(runtime::Bool(false));
+            return TranspileOperation(emitter, *this,
+                "transpiled::Compare<ast::ComparisonOperator::GREATER_OR_EQUAL>"sv);
+    }
+
+
+    template <ComparisonOperator Op>
+    unique_ptr<Statement> ComparisonOf<Op>::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(lhs_);
+        folder.Fold(rhs_);
+        if (!optimizer::Folder::GetConstant(lhs_.get()) || !optimizer::Folder::GetConstant(rhs_.get()))
+            return nullptr;
+
+        // Сравнение констант не вызывает методов классов и не зависит от окружения
+        auto value = folder.Evaluate(*this);
+        return value ? folder.ReplaceWithConstant("constant comparison"sv, *value) : nullptr;
     }
 
 
+    template class ComparisonOf<ComparisonOperator::LESS>;
+    template class ComparisonOf<ComparisonOperator::GREATER>;
+    template class ComparisonOf<ComparisonOperator::EQUAL>;
+    template class ComparisonOf<ComparisonOperator::NOT_EQUAL>;
+    template class ComparisonOf<ComparisonOperator::LESS_OR_EQUAL>;
+    template class ComparisonOf<ComparisonOperator::GREATER_OR_EQUAL>;
+
+
 
     /***************   NewInstance   ***************/
 
@@ -485,24 +2056,84 @@ namespace ast
     }
 
 
-    ObjectHolder NewInstance::Execute(Closure& closure, Context& context)
+    bool NewInstance::HasInitializer() const
+    {
+        return GetInitializer() != nullptr;
+    }
+
+
+    const runtime::Method* NewInstance::GetInitializer() const
     {
-        auto holder = ObjectHolder::Own(runtime::ClassInstance{ cls_ });
-        auto cls_inst = holder.TryAs<runtime::ClassInstance>();
+        return cls_.GetMethod(INIT_METHOD, args_.size());
+    }
+
+
+    ObjectHolder NewInstance::Create() const
+    {
+        return ObjectHolder::Own(runtime::ClassInstance{ cls_ });
+    }
+
 
-        if (cls_inst->HasMethod(INIT_METHOD, args_.size()))
+    ObjectHolder NewInstance::Execute(Closure& closure, Context& context)
+    {
+        // Аргументы вычисляются, только если их получит метод __init__
+        vector<runtime::ObjectHolder> actual_args;
+        if (HasInitializer())
         {
-            vector<runtime::ObjectHolder> actual_args;
             for (const auto& arg : args_)
             {
                 actual_args.push_back(arg->Execute(closure, context));
             }
-            cls_inst->Call(INIT_METHOD, actual_args, context);
+        }
+        return Instantiate(actual_args, context);
+    }
+
+
+    ObjectHolder NewInstance::Instantiate(const vector<ObjectHolder>& args, Context& context)
+    {
+        auto holder = Create();
+        if (const runtime::Method* init = GetInitializer())
+        {
+            holder.TryAs<runtime::ClassInstance>()->Call(*init, args, context);
         }
         return holder;
     }
 
 
+    void NewInstance::Compile(bytecode::Compiler& compiler)
+    {
+        const size_t argument_count = HasInitializer() ? args_.size() : 0;
+        for (size_t i = 0; i < argument_count; ++i)
+        {
+            compiler.Compile(args_[i].get());
+        }
+        compiler.Emit(bytecode::OpCode::NEW_INSTANCE, compiler.AddCall(*this, argument_count),
+            argument_count);
+    }
+
+
+    transpiler::Value NewInstance::Transpile(transpiler::Emitter& emitter)
+    {
+        // Аргументы вычисляются, только если их получит метод __init__
+        const runtime::Method* init = cls_.GetMethod(INIT_METHOD, args_.size());
+        vector<string> args;
+        if (init != nullptr)
+        {
+            for (const auto& arg : args_)
+                args.push_back(emitter.Emit(arg.get()).code);
+        }
+        return emitter.NewInstance(cls_, init, args);
+    }
+
+
+    unique_ptr<Statement> NewInstance::Fold(optimizer::Folder& folder)
+    {
+        for (auto& arg : args_)
+            folder.Fold(arg);
+        return nullptr;
+    }
+
+
 
     /***************   MethodBody   ***************/
 
@@ -514,17 +2145,33 @@ namespace ast
 
     ObjectHolder MethodBody::Execute(Closure& closure, Context& context)
     {
-        try
-        {
-            if (!body_)
-                throw  runtime_error("MethodBody::Execute: Null pointer");
+        if (!body_)
+            throw runtime_error("MethodBody::Execute: Null pointer");
 
-            return body_->Execute(closure, context);
-        }
-        catch (ReturnValue& return_value)
-        {
-            return return_value;
-        }
+        ObjectHolder result = body_->Execute(closure, context);
+        // Инструкция return завершает только этот метод
+        context.SetReturning(false);
+        return result;
+    }
+
+
+    void MethodBody::Compile(bytecode::Compiler& compiler)
+    {
+        // Команда RETURN в конце байт-кода метода возвращает значение тела
+        compiler.Compile(body_.get());
+    }
+
+
+    transpiler::Value MethodBody::Transpile(transpiler::Emitter& emitter)
+    {
+        return emitter.Emit(body_.get());
+    }
+
+
+    unique_ptr<Statement> MethodBody::Fold(optimizer::Folder& folder)
+    {
+        folder.Fold(body_);
+        return nullptr;
     }
 
 }  // namespace ast
\ No newline at end of file
@@ -2,13 +2,48 @@
 
 #include "runtime.h"
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <optional>
+
+namespace bytecode
+{
+    class Compiler;
+    enum class OpCode : std::uint8_t;
+}  // namespace bytecode
+
+namespace optimizer
+{
+    class Folder;
+}  // namespace optimizer
+
+namespace transpiler
+{
+    class Emitter;
+    struct Value;
+    struct Call;
+}  // namespace transpiler
 
 namespace ast
 {
 
-    using Statement = runtime::Executable;
-    using ReturnValue = runtime::ObjectHolder;
+    // Узел дерева программы. Выполняется обходом дерева (Execute)
+    // либо компилируется в байт-код для виртуальной машины (см. bytecode.h).
+    // Программу можно также перевести в исходный текст на C++ (см. transpiler.h)
+    class Statement : public runtime::Executable
+    {
+    public:
+        // Добавляет в compiler байт-код, который оставляет на стеке значение узла
+        virtual void Compile(bytecode::Compiler& compiler) = 0;
+
+        // Упрощает поддеревья узла (см. optimizer.h). Возвращает узел, которым нужно
+        // заменить этот, либо nullptr, если узел остаётся в дереве
+        virtual std::unique_ptr<Statement> Fold(optimizer::Folder& folder);
+
+        // Добавляет в emitter код C++, который вычисляет значение узла (см. transpiler.h)
+        virtual transpiler::Value Transpile(transpiler::Emitter& emitter) = 0;
+    };
 
 
     // Выражение, возвращающее значение типа T,
@@ -25,7 +60,28 @@ namespace ast
         runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
             runtime::Context& /*context*/) override
         {
-            return runtime::ObjectHolder::Share(value_);
+            return GetValue();
+        }
+
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+
+        runtime::ObjectHolder GetValue()
+        {
+            // Для логических значений есть общие объекты True и False,
+            // а небольшие значения дешевле скопировать, чем ссылаться на них
+            if constexpr (std::is_same_v<T, runtime::Bool>)
+            {
+                return runtime::ObjectHolder::FromBool(value_.GetValue());
+            }
+            else if constexpr (runtime::ObjectHolder::IS_INLINE<T>)
+            {
+                return runtime::ObjectHolder::Own(T(value_));
+            }
+            else
+            {
+                return runtime::ObjectHolder::Share(value_);
+            }
         }
 
     private:
@@ -40,36 +96,73 @@ namespace ast
 
 
 
+    // Встроенный кеш обращения к полю: у объектов с формой номер shape_id
+    // поле хранится в ячейке slot (см. runtime::Shape)
+    struct FieldCache
+    {
+        std::uint64_t shape_id = 0;
+        size_t slot = 0;
+    };
+
+
+
     /*
     Вычисляет значение переменной либо цепочки вызовов полей объектов id1.id2.id3.
     Например, выражение circle.center.x - цепочка вызовов полей объектов в инструкции:
     x = circle.center.x
+    Если задан номер ячейки slot, первое имя цепочки - локальная переменная метода,
+    значение которой хранится в ячейке slot кадра вызова (см. runtime::ValueStack)
     */
     class VariableValue : public Statement
     {
     public:
-        explicit VariableValue(const std::string& var_name);
-        explicit VariableValue(std::vector<std::string> dotted_ids);
+        explicit VariableValue(runtime::Symbol var_name);
+        explicit VariableValue(std::vector<runtime::Symbol> dotted_ids);
+        explicit VariableValue(const std::vector<std::string>& dotted_ids);
+        VariableValue(std::vector<runtime::Symbol> dotted_ids, size_t slot);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+
+        // Возвращает значение поля с именем номер index цепочки у объекта object,
+        // полученного по предыдущим именам цепочки
+        runtime::ObjectHolder ReadField(const runtime::ObjectHolder& object, size_t index);
+
+        // Возвращает true, если узел читает переменную var (локальную в ячейке slot, если он задан)
+        [[nodiscard]] bool IsVariable(runtime::Symbol var, std::optional<size_t> slot) const;
+        // Возвращает true, если узел читает поле field объекта, значение которого вычисляет object
+        [[nodiscard]] bool IsFieldOf(const VariableValue& object, runtime::Symbol field) const;
 
     private:
-        std::string name_;
-        std::vector<std::string> dotted_ids_;
+        // Возвращает значение первого имени цепочки либо nullptr, если переменная не определена
+        runtime::ObjectHolder* FindRoot(runtime::Closure& closure, runtime::Context& context) const;
+
+        runtime::Symbol name_;
+        std::vector<runtime::Symbol> dotted_ids_;
+        std::optional<size_t> slot_;
+        // Кеши обращения к полям dotted_ids_[1], dotted_ids_[2] и т.д.
+        std::vector<FieldCache> field_caches_;
     };
 
 
 
     // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
+    // Локальная переменная метода хранится в ячейке slot кадра вызова
     class Assignment : public Statement
     {
     public:
-        Assignment(std::string var, std::unique_ptr<Statement> rv);
+        Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv);
+        Assignment(runtime::Symbol var, size_t slot, std::unique_ptr<Statement> rv);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
 
     private:
-        std::string name_;
+        runtime::Symbol name_;
+        std::optional<size_t> slot_;
         std::unique_ptr<Statement> rv_;
     };
 
@@ -79,14 +172,83 @@ namespace ast
     class FieldAssignment : public Statement
     {
     public:
-        FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+        FieldAssignment(VariableValue object, runtime::Symbol field_name, std::unique_ptr<Statement> rv);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Присваивает полю объекта object уже вычисленное значение value и возвращает его.
+        // Если object - не экземпляр класса, выбрасывает runtime_error
+        runtime::ObjectHolder Assign(const runtime::ObjectHolder& object, runtime::ObjectHolder value);
     
     private:
         VariableValue object_;
-        std::string field_name_;
+        runtime::Symbol field_name_;
         std::unique_ptr<Statement> rv_;
+        // Объект с формой из кеша после присваивания получает форму new_shape_
+        // (она отличается от исходной, если присваивание добавляет поле)
+        FieldCache cache_;
+        const runtime::Shape* new_shape_ = nullptr;
+    };
+
+
+
+    // Арифметическая операция присваивания с изменением значения (см. FieldUpdate и VariableUpdate)
+    enum class ArithmeticOperator
+    {
+        ADD,
+        SUB,
+        MULT,
+        DIV
+    };
+
+
+
+    /*
+    Присваивание вида object.field = object.field op operand, где op - арифметическая операция,
+    а operand - константа или переменная. Им оптимизатор (см. optimizer.h) заменяет FieldAssignment:
+    объект вычисляется один раз, поле находится один раз, а числовой результат
+    записывается на место прежнего значения
+    */
+    class FieldUpdate : public Statement
+    {
+    public:
+        FieldUpdate(VariableValue object, runtime::Symbol field_name, ArithmeticOperator op,
+            std::unique_ptr<Statement> operand);
+
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+
+    private:
+        VariableValue object_;
+        runtime::Symbol field_name_;
+        ArithmeticOperator op_;
+        std::unique_ptr<Statement> operand_;
+        FieldCache cache_;
+    };
+
+
+
+    // Присваивание вида x = x op operand для переменной x, которую оно находит один раз.
+    // Локальная переменная метода хранится в ячейке slot кадра вызова
+    class VariableUpdate : public Statement
+    {
+    public:
+        VariableUpdate(runtime::Symbol var, std::optional<size_t> slot, ArithmeticOperator op,
+            std::unique_ptr<Statement> operand);
+
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+
+    private:
+        runtime::Symbol name_;
+        std::optional<size_t> slot_;
+        ArithmeticOperator op_;
+        std::unique_ptr<Statement> operand_;
     };
 
 
@@ -100,6 +262,9 @@ namespace ast
         {
             return {};
         }
+
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
     };
 
 
@@ -114,11 +279,14 @@ namespace ast
         explicit Print(std::vector<std::unique_ptr<Statement>> args);
 
         // Инициализирует команду print для вывода значения переменной name
-        static std::unique_ptr<Print> Variable(const std::string& name);
+        static std::unique_ptr<Print> Variable(runtime::Symbol name);
 
         // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
         // context.GetOutputStream()
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
 
     private:
         std::vector<std::unique_ptr<Statement>> args_;
@@ -126,19 +294,77 @@ namespace ast
 
 
 
-    // Вызывает метод object.method со списком параметров args
+    /*
+    Вызывает метод object.method со списком параметров args.
+    Узел запоминает методы, найденные для нескольких последних классов объектов (полиморфный
+    встроенный кеш), поэтому повторные вызовы в этом месте программы обходятся без поиска метода.
+    Классы программы живут дольше её узлов, поэтому указатели на них в кеше остаются действительными
+    */
     class MethodCall : public Statement
     {
     public:
-        MethodCall(std::unique_ptr<Statement> object, std::string method,
+        // Количество классов, методы которых запоминает один узел
+        static constexpr size_t CACHE_SIZE = 4;
+
+        // Статистика попаданий во встроенные кеши всех узлов MethodCall.
+        // Собирается только в сборке с макросом MYTHON_STATS, чтобы не замедлять вызовы
+        struct CacheStats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+        };
+
+        MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
             std::vector<std::unique_ptr<Statement>> args);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
-    
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Вызывает метод у уже вычисленного объекта object с вычисленными аргументами args.
+        // Если object - не экземпляр класса, выбрасывает runtime_error
+        runtime::ObjectHolder Invoke(const runtime::ObjectHolder& object,
+            const std::vector<runtime::ObjectHolder>& args, runtime::Context& context);
+
+        // Выполняет вызов в инструкции return: вычисляет объект и аргументы и, если вызов может
+        // заменить выполняемый метод (см. runtime::CanReplaceCall), откладывает его в tail_call
+        // и возвращает None. Иначе вызывает метод сразу
+        runtime::ObjectHolder Defer(runtime::Closure& closure, runtime::Context& context,
+            runtime::TailCall& tail_call);
+        // Компилирует вызов в инструкции return командой TAIL_CALL
+        void CompileTail(bytecode::Compiler& compiler);
+        // Добавляет в emitter вычисление объекта и аргументов вызова и возвращает вызов
+        transpiler::Call TranspileCall(transpiler::Emitter& emitter);
+
+        // Возвращает метод, вызываемый у объекта класса cls, проверив количество аргументов
+        const runtime::Method& FindMethod(const runtime::Class& cls);
+
+#ifdef MYTHON_STATS
+        [[nodiscard]] static const CacheStats& GetCacheStats();
+        static void ResetCacheStats();
+#endif
+
     private:
+        struct CacheEntry
+        {
+            const runtime::Class* cls = nullptr;
+            const runtime::Method* method = nullptr;
+        };
+
+        // Вычисляет объект, у которого вызывается метод, и аргументы вызова
+        runtime::ClassInstance& Evaluate(runtime::Closure& closure, runtime::Context& context,
+            runtime::ObjectHolder& object, std::vector<runtime::ObjectHolder>& args);
+        void EmitCall(bytecode::Compiler& compiler, bytecode::OpCode op);
+
         std::unique_ptr<Statement> object_;
-        std::string method_name_;
+        runtime::Symbol method_name_;
         std::vector<std::unique_ptr<Statement>> method_args_;
+        std::array<CacheEntry, CACHE_SIZE> cache_;
+
+#ifdef MYTHON_STATS
+        static CacheStats cache_stats_;
+#endif
     };
 
 
@@ -163,8 +389,24 @@ namespace ast
         NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Создаёт экземпляр класса. Если у класса есть подходящий метод __init__,
+        // вызывает его с уже вычисленными аргументами args
+        runtime::ObjectHolder Instantiate(const std::vector<runtime::ObjectHolder>& args,
+            runtime::Context& context);
+
+        // Создаёт экземпляр класса, не вызывая __init__
+        [[nodiscard]] runtime::ObjectHolder Create() const;
+        // Возвращает метод __init__, вызываемый при создании экземпляра, либо nullptr
+        [[nodiscard]] const runtime::Method* GetInitializer() const;
 
     private:
+        // Возвращает true, если при создании экземпляра вызывается метод __init__
+        [[nodiscard]] bool HasInitializer() const;
+
         const runtime::Class& cls_;
         std::vector<std::unique_ptr<Statement>> args_;
     };
@@ -191,6 +433,12 @@ namespace ast
     public:
         using UnaryOperation::UnaryOperation;
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Возвращает строковое представление уже вычисленного значения arg
+        static runtime::ObjectHolder Apply(const runtime::ObjectHolder& arg, runtime::Context& context);
     };
 
 
@@ -209,61 +457,149 @@ namespace ast
 
 
 
-    // Возвращает результат операции + над аргументами lhs и rhs
-    class Add : public BinaryOperation
+    /*
+     * Бинарная операция, которая при первом выполнении запоминает виды операндов
+     * и дальше выполняется специализированной веткой для них.
+     * Специализированная ветка лишь проверяет, что операнды прежних видов. При несовпадении
+     * операция навсегда переходит на общую ветку, которая разбирает все допустимые случаи
+     */
+    class SpecializingOperation : public BinaryOperation
     {
     public:
+        enum class Specialization
+        {
+            NONE,     // операция ещё не выполнялась
+            NUMBERS,  // оба операнда - числа
+            STRINGS,  // оба операнда - строки
+            METHOD,   // lhs - экземпляр одного и того же класса, операция вызывает его метод
+            GENERIC   // общая ветка
+        };
+
+        // Статистика специализаций всех узлов. Собирается только в сборке с MYTHON_STATS
+        struct QuickeningStats
+        {
+            size_t specializations = 0;
+            size_t deoptimizations = 0;
+        };
+
         using BinaryOperation::BinaryOperation;
 
+        [[nodiscard]] Specialization GetSpecialization() const
+        {
+            return specialization_;
+        }
+
+#ifdef MYTHON_STATS
+        [[nodiscard]] static const QuickeningStats& GetQuickeningStats();
+        static void ResetQuickeningStats();
+#endif
+
+    protected:
+        // Выбирает ветку по видам операндов первого выполнения
+        void Specialize(Specialization specialization);
+        // Отказывается от специализации, когда операнды не прошли проверку
+        void Deoptimize();
+
+        Specialization specialization_ = Specialization::NONE;
+
+#ifdef MYTHON_STATS
+    private:
+        static QuickeningStats quickening_stats_;
+#endif
+    };
+
+
+
+    // Возвращает результат операции + над аргументами lhs и rhs
+    class Add : public SpecializingOperation
+    {
+    public:
+        using SpecializingOperation::SpecializingOperation;
+
         // Поддерживается сложение:
         //  число + число
         //  строка + строка
         //  объект1 + объект2, если у объект1 - пользовательский класс с методом _add__(rhs)
         // В противном случае при вычислении выбрасывается runtime_error
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Возвращает сумму уже вычисленных lhs и rhs, разбирая все допустимые случаи
+        static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs,
+            const runtime::ObjectHolder& rhs, runtime::Context& context);
+
+    private:
+        // Выполняет сложение всеми способами, кроме уже специализированного сложения чисел.
+        // Вынесено из Execute, чтобы рекурсия через сложение занимала меньше стека процесса
+        runtime::ObjectHolder Dispatch(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+            runtime::Context& context);
+
+        // Класс lhs и его метод __add__ для специализации METHOD
+        const runtime::Class* method_class_ = nullptr;
+        const runtime::Method* method_ = nullptr;
     };
 
 
 
     // Возвращает результат вычитания аргументов lhs и rhs
-    class Sub : public BinaryOperation
+    class Sub : public SpecializingOperation
     {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         // Поддерживается вычитание:
         //  число - число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Возвращает разность уже вычисленных lhs и rhs
+        static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
     };
 
 
 
     // Возвращает результат умножения аргументов lhs и rhs
-    class Mult : public BinaryOperation
+    class Mult : public SpecializingOperation
     {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         // Поддерживается умножение:
         //  число * число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Возвращает произведение уже вычисленных lhs и rhs
+        static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
     };
 
 
 
     // Возвращает результат деления lhs и rhs
-    class Div : public BinaryOperation
+    class Div : public SpecializingOperation
     {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         // Поддерживается деление:
         //  число / число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
         // Если rhs равен 0, выбрасывается исключение runtime_error
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        // Возвращает частное уже вычисленных lhs и rhs
+        static runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
     };
 
 
@@ -276,6 +612,9 @@ namespace ast
         // Значение аргумента rhs вычисляется, только если значение lhs
         // после приведения к Bool равно False
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     };
 
 
@@ -288,6 +627,9 @@ namespace ast
         // Значение аргумента rhs вычисляется, только если значение lhs
         // после приведения к Bool равно True
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     };
 
 
@@ -298,6 +640,9 @@ namespace ast
     public:
         using UnaryOperation::UnaryOperation;
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     };
 
 
@@ -319,8 +664,17 @@ namespace ast
             instructions_.push_back(std::move(stmt));
         }
 
-        // Последовательно выполняет добавленные инструкции. Возвращает None
+        [[nodiscard]] bool IsEmpty() const noexcept
+        {
+            return instructions_.empty();
+        }
+
+        // Последовательно выполняет добавленные инструкции. Возвращает None.
+        // Если одна из инструкций выполнила return, прекращает выполнение и возвращает её результат
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     
     private:
         std::vector<std::unique_ptr<Statement>> instructions_;
@@ -338,6 +692,9 @@ namespace ast
         // Если внутри body была выполнена инструкция return, возвращает результат return
         // В противном случае возвращает None
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
 
     private:
         std::unique_ptr<Statement> body_;
@@ -349,17 +706,21 @@ namespace ast
     class Return : public Statement
     {
     public:
-        explicit Return(std::unique_ptr<Statement> statement)
-            : expr_(std::move(statement))
-        {
-        }
+        explicit Return(std::unique_ptr<Statement> statement);
 
         // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
         // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
+        // Возвращает этот результат и сообщает о завершении метода через context.SetReturning.
+        // Вызов метода в return выполняется после выхода из текущего метода (см. runtime::TailCall)
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     
     private:
         std::unique_ptr<Statement> expr_;
+        // expr_, если это вызов метода, иначе nullptr
+        MethodCall* tail_call_ = nullptr;
     };
 
 
@@ -370,13 +731,19 @@ namespace ast
     public:
         // Гарантируется, что ObjectHolder содержит объект типа runtime::Class
         explicit ClassDefinition(runtime::ObjectHolder cls);
+        // Класс, объявленный в теле метода, сохраняется в ячейке slot кадра вызова
+        ClassDefinition(runtime::ObjectHolder cls, size_t slot);
 
         // Создаёт внутри closure новый объект, совпадающий с именем класса и значением, переданным в
         // конструктор
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     
     private:
         runtime::ObjectHolder class_;
+        std::optional<size_t> slot_;
     };
 
 
@@ -390,6 +757,9 @@ namespace ast
             std::unique_ptr<Statement> else_body);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
     
     private:
         std::unique_ptr<Statement> condition_;
@@ -399,7 +769,8 @@ namespace ast
 
 
 
-    // Операция сравнения
+    // Операция сравнения с произвольной функцией сравнения.
+    // Парсер создаёт вместо неё узлы ComparisonOf для конкретных операторов
     class Comparison : public BinaryOperation
     {
     public:
@@ -412,9 +783,51 @@ namespace ast
         // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
         // приведённый к типу runtime::Bool
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+
+        [[nodiscard]] const Comparator& GetComparator() const
+        {
+            return comparator_;
+        }
     
     private:
         Comparator comparator_;
     };
 
+
+
+    // Оператор сравнения, который вычисляет узел ComparisonOf
+    enum class ComparisonOperator
+    {
+        LESS,
+        GREATER,
+        EQUAL,
+        NOT_EQUAL,
+        LESS_OR_EQUAL,
+        GREATER_OR_EQUAL
+    };
+
+    // Операция сравнения с оператором, известным на этапе компиляции.
+    // Числа и строки сравниваются напрямую, остальные значения - функциями из runtime
+    template <ComparisonOperator Op>
+    class ComparisonOf : public SpecializingOperation
+    {
+    public:
+        using SpecializingOperation::SpecializingOperation;
+
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Compile(bytecode::Compiler& compiler) override;
+        transpiler::Value Transpile(transpiler::Emitter& emitter) override;
+        std::unique_ptr<Statement> Fold(optimizer::Folder& folder) override;
+    };
+
+    using Less = ComparisonOf<ComparisonOperator::LESS>;
+    using Greater = ComparisonOf<ComparisonOperator::GREATER>;
+    using Equal = ComparisonOf<ComparisonOperator::EQUAL>;
+    using NotEqual = ComparisonOf<ComparisonOperator::NOT_EQUAL>;
+    using LessOrEqual = ComparisonOf<ComparisonOperator::LESS_OR_EQUAL>;
+    using GreaterOrEqual = ComparisonOf<ComparisonOperator::GREATER_OR_EQUAL>;
+
 }  // namespace ast
\ No newline at end of file
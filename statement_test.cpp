@@ -1,5 +1,6 @@
 #include "statement.h"
 
+#include "bytecode.h"
 #include "test_runner.h"
 
 using namespace std;
@@ -7,12 +8,44 @@ using namespace std;
 namespace ast
 {
 
+    using bytecode::ExecutionMode;
     using runtime::Closure;
     using runtime::ObjectHolder;
 
     namespace
     {
 
+        // Выполняет узел node обходом дерева либо виртуальной машиной
+        template <ExecutionMode Mode>
+        ObjectHolder Run(Statement& node, Closure& closure, runtime::Context& context)
+        {
+            if constexpr (Mode == ExecutionMode::BYTECODE)
+            {
+                bytecode::Chunk chunk = bytecode::Compiler::CompileStatement(node);
+                return bytecode::Run(chunk, closure, context);
+            }
+            else
+            {
+                return node.Execute(closure, context);
+            }
+        }
+
+        template <ExecutionMode Mode>
+        ObjectHolder Run(Statement&& node, Closure& closure, runtime::Context& context)
+        {
+            return Run<Mode>(node, closure, context);
+        }
+
+        // При выполнении виртуальной машиной компилирует методы класса cls
+        template <ExecutionMode Mode>
+        void PrepareClass(runtime::Class& cls)
+        {
+            if constexpr (Mode == ExecutionMode::BYTECODE)
+            {
+                bytecode::Compiler::CompileMethods(cls);
+            }
+        }
+
         template <typename T>
         void AssertObjectValueEqual(const ObjectHolder& obj, const T& expected, const string& msg)
         {
@@ -35,6 +68,7 @@ namespace ast
         AssertObjectValueEqual(obj, expected, __assert_equal_private_os.str());           \
     }
 
+        template <ExecutionMode Mode>
         void TestNumericConst()
         {
             runtime::DummyContext context;
@@ -42,7 +76,7 @@ namespace ast
             NumericConst num(runtime::Number(57));
             Closure empty;
 
-            ObjectHolder o = num.Execute(empty, context);
+            ObjectHolder o = Run<Mode>(num, empty, context);
             ASSERT(o);
             ASSERT(empty.empty());
 
@@ -50,9 +84,10 @@ namespace ast
             o->Print(os, context);
             ASSERT_EQUAL(os.str(), "57"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestStringConst()
         {
             runtime::DummyContext context;
@@ -60,7 +95,7 @@ namespace ast
             StringConst value_(runtime::String("Hello!"s));
             Closure empty;
 
-            ObjectHolder o = value_.Execute(empty, context);
+            ObjectHolder o = Run<Mode>(value_, empty, context);
             ASSERT(o);
             ASSERT(empty.empty());
 
@@ -68,9 +103,10 @@ namespace ast
             o->Print(os, context);
             ASSERT_EQUAL(os.str(), "Hello!"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestVariable()
         {
             runtime::DummyContext context;
@@ -79,13 +115,14 @@ namespace ast
             runtime::String word("Hello"s);
 
             Closure closure = { {"x"s, ObjectHolder::Share(num)}, {"w"s, ObjectHolder::Share(word)} };
-            ASSERT(VariableValue("x"s).Execute(closure, context).Get() == &num);
-            ASSERT(VariableValue("w"s).Execute(closure, context).Get() == &word);
-            ASSERT_THROWS(VariableValue("unknown"s).Execute(closure, context), runtime_error);
+            ASSERT(Run<Mode>(VariableValue("x"s), closure, context).Get() == &num);
+            ASSERT(Run<Mode>(VariableValue("w"s), closure, context).Get() == &word);
+            ASSERT_THROWS(Run<Mode>(VariableValue("unknown"s), closure, context), runtime_error);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestAssignment()
         {
             runtime::DummyContext context;
@@ -96,7 +133,7 @@ namespace ast
             Closure closure = { {"y"s, ObjectHolder::Own(runtime::Number(42))} };
 
             {
-                ObjectHolder o = assign_x.Execute(closure, context);
+                ObjectHolder o = Run<Mode>(assign_x, closure, context);
                 ASSERT(o);
                 ASSERT_OBJECT_VALUE_EQUAL(o, 57);
             }
@@ -104,16 +141,17 @@ namespace ast
             ASSERT_OBJECT_VALUE_EQUAL(closure.at("x"s), 57);
 
             {
-                ObjectHolder o = assign_y.Execute(closure, context);
+                ObjectHolder o = Run<Mode>(assign_y, closure, context);
                 ASSERT(o);
                 ASSERT_OBJECT_VALUE_EQUAL(o, "Hello"s);
             }
             ASSERT(closure.find("y"s) != closure.end());
             ASSERT_OBJECT_VALUE_EQUAL(closure.at("y"s), "Hello"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestFieldAssignment()
         {
             runtime::DummyContext context;
@@ -128,19 +166,19 @@ namespace ast
             Closure closure = { {"self"s, ObjectHolder::Share(object)} };
 
             {
-                ObjectHolder o = assign_x.Execute(closure, context);
+                ObjectHolder o = Run<Mode>(assign_x, closure, context);
                 ASSERT(o);
                 ASSERT_OBJECT_VALUE_EQUAL(o, 57);
             }
             ASSERT(object.Fields().find("x"s) != object.Fields().end());
             ASSERT_OBJECT_VALUE_EQUAL(object.Fields().at("x"s), 57);
 
-            assign_y.Execute(closure, context);
+            Run<Mode>(assign_y, closure, context);
             FieldAssignment assign_yz(
                 VariableValue{ vector<string>{"self"s, "y"s} }, "z"s,
                 make_unique<StringConst>(runtime::String("Hello, world! Hooray! Yes-yes!!!"s)));
             {
-                ObjectHolder o = assign_yz.Execute(closure, context);
+                ObjectHolder o = Run<Mode>(assign_yz, closure, context);
                 ASSERT(o);
                 ASSERT_OBJECT_VALUE_EQUAL(o, "Hello, world! Hooray! Yes-yes!!!"s);
             }
@@ -150,9 +188,10 @@ namespace ast
             ASSERT(subobject != nullptr && subobject->Fields().find("z"s) != subobject->Fields().end());
             ASSERT_OBJECT_VALUE_EQUAL(subobject->Fields().at("z"s), "Hello, world! Hooray! Yes-yes!!!"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestPrintVariable()
         {
             runtime::DummyContext context;
@@ -160,11 +199,12 @@ namespace ast
             Closure closure = { {"y"s, ObjectHolder::Own(runtime::Number(42))} };
 
             auto print_statement = Print::Variable("y"s);
-            print_statement->Execute(closure, context);
+            Run<Mode>(*print_statement, closure, context);
 
-            ASSERT_EQUAL(context.output.str(), "42\n"s);
+            ASSERT_EQUAL(context.output.View(), "42\n"s);
         }
 
+        template <ExecutionMode Mode>
         void TestPrintMultipleStatements()
         {
             runtime::DummyContext context;
@@ -178,11 +218,12 @@ namespace ast
             args.push_back(make_unique<StringConst>("Python"s));
             args.push_back(make_unique<VariableValue>("empty"s));
 
-            Print(move(args)).Execute(closure, context);
+            Run<Mode>(Print(move(args)), closure, context);
 
-            ASSERT_EQUAL(context.output.str(), "hello 57 Python None\n"s);
+            ASSERT_EQUAL(context.output.View(), "hello 57 Python None\n"s);
         }
 
+        template <ExecutionMode Mode>
         void TestStringify()
         {
             runtime::DummyContext context;
@@ -190,12 +231,12 @@ namespace ast
             Closure empty;
 
             {
-                auto result = Stringify(make_unique<NumericConst>(57)).Execute(empty, context);
+                ObjectHolder result = Run<Mode>(Stringify(make_unique<NumericConst>(57)), empty, context);
                 ASSERT_OBJECT_VALUE_EQUAL(result, "57"s);
                 ASSERT(result.TryAs<runtime::String>());
             }
             {
-                auto result = Stringify(make_unique<StringConst>("Wazzup!"s)).Execute(empty, context);
+                ObjectHolder result = Run<Mode>(Stringify(make_unique<StringConst>("Wazzup!"s)), empty, context);
                 ASSERT_OBJECT_VALUE_EQUAL(result, "Wazzup!"s);
                 ASSERT(result.TryAs<runtime::String>());
             }
@@ -204,8 +245,9 @@ namespace ast
                 methods.push_back({ "__str__"s, {}, make_unique<NumericConst>(842) });
 
                 runtime::Class cls("BoxedValue"s, move(methods), nullptr);
+                PrepareClass<Mode>(cls);
 
-                auto result = Stringify(make_unique<NewInstance>(cls)).Execute(empty, context);
+                ObjectHolder result = Run<Mode>(Stringify(make_unique<NewInstance>(cls)), empty, context);
                 ASSERT_OBJECT_VALUE_EQUAL(result, "842"s);
                 ASSERT(result.TryAs<runtime::String>());
             }
@@ -217,16 +259,17 @@ namespace ast
                 expected_output << closure.at("x"s).Get();
 
                 Stringify str(make_unique<VariableValue>("x"s));
-                ASSERT_OBJECT_VALUE_EQUAL(str.Execute(closure, context), expected_output.str());
+                ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(str, closure, context), expected_output.str());
             }
             {
                 Stringify str(make_unique<None>());
-                ASSERT_OBJECT_VALUE_EQUAL(str.Execute(empty, context), "None"s);
+                ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(str, empty, context), "None"s);
             }
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestNumbersAddition()
         {
             runtime::DummyContext context;
@@ -234,11 +277,12 @@ namespace ast
             Add sum(make_unique<NumericConst>(23), make_unique<NumericConst>(34));
 
             Closure empty;
-            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(empty, context), 57);
+            ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(sum, empty, context), 57);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestStringsAddition()
         {
             runtime::DummyContext context;
@@ -246,11 +290,12 @@ namespace ast
             Add sum(make_unique<StringConst>("23"s), make_unique<StringConst>("34"s));
 
             Closure empty;
-            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(empty, context), "2334"s);
+            ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(sum, empty, context), "2334"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestBadAddition()
         {
             runtime::DummyContext context;
@@ -258,19 +303,20 @@ namespace ast
             Closure empty;
 
             ASSERT_THROWS(
-                Add(make_unique<NumericConst>(42), make_unique<StringConst>("4"s)).Execute(empty, context),
+                Run<Mode>(Add(make_unique<NumericConst>(42), make_unique<StringConst>("4"s)), empty, context),
                 runtime_error);
             ASSERT_THROWS(
-                Add(make_unique<StringConst>("4"s), make_unique<NumericConst>(42)).Execute(empty, context),
+                Run<Mode>(Add(make_unique<StringConst>("4"s), make_unique<NumericConst>(42)), empty, context),
                 runtime_error);
-            ASSERT_THROWS(Add(make_unique<None>(), make_unique<StringConst>("4"s)).Execute(empty, context),
+            ASSERT_THROWS(Run<Mode>(Add(make_unique<None>(), make_unique<StringConst>("4"s)), empty, context),
                 runtime_error);
-            ASSERT_THROWS(Add(make_unique<None>(), make_unique<None>()).Execute(empty, context),
+            ASSERT_THROWS(Run<Mode>(Add(make_unique<None>(), make_unique<None>()), empty, context),
                 runtime_error);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestSuccessfulClassInstanceAdd()
         {
             runtime::DummyContext context;
@@ -282,15 +328,17 @@ namespace ast
                                                 make_unique<VariableValue>("value_"s)) });
 
             runtime::Class cls("BoxedValue"s, move(methods), nullptr);
+            PrepareClass<Mode>(cls);
 
             Closure empty;
-            auto result = Add(make_unique<NewInstance>(cls), make_unique<StringConst>("world"s))
-                .Execute(empty, context);
+            ObjectHolder result = Run<Mode>(Add(make_unique<NewInstance>(cls), make_unique<StringConst>("world"s)),
+                empty, context);
             ASSERT_OBJECT_VALUE_EQUAL(result, "hello, world"s);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestClassInstanceAddWithoutMethod()
         {
             runtime::DummyContext context;
@@ -299,11 +347,12 @@ namespace ast
 
             Closure empty;
             Add addition(make_unique<NewInstance>(cls), make_unique<StringConst>("world"s));
-            ASSERT_THROWS(addition.Execute(empty, context), runtime_error);
+            ASSERT_THROWS(Run<Mode>(addition, empty, context), runtime_error);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestCompound()
         {
             runtime::DummyContext context;
@@ -316,7 +365,7 @@ namespace ast
             };
 
             Closure closure;
-            auto result = cpd.Execute(closure, context);
+            ObjectHolder result = Run<Mode>(cpd, closure, context);
 
             ASSERT_OBJECT_VALUE_EQUAL(closure.at("x"s), "one"s);
             ASSERT_OBJECT_VALUE_EQUAL(closure.at("y"s), 2);
@@ -324,9 +373,10 @@ namespace ast
 
             ASSERT(!result);
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
+        template <ExecutionMode Mode>
         void TestFields()
         {
             runtime::DummyContext context;
@@ -348,6 +398,7 @@ namespace ast
                                       make_unique<VariableValue>("x"s)))} });
 
             runtime::Class cls("BoxedValue"s, move(methods), nullptr);
+            PrepareClass<Mode>(cls);
             runtime::ClassInstance inst(cls);
 
             inst.Call("__init__"s, {}, context);
@@ -362,7 +413,7 @@ namespace ast
                 inst.Call("add"s, { ObjectHolder::Own(runtime::Number(i)) }, context);
             }
 
-            ASSERT(context.output.str().empty());
+            ASSERT(context.output.View().empty());
         }
 
         void TestBaseClass()
@@ -430,6 +481,79 @@ namespace ast
             ASSERT(!cls.GetMethod("AsStringValue"s));
         }
 
+        template <ExecutionMode Mode>
+        void TestReturn()
+        {
+            runtime::DummyContext context;
+            Closure closure;
+
+            // if True: print 1; return 2  /  print 3
+            auto if_body = make_unique<Compound>(
+                make_unique<Print>(make_unique<NumericConst>(1)),
+                make_unique<Return>(make_unique<NumericConst>(2)));
+            MethodBody body(make_unique<Compound>(
+                make_unique<IfElse>(make_unique<BoolConst>(true), move(if_body), nullptr),
+                make_unique<Print>(make_unique<NumericConst>(3))));
+
+            ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(body, closure, context), 2);
+            ASSERT(!context.IsReturning());
+            ASSERT_EQUAL(context.output.View(), "1\n"s);
+
+            // Тело без return возвращает None
+            MethodBody no_return(make_unique<Compound>(make_unique<Print>(make_unique<NumericConst>(4))));
+            ASSERT(!Run<Mode>(no_return, closure, context));
+            ASSERT(!context.IsReturning());
+            ASSERT_EQUAL(context.output.View(), "1\n4\n"s);
+        }
+
+        template <ExecutionMode Mode>
+        void TestMethodCallCache()
+        {
+            runtime::DummyContext context;
+
+            // Классов больше, чем умещается в кеше одного узла
+            const int class_count = static_cast<int>(MethodCall::CACHE_SIZE) + 2;
+            vector<unique_ptr<runtime::Class>> classes;
+            for (int i = 0; i < class_count; ++i)
+            {
+                vector<runtime::Method> methods;
+                methods.push_back({ "get"s, {}, make_unique<NumericConst>(i) });
+                classes.push_back(make_unique<runtime::Class>("Class"s + to_string(i), move(methods), nullptr));
+                PrepareClass<Mode>(*classes.back());
+            }
+
+            MethodCall call(make_unique<VariableValue>("x"s), "get"s, {});
+#ifdef MYTHON_STATS
+            MethodCall::ResetCacheStats();
+#endif
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (int i = 0; i < class_count; ++i)
+                {
+                    Closure closure{ {"x"s, ObjectHolder::Own(runtime::ClassInstance{*classes[i]})} };
+                    ASSERT_OBJECT_VALUE_EQUAL(Run<Mode>(call, closure, context), i);
+                }
+            }
+
+#ifdef MYTHON_STATS
+            const auto& stats = MethodCall::GetCacheStats();
+            ASSERT_EQUAL(stats.hits, MethodCall::CACHE_SIZE);
+            ASSERT_EQUAL(stats.misses, static_cast<size_t>(class_count) + 2);
+#endif
+
+            MethodCall on_number(make_unique<VariableValue>("x"s), "get"s, {});
+            vector<unique_ptr<Statement>> args;
+            args.push_back(make_unique<NumericConst>(1));
+            MethodCall extra_arg(make_unique<VariableValue>("x"s), "get"s, move(args));
+            Closure closure{ {"x"s, ObjectHolder::Own(runtime::ClassInstance{*classes[0]})} };
+            ASSERT_THROWS(Run<Mode>(extra_arg, closure, context), runtime_error);
+            ASSERT_THROWS(Run<Mode>(extra_arg, closure, context), runtime_error);
+
+            closure["x"s] = ObjectHolder::Own(runtime::Number(1));
+            ASSERT_THROWS(Run<Mode>(on_number, closure, context), runtime_error);
+        }
+
+        template <ExecutionMode Mode>
         void TestOr()
         {
             auto test_or = [](bool lhs, bool rhs)
@@ -437,7 +561,7 @@ namespace ast
                 Or or_statement{ make_unique<BoolConst>(lhs), make_unique<BoolConst>(rhs) };
                 Closure closure;
                 runtime::DummyContext context;
-                ASSERT_EQUAL(runtime::Equal(or_statement.Execute(closure, context),
+                ASSERT_EQUAL(runtime::Equal(Run<Mode>(or_statement, closure, context),
                     ObjectHolder::Own(runtime::Bool(true)), context),
                     lhs || rhs);
             };
@@ -448,6 +572,7 @@ namespace ast
             test_or(false, false);
         }
 
+        template <ExecutionMode Mode>
         void TestAnd()
         {
             auto test_and = [](bool lhs, bool rhs)
@@ -455,7 +580,7 @@ namespace ast
                 And and_statement{ make_unique<BoolConst>(lhs), make_unique<BoolConst>(rhs) };
                 Closure closure;
                 runtime::DummyContext context;
-                ASSERT_EQUAL(runtime::Equal(and_statement.Execute(closure, context),
+                ASSERT_EQUAL(runtime::Equal(Run<Mode>(and_statement, closure, context),
                     ObjectHolder::Own(runtime::Bool(true)), context),
                     lhs && rhs);
             };
@@ -466,6 +591,7 @@ namespace ast
             test_and(false, false);
         }
 
+        template <ExecutionMode Mode>
         void TestNot()
         {
             auto test_not = [](bool arg)
@@ -473,7 +599,7 @@ namespace ast
                 Not not_statement{ make_unique<BoolConst>(arg) };
                 Closure closure;
                 runtime::DummyContext context;
-                ASSERT_EQUAL(runtime::Equal(not_statement.Execute(closure, context),
+                ASSERT_EQUAL(runtime::Equal(Run<Mode>(not_statement, closure, context),
                     ObjectHolder::Own(runtime::Bool(true)), context),
                     !arg);
             };
@@ -482,30 +608,194 @@ namespace ast
             test_not(false);
         }
 
+        void TestQuickening()
+        {
+            using Specialization = SpecializingOperation::Specialization;
+            runtime::DummyContext context;
+#ifdef MYTHON_STATS
+            SpecializingOperation::ResetQuickeningStats();
+#endif
+            // Счётчики специализаций ведутся только в сборке с макросом MYTHON_STATS
+            auto assert_stats = []([[maybe_unused]] size_t specializations,
+                [[maybe_unused]] size_t deoptimizations)
+            {
+#ifdef MYTHON_STATS
+                const auto& stats = SpecializingOperation::GetQuickeningStats();
+                ASSERT_EQUAL(stats.specializations, specializations);
+                ASSERT_EQUAL(stats.deoptimizations, deoptimizations);
+#endif
+            };
+
+            Closure closure;
+            Add sum(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+            ASSERT(sum.GetSpecialization() == Specialization::NONE);
+
+            // Числа
+            closure["x"s] = ObjectHolder::Own(runtime::Number(2));
+            closure["y"s] = ObjectHolder::Own(runtime::Number(3));
+            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+            ASSERT(sum.GetSpecialization() == Specialization::NUMBERS);
+            assert_stats(1, 0);
+
+            // Строки в узле, специализированном под числа, переводят его на общую ветку
+            closure["x"s] = ObjectHolder::Own(runtime::String("2"s));
+            closure["y"s] = ObjectHolder::Own(runtime::String("3"s));
+            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "23"s);
+            ASSERT(sum.GetSpecialization() == Specialization::GENERIC);
+            assert_stats(1, 1);
+
+            closure["x"s] = ObjectHolder::Own(runtime::Number(2));
+            closure["y"s] = ObjectHolder::Own(runtime::Number(3));
+            ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+            assert_stats(1, 1);
+
+            // Вызов __add__ специализируется под класс lhs
+            vector<runtime::Method> methods;
+            methods.push_back({ "__add__"s, {"rhs"s}, make_unique<VariableValue>("rhs"s) });
+            runtime::Class cls("Adder"s, move(methods), nullptr);
+            runtime::ClassInstance instance(cls);
+            runtime::Class other_cls("Other"s, {}, nullptr);
+            runtime::ClassInstance other(other_cls);
+
+            Add method_sum(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+            closure["x"s] = ObjectHolder::Share(instance);
+            ASSERT_OBJECT_VALUE_EQUAL(method_sum.Execute(closure, context), 3);
+            ASSERT(method_sum.GetSpecialization() == Specialization::METHOD);
+            assert_stats(2, 1);
+
+            closure["x"s] = ObjectHolder::Share(other);
+            ASSERT_THROWS(method_sum.Execute(closure, context), runtime_error);
+            ASSERT(method_sum.GetSpecialization() == Specialization::GENERIC);
+            assert_stats(2, 2);
+
+            // Сравнение строк
+            Less less(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+            closure["x"s] = ObjectHolder::Own(runtime::String("a"s));
+            closure["y"s] = ObjectHolder::Own(runtime::String("b"s));
+            ASSERT(runtime::IsTrue(less.Execute(closure, context)));
+            ASSERT(less.GetSpecialization() == Specialization::STRINGS);
+
+            closure["x"s] = ObjectHolder::Own(runtime::Number(1));
+            closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+            ASSERT(runtime::IsTrue(less.Execute(closure, context)));
+            ASSERT(less.GetSpecialization() == Specialization::GENERIC);
+            assert_stats(3, 3);
+
+            // Деление специализируется под числа, но по-прежнему проверяет делитель
+            Div div(make_unique<NumericConst>(1), make_unique<VariableValue>("y"s));
+            ASSERT_OBJECT_VALUE_EQUAL(div.Execute(closure, context), 0);
+            closure["y"s] = ObjectHolder::Own(runtime::Number(0));
+            ASSERT_THROWS(div.Execute(closure, context), runtime_error);
+            ASSERT(div.GetSpecialization() == Specialization::NUMBERS);
+
+            // Вычитание выполняется специализированной веткой, пока операнды - числа
+            Sub difference(make_unique<VariableValue>("x"s), make_unique<NumericConst>(1));
+            ASSERT_OBJECT_VALUE_EQUAL(difference.Execute(closure, context), 0);
+            ASSERT(difference.GetSpecialization() == Specialization::NUMBERS);
+            closure["x"s] = ObjectHolder::Own(runtime::String("a"s));
+            ASSERT_THROWS(difference.Execute(closure, context), runtime_error);
+            ASSERT(difference.GetSpecialization() == Specialization::GENERIC);
+        }
+
+        template <ExecutionMode Mode>
+        void TestComparisonNodes()
+        {
+            runtime::DummyContext context;
+            Closure empty;
+
+            // Вычисляет узел сравнения и возвращает его результат
+            auto compare = [&](auto node) -> bool
+            {
+                return Run<Mode>(node, empty, context).template TryAs<runtime::Bool>()->GetValue();
+            };
+            auto num = [](int value)
+            {
+                return make_unique<NumericConst>(value);
+            };
+            auto str = [](string value)
+            {
+                return make_unique<StringConst>(move(value));
+            };
+
+            ASSERT(compare(Less(num(1), num(2))));
+            ASSERT(!compare(Less(num(2), num(2))));
+            ASSERT(compare(Greater(num(3), num(2))));
+            ASSERT(compare(Equal(num(2), num(2))));
+            ASSERT(compare(NotEqual(num(2), num(3))));
+            ASSERT(compare(LessOrEqual(num(2), num(2))));
+            ASSERT(!compare(GreaterOrEqual(num(1), num(2))));
+
+            ASSERT(compare(Less(str("abc"s), str("abd"s))));
+            ASSERT(compare(Greater(str("b"s), str("abc"s))));
+            ASSERT(compare(Equal(str("abc"s), str("abc"s))));
+            ASSERT(!compare(Equal(str("abc"s), str("ab"s))));
+            ASSERT(compare(NotEqual(str("abc"s), str("ab"s))));
+            ASSERT(compare(LessOrEqual(str("ab"s), str("abc"s))));
+            ASSERT(compare(GreaterOrEqual(str("abc"s), str("abc"s))));
+
+            // Остальные значения сравниваются функциями runtime
+            ASSERT(compare(Less(make_unique<BoolConst>(false), make_unique<BoolConst>(true))));
+            ASSERT(compare(Equal(make_unique<None>(), make_unique<None>())));
+            try
+            {
+                compare(Less(num(1), str("1"s)));
+                ASSERT(false);
+            }
+            catch (const runtime_error&)
+            {
+            }
+        }
+
     }  // namespace
 
     void RunUnitTests(TestRunner& tr)
     {
-        RUN_TEST(tr, ast::TestNumericConst);
-        RUN_TEST(tr, ast::TestStringConst);
-        RUN_TEST(tr, ast::TestVariable);
-        RUN_TEST(tr, ast::TestAssignment);
-        RUN_TEST(tr, ast::TestFieldAssignment);
-        RUN_TEST(tr, ast::TestPrintVariable);
-        RUN_TEST(tr, ast::TestPrintMultipleStatements);
-        RUN_TEST(tr, ast::TestStringify);
-        RUN_TEST(tr, ast::TestNumbersAddition);
-        RUN_TEST(tr, ast::TestStringsAddition);
-        RUN_TEST(tr, ast::TestBadAddition);
-        RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
-        RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
-        RUN_TEST(tr, ast::TestCompound);
-        RUN_TEST(tr, ast::TestFields);
+        RUN_TEST(tr, ast::TestNumericConst<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestNumericConst<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestStringConst<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestStringConst<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestVariable<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestVariable<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestAssignment<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestAssignment<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestFieldAssignment<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestFieldAssignment<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestPrintVariable<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestPrintVariable<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestPrintMultipleStatements<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestPrintMultipleStatements<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestStringify<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestStringify<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestNumbersAddition<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestNumbersAddition<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestStringsAddition<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestStringsAddition<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestBadAddition<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestBadAddition<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestCompound<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestCompound<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestFields<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestFields<ExecutionMode::BYTECODE>);
         RUN_TEST(tr, ast::TestBaseClass);
         RUN_TEST(tr, ast::TestInheritance);
-        RUN_TEST(tr, ast::TestOr);
-        RUN_TEST(tr, ast::TestAnd);
-        RUN_TEST(tr, ast::TestNot);
+        RUN_TEST(tr, ast::TestMethodCallCache<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestMethodCallCache<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestReturn<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestReturn<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestOr<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestOr<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestAnd<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestAnd<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestNot<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestNot<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestComparisonNodes<ExecutionMode::TREE>);
+        RUN_TEST(tr, ast::TestComparisonNodes<ExecutionMode::BYTECODE>);
+        RUN_TEST(tr, ast::TestQuickening);
     }
 
 }  // namespace ast
\ No newline at end of file
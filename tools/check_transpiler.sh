@@ -0,0 +1,92 @@
+#!/bin/bash
+#
+# Сверяет транслятор с интерпретатором на программах Mython из тестов репозитория.
+# Каждая строка R"(...)" из файлов ниже выполняется интерпретатором mython и переводится
+# в C++ (mython --emit-cpp). Полученный код собирается с объектными файлами среды выполнения,
+# а вывод, поток ошибок и код возврата программы сравниваются с результатами интерпретатора.
+#
+# Использование: tools/check_transpiler.sh [каталог сборки]
+# Компилятор и флаги задаются переменными CXX и CXXFLAGS.
+
+set -u
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-$(mktemp -d)}
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2"}
+SOURCES="parse_test.cpp main.cpp bytecode_test.cpp optimizer_test.cpp transpiler_test.cpp"
+
+mkdir -p "$BUILD/obj" "$BUILD/programs"
+
+# Интерпретатор и объектные файлы среды выполнения (все, кроме main.cpp и тестов)
+for source in "$ROOT"/*.cpp; do
+    $CXX $CXXFLAGS -I"$ROOT" -c "$source" -o "$BUILD/obj/$(basename "$source" .cpp).o" &
+done
+wait
+RUNTIME_OBJECTS=$(ls "$BUILD"/obj/*.o | grep -v -e '/main\.o$' -e '_test')
+$CXX "$BUILD"/obj/*.o -o "$BUILD/mython" || exit 1
+
+# Извлекает строки R"(...)" файла $1 в файлы $BUILD/programs/<файл>_<номер>.my
+extract_programs() {
+    perl -e '
+        my $prefix = shift;
+        local $/;
+        my $text = <STDIN>;
+        my $n = 0;
+        while ($text =~ /R"\((.*?)\)"/sg) {
+            open(my $out, ">", sprintf("%s_%02d.my", $prefix, $n++)) or die;
+            print $out $1;
+        }
+    ' "$BUILD/programs/$(basename "$1" .cpp)" < "$1"
+}
+
+for source in $SOURCES; do
+    extract_programs "$ROOT/$source"
+done
+
+# Строки вида "<тест> OK" интерпретатор выводит в поток ошибок при самопроверке
+strip_self_tests() {
+    grep -v ' OK$' "$1" > "$1.stripped"
+}
+
+failed=0
+total=0
+for program in "$BUILD"/programs/*.my; do
+    name=$(basename "$program" .my)
+    total=$((total + 1))
+
+    "$BUILD/mython" < "$program" > "$BUILD/$name.expected.out" 2> "$BUILD/$name.expected.err"
+    expected_code=$?
+    strip_self_tests "$BUILD/$name.expected.err"
+
+    if ! "$BUILD/mython" --emit-cpp < "$program" > "$BUILD/$name.cpp" 2> "$BUILD/$name.emit.err"; then
+        echo "$name: translation failed"
+        grep -v ' OK$' "$BUILD/$name.emit.err"
+        failed=$((failed + 1))
+        continue
+    fi
+    if ! $CXX $CXXFLAGS -I"$ROOT" "$BUILD/$name.cpp" $RUNTIME_OBJECTS -o "$BUILD/$name" 2> "$BUILD/$name.build.err"; then
+        echo "$name: generated code does not compile"
+        head -20 "$BUILD/$name.build.err"
+        failed=$((failed + 1))
+        continue
+    fi
+
+    "$BUILD/$name" > "$BUILD/$name.actual.out" 2> "$BUILD/$name.actual.err"
+    actual_code=$?
+    strip_self_tests "$BUILD/$name.actual.err"
+
+    if [ "$expected_code" != "$actual_code" ]; then
+        echo "$name: exit code $actual_code, interpreter returned $expected_code"
+        failed=$((failed + 1))
+    elif ! diff "$BUILD/$name.expected.out" "$BUILD/$name.actual.out" > /dev/null \
+        || ! diff "$BUILD/$name.expected.err.stripped" "$BUILD/$name.actual.err.stripped" > /dev/null; then
+        echo "$name: output differs from the interpreter"
+        diff "$BUILD/$name.expected.out" "$BUILD/$name.actual.out" | head -10
+        diff "$BUILD/$name.expected.err.stripped" "$BUILD/$name.actual.err.stripped" | head -10
+        failed=$((failed + 1))
+    fi
+done
+
+echo "$((total - failed)) of $total programs match the interpreter"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,223 @@
+#include "transpiled.h"
+
+#include "output.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace transpiled
+{
+
+    namespace
+    {
+        // Возвращает метод method с argument_count параметрами класса cls, запоминая его в cache
+        const runtime::Method& FindMethod(const runtime::Class& cls, runtime::Symbol method, size_t argument_count,
+            CallCache& cache)
+        {
+            if (cache.cls == &cls)
+                return *cache.method;
+
+            const runtime::Method* found = cls.GetMethod(method, argument_count);
+            if (found == nullptr)
+            {
+                throw runtime_error("MethodCall::Execute: No method "s + method.GetName()
+                    + " with passed parameters"s);
+            }
+            cache = { &cls, found };
+            return *found;
+        }
+
+        // Возвращает номер ячейки поля field объекта с полями fields, запоминая его в cache
+        size_t FindSlot(const runtime::InstanceFields& fields, runtime::Symbol field, ast::FieldCache& cache)
+        {
+            if (cache.shape_id != fields.GetShape().GetId())
+            {
+                const size_t slot = fields.GetShape().FindField(field);
+                if (slot == runtime::Shape::NO_FIELD)
+                    throw runtime_error("VariableValue::Execute: There is no field "s + field.GetName());
+                cache = { fields.GetShape().GetId(), slot };
+            }
+            return cache.slot;
+        }
+    }  // namespace
+
+
+
+    ObjectHolder MakeClass(string_view name, vector<runtime::Method> methods, const ObjectHolder* parent)
+    {
+        return ObjectHolder::Own(runtime::Class(string(name), move(methods),
+            parent != nullptr ? parent->TryAs<runtime::Class>() : nullptr));
+    }
+
+
+    ObjectHolder NewInstance(const ObjectHolder& cls)
+    {
+        return ObjectHolder::Own(runtime::ClassInstance{ *cls.TryAs<runtime::Class>() });
+    }
+
+
+
+    void CheckObject(const ObjectHolder& object)
+    {
+        if (object.TryAs<runtime::ClassInstance>() == nullptr)
+            throw runtime_error("MethodCall::Execute: Method call on non-object"s);
+    }
+
+
+    ObjectHolder CallMethod(Context& context, const ObjectHolder& object, runtime::Symbol method,
+        const vector<ObjectHolder>& args, CallCache& cache)
+    {
+        runtime::ClassInstance& instance = *object.TryAs<runtime::ClassInstance>();
+        return instance.Call(FindMethod(instance.GetClass(), method, args.size(), cache), args, context);
+    }
+
+
+    ObjectHolder DeferCall(Context& context, const ObjectHolder& object, runtime::Symbol method,
+        vector<ObjectHolder> args, CallCache& cache)
+    {
+        runtime::ClassInstance& instance = *object.TryAs<runtime::ClassInstance>();
+        const runtime::Method& called = FindMethod(instance.GetClass(), method, args.size(), cache);
+
+        runtime::TailCall* tail_call = context.GetTailCall();
+        if (tail_call == nullptr
+            || !runtime::CanReplaceCall(tail_call->self, object, args.data(), args.data() + args.size()))
+            return instance.Call(called, args, context);
+
+        tail_call->object = object;
+        tail_call->method = &called;
+        tail_call->args = move(args);
+        return ObjectHolder::None();
+    }
+
+
+
+    void ThrowUndefinedVariable()
+    {
+        throw runtime_error("VariableValue::Execute: There is no value with the given name"s);
+    }
+
+
+    ObjectHolder ReadFieldSlow(const ObjectHolder& object, runtime::Symbol object_name, runtime::Symbol field,
+        ast::FieldCache& cache)
+    {
+        const auto* instance = object.TryAs<runtime::ClassInstance>();
+        if (instance == nullptr)
+            throw runtime_error("VariableValue::Execute: "s + object_name.GetName() + " is not a class instance"s);
+
+        const runtime::InstanceFields& fields = instance->Fields();
+        return fields.GetSlot(FindSlot(fields, field, cache));
+    }
+
+
+    void CheckFieldObject(const ObjectHolder& object)
+    {
+        if (object.TryAs<runtime::ClassInstance>() == nullptr)
+            throw runtime_error("FieldAssignment::Execute: Assignment to a field of non-object"s);
+    }
+
+
+    void AssignField(const ObjectHolder& object, runtime::Symbol field, ObjectHolder value, FieldStoreCache& cache)
+    {
+        CheckFieldObject(object);
+
+        // Форму проверяем после вычисления значения: оно могло добавить объекту поля
+        runtime::InstanceFields& fields = object.TryAs<runtime::ClassInstance>()->Fields();
+        if (cache.cache.shape_id == fields.GetShape().GetId())
+        {
+            fields.ExtendTo(*cache.new_shape);
+        }
+        else
+        {
+            cache.cache.shape_id = fields.GetShape().GetId();
+            cache.cache.slot = fields.Define(field);
+            cache.new_shape = &fields.GetShape();
+        }
+        fields.GetSlot(cache.cache.slot) = move(value);
+    }
+
+
+    void FindField(const ObjectHolder& object, runtime::Symbol field, ast::FieldCache& cache)
+    {
+        CheckFieldObject(object);
+        FindSlot(object.TryAs<runtime::ClassInstance>()->Fields(), field, cache);
+    }
+
+
+    void UpdateField(Context& context, const ObjectHolder& object, runtime::Symbol field,
+        ast::ArithmeticOperator op, const ObjectHolder& operand, ast::FieldCache& cache)
+    {
+        runtime::InstanceFields& fields = object.TryAs<runtime::ClassInstance>()->Fields();
+        const ObjectHolder current = fields.GetSlot(FindSlot(fields, field, cache));
+        ObjectHolder result = Apply(op, current, operand, context);
+        // Метод __add__ может добавить объекту поля, поэтому ячейка находится заново
+        fields.GetSlot(FindSlot(fields, field, cache)) = move(result);
+    }
+
+
+
+    PrintLine::~PrintLine()
+    {
+        if (ended_)
+            return;
+
+        // Начало строки выводится и при ошибке. Ошибка вывода не заменяет исходную
+        try
+        {
+            buffer_.WriteTo(context_.GetOutput());
+        }
+        catch (...)
+        {
+        }
+    }
+
+
+    void PrintLine::Append(const ObjectHolder& value)
+    {
+        if (!buffer_.TryAppend(value))
+        {
+            buffer_.WriteTo(context_.GetOutput());
+            value->Print(context_.GetOutputStream(), context_);
+        }
+    }
+
+
+    void PrintLine::End()
+    {
+        buffer_.Append('\n');
+        ended_ = true;
+        buffer_.WriteTo(context_.GetOutput());
+    }
+
+
+
+    int Run(int argc, char* argv[], ClassesFunction define_classes, ProgramFunction program)
+    {
+        try
+        {
+            runtime::FlushPolicy flush = runtime::FlushPolicy::THRESHOLD;
+            for (int i = 1; i < argc; ++i)
+            {
+                const string_view arg = argv[i];
+                if (arg == "--flush=line"sv)
+                    flush = runtime::FlushPolicy::PER_LINE;
+                else if (arg == "--flush=exit"sv)
+                    flush = runtime::FlushPolicy::AT_EXIT;
+            }
+
+            define_classes();
+
+            runtime::FdSink stdout_sink(1);
+            runtime::BufferedSink output(stdout_sink, flush);
+            runtime::SinkContext context(output);
+            program(context);
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+}  // namespace transpiled
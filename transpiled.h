@@ -0,0 +1,294 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Поддержка выполнения программ, полученных транслятором Mython в C++ (см. transpiler.h).
+ * Сгенерированный код хранит значения в runtime::ObjectHolder и выполняет операции функциями
+ * этого файла. Они повторяют поведение узлов дерева, в том числе тексты ошибок, а для чисел
+ * обходятся без вызова общих функций
+ */
+namespace transpiled
+{
+
+    using runtime::Context;
+    using runtime::ObjectHolder;
+
+    // Функция C++, в которую переведён метод. Получает self и аргументы вызова (все - ObjectHolder)
+    template <typename... Params>
+    using MethodFunction = ObjectHolder (*)(Context& context, ObjectHolder self, Params... params);
+
+
+    // Тело метода, которое выполняет функция C++. Метод, вызванный через runtime
+    // (например, ClassInstance::Call или print), получает self и аргументы из кадра вызова
+    template <typename... Params>
+    class FunctionBody : public runtime::Executable
+    {
+    public:
+        explicit FunctionBody(MethodFunction<Params...> function)
+            : function_(function)
+        {
+        }
+
+        ObjectHolder Execute(runtime::Closure& /*closure*/, Context& context) override
+        {
+            return Call(context, std::index_sequence_for<Params...>{});
+        }
+
+    private:
+        template <size_t... Indices>
+        ObjectHolder Call(Context& context, std::index_sequence<Indices...> /*indices*/)
+        {
+            // Значения копируются до вызова: вложенные вызовы могут переместить кадры стека
+            runtime::ValueStack& stack = context.GetValueStack();
+            return function_(context, stack.Local(0), ObjectHolder(stack.Local(Indices + 1))...);
+        }
+
+        MethodFunction<Params...> function_;
+    };
+
+
+    // Создаёт метод name с параметрами formal_params, тело которого выполняет функция function
+    template <typename... Params>
+    runtime::Method MakeMethod(runtime::Symbol name, std::vector<runtime::Symbol> formal_params,
+        MethodFunction<Params...> function)
+    {
+        runtime::Method method;
+        method.name = name;
+        method.formal_params = std::move(formal_params);
+        method.body = std::make_unique<FunctionBody<Params...>>(function);
+        method.frame_size = sizeof...(Params) + 1;
+        return method;
+    }
+
+    // Создаёт класс name с методами methods, унаследованный от parent (nullptr для базового класса)
+    ObjectHolder MakeClass(std::string_view name, std::vector<runtime::Method> methods, const ObjectHolder* parent);
+
+    // Создаёт экземпляр класса cls без вызова __init__
+    ObjectHolder NewInstance(const ObjectHolder& cls);
+
+
+    // Вызывает у экземпляра класса self метод, переведённый в функцию function, так же,
+    // как ClassInstance::Call: с учётом глубины рекурсии и отложенных вызовов (см. runtime::MethodCallScope)
+    template <typename... Params, typename... Args>
+    ObjectHolder Invoke(Context& context, MethodFunction<Params...> function, const ObjectHolder& self,
+        Args&&... args)
+    {
+        runtime::MethodCallScope scope(context, *self.TryAs<runtime::ClassInstance>());
+        ObjectHolder result = function(context, self, std::forward<Args>(args)...);
+        scope.Finish(result);
+        return result;
+    }
+
+
+    // Встроенный кеш вызова метода: у объектов класса cls вызывается метод method
+    struct CallCache
+    {
+        const runtime::Class* cls = nullptr;
+        const runtime::Method* method = nullptr;
+    };
+
+    // Встроенный кеш присваивания полю (см. ast::FieldAssignment): объект с формой из cache
+    // получает форму new_shape
+    struct FieldStoreCache
+    {
+        ast::FieldCache cache;
+        const runtime::Shape* new_shape = nullptr;
+    };
+
+    // Выбрасывает runtime_error, если object - не экземпляр класса, у которого вызывается метод
+    void CheckObject(const ObjectHolder& object);
+
+    // Вызывает метод method у экземпляра класса object, проверенного CheckObject
+    ObjectHolder CallMethod(Context& context, const ObjectHolder& object, runtime::Symbol method,
+        const std::vector<ObjectHolder>& args, CallCache& cache);
+
+    // Выполняет вызов метода в инструкции return: откладывает его, если он может заменить
+    // выполняемый метод (см. ast::MethodCall::Defer), и возвращает None. Иначе вызывает метод сразу
+    ObjectHolder DeferCall(Context& context, const ObjectHolder& object, runtime::Symbol method,
+        std::vector<ObjectHolder> args, CallCache& cache);
+
+
+    [[noreturn]] void ThrowUndefinedVariable();
+
+    // Возвращает значение переменной. Если ей ещё не присвоено значение, выбрасывает runtime_error
+    inline const ObjectHolder& Read(const std::optional<ObjectHolder>& variable)
+    {
+        if (!variable)
+            ThrowUndefinedVariable();
+        return *variable;
+    }
+
+    ObjectHolder ReadFieldSlow(const ObjectHolder& object, runtime::Symbol object_name, runtime::Symbol field,
+        ast::FieldCache& cache);
+
+    // Возвращает значение поля field объекта object, полученного по имени object_name
+    // цепочки object_name.field
+    inline ObjectHolder ReadField(const ObjectHolder& object, runtime::Symbol object_name, runtime::Symbol field,
+        ast::FieldCache& cache)
+    {
+        if (const auto* instance = object.TryAs<runtime::ClassInstance>())
+        {
+            const runtime::InstanceFields& fields = instance->Fields();
+            if (cache.shape_id == fields.GetShape().GetId())
+                return fields.GetSlot(cache.slot);
+        }
+        return ReadFieldSlow(object, object_name, field, cache);
+    }
+
+    // Выбрасывает runtime_error, если object - не экземпляр класса, полю которого выполняется присваивание
+    void CheckFieldObject(const ObjectHolder& object);
+    // Присваивает полю field объекта object значение value
+    void AssignField(const ObjectHolder& object, runtime::Symbol field, ObjectHolder value, FieldStoreCache& cache);
+
+    // Проверяет, что у объекта object есть поле field, которое изменяет UpdateField
+    void FindField(const ObjectHolder& object, runtime::Symbol field, ast::FieldCache& cache);
+    // Выполняет присваивание object.field = object.field op operand (см. ast::FieldUpdate)
+    void UpdateField(Context& context, const ObjectHolder& object, runtime::Symbol field,
+        ast::ArithmeticOperator op, const ObjectHolder& operand, ast::FieldCache& cache);
+
+
+    inline ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+    {
+        const auto* l = lhs.TryAs<runtime::Number>();
+        const auto* r = rhs.TryAs<runtime::Number>();
+        if (l != nullptr && r != nullptr)
+            return ObjectHolder::Own(runtime::Number(l->GetValue() + r->GetValue()));
+        return ast::Add::Apply(lhs, rhs, context);
+    }
+
+    inline ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /*context*/)
+    {
+        const auto* l = lhs.TryAs<runtime::Number>();
+        const auto* r = rhs.TryAs<runtime::Number>();
+        if (l != nullptr && r != nullptr)
+            return ObjectHolder::Own(runtime::Number(l->GetValue() - r->GetValue()));
+        return ast::Sub::Apply(lhs, rhs);
+    }
+
+    inline ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /*context*/)
+    {
+        const auto* l = lhs.TryAs<runtime::Number>();
+        const auto* r = rhs.TryAs<runtime::Number>();
+        if (l != nullptr && r != nullptr)
+            return ObjectHolder::Own(runtime::Number(l->GetValue() * r->GetValue()));
+        return ast::Mult::Apply(lhs, rhs);
+    }
+
+    inline ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /*context*/)
+    {
+        const auto* l = lhs.TryAs<runtime::Number>();
+        const auto* r = rhs.TryAs<runtime::Number>();
+        if (l != nullptr && r != nullptr && r->GetValue() != 0)
+            return ObjectHolder::Own(runtime::Number(l->GetValue() / r->GetValue()));
+        return ast::Div::Apply(lhs, rhs);
+    }
+
+    // Вычисляет lhs op rhs так же, как узлы Add, Sub, Mult и Div
+    inline ObjectHolder Apply(ast::ArithmeticOperator op, const ObjectHolder& lhs, const ObjectHolder& rhs,
+        Context& context)
+    {
+        switch (op)
+        {
+        case ast::ArithmeticOperator::ADD:
+            return Add(lhs, rhs, context);
+        case ast::ArithmeticOperator::SUB:
+            return Sub(lhs, rhs, context);
+        case ast::ArithmeticOperator::MULT:
+            return Mult(lhs, rhs, context);
+        default:
+            return Div(lhs, rhs, context);
+        }
+    }
+
+    // Сравнивает lhs и rhs оператором Op так же, как узел ast::ComparisonOf<Op>
+    template <ast::ComparisonOperator Op>
+    ObjectHolder Compare(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context)
+    {
+        using ast::ComparisonOperator;
+
+        const auto* l = lhs.TryAs<runtime::Number>();
+        const auto* r = rhs.TryAs<runtime::Number>();
+        if (l != nullptr && r != nullptr)
+        {
+            const int a = l->GetValue();
+            const int b = r->GetValue();
+            if constexpr (Op == ComparisonOperator::LESS)
+                return ObjectHolder::FromBool(a < b);
+            else if constexpr (Op == ComparisonOperator::GREATER)
+                return ObjectHolder::FromBool(a > b);
+            else if constexpr (Op == ComparisonOperator::EQUAL)
+                return ObjectHolder::FromBool(a == b);
+            else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+                return ObjectHolder::FromBool(a != b);
+            else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+                return ObjectHolder::FromBool(a <= b);
+            else
+                return ObjectHolder::FromBool(a >= b);
+        }
+
+        if constexpr (Op == ComparisonOperator::LESS)
+            return ObjectHolder::FromBool(runtime::Less(lhs, rhs, context));
+        else if constexpr (Op == ComparisonOperator::GREATER)
+            return ObjectHolder::FromBool(runtime::Greater(lhs, rhs, context));
+        else if constexpr (Op == ComparisonOperator::EQUAL)
+            return ObjectHolder::FromBool(runtime::Equal(lhs, rhs, context));
+        else if constexpr (Op == ComparisonOperator::NOT_EQUAL)
+            return ObjectHolder::FromBool(runtime::NotEqual(lhs, rhs, context));
+        else if constexpr (Op == ComparisonOperator::LESS_OR_EQUAL)
+            return ObjectHolder::FromBool(runtime::LessOrEqual(lhs, rhs, context));
+        else
+            return ObjectHolder::FromBool(runtime::GreaterOrEqual(lhs, rhs, context));
+    }
+
+
+    /*
+     * Строка вывода инструкции print. Собирается в буфере контекста, как у ast::Print.
+     * Если строка не завершена методом End (например, вычисление аргумента выбросило исключение),
+     * при разрушении выводится её начало
+     */
+    class PrintLine
+    {
+    public:
+        explicit PrintLine(Context& context)
+            : context_(context)
+            , buffer_(context.GetFormatBuffer())
+        {
+        }
+
+        ~PrintLine();
+
+        PrintLine(const PrintLine&) = delete;
+        PrintLine& operator=(const PrintLine&) = delete;
+
+        void Separator()
+        {
+            buffer_.Append(' ');
+        }
+
+        void Append(const ObjectHolder& value);
+        void End();
+
+    private:
+        Context& context_;
+        runtime::FormatBuffer& buffer_;
+        bool ended_ = false;
+    };
+
+
+    // Функции программы: создание классов и инструкции верхнего уровня
+    using ClassesFunction = void (*)();
+    using ProgramFunction = void (*)(Context& context);
+
+    // Выполняет программу так же, как интерпретатор mython: вывод передаётся в дескриптор
+    // стандартного вывода (аргумент --flush=line|size|exit задаёт, когда), а ошибка выводится в cerr.
+    // Возвращает код завершения процесса
+    int Run(int argc, char* argv[], ClassesFunction define_classes, ProgramFunction program);
+
+}  // namespace transpiled
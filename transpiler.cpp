@@ -0,0 +1,583 @@
+#include "transpiler.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace transpiler
+{
+
+    namespace
+    {
+        // Отступ одного уровня вложенности в генерируемом коде
+        constexpr string_view INDENT = "    "sv;
+
+        // Возвращает true, если класс cls - base либо его наследник
+        bool IsDerived(const runtime::Class& cls, const runtime::Class& base)
+        {
+            for (const runtime::Class* current = &cls; current != nullptr; current = current->GetParent())
+            {
+                if (current == &base)
+                    return true;
+            }
+            return false;
+        }
+
+        // Возвращает true, если в тексте text встречается идентификатор name
+        bool Mentions(string_view text, string_view name)
+        {
+            const auto is_identifier = [](char c) {
+                return isalnum(static_cast<unsigned char>(c)) || c == '_';
+            };
+            for (size_t pos = text.find(name); pos != string_view::npos; pos = text.find(name, pos + 1))
+            {
+                const size_t end = pos + name.size();
+                if ((pos == 0 || !is_identifier(text[pos - 1])) && (end == text.size() || !is_identifier(text[end])))
+                    return true;
+            }
+            return false;
+        }
+
+        // Возвращает аргументы через запятую
+        string Join(const vector<string>& args)
+        {
+            string result;
+            for (const string& arg : args)
+            {
+                if (!result.empty())
+                    result += ", "sv;
+                result += arg;
+            }
+            return result;
+        }
+
+        string Local(size_t slot)
+        {
+            return "local_"s + to_string(slot);
+        }
+
+        // Возвращает сигнатуру метода в Mython, например Point.move(dx, dy)
+        string Signature(const runtime::Class& cls, const runtime::Method& method)
+        {
+            vector<string> params;
+            for (runtime::Symbol param : method.formal_params)
+                params.push_back(param.GetName());
+            return cls.GetName() + '.' + method.name.GetName() + '(' + Join(params) + ')';
+        }
+    }  // namespace
+
+
+
+    void Emitter::EmitProgram(ast::Statement& program)
+    {
+        declarations_.clear();
+        symbols_.clear();
+        strings_.clear();
+        globals_.clear();
+        global_declarations_.clear();
+        cache_count_ = 0;
+        method_code_.clear();
+
+        BeginFunction(nullptr);
+        Emit(&program);
+        program_code_ = EndFunction("void Program(Context& context)"sv);
+
+        // Классы регистрируются по мере перевода, в том числе методов других классов
+        for (size_t i = 0; i < classes_.size(); ++i)
+        {
+            const vector<const runtime::Method*> methods = classes_[i].methods;
+            for (const runtime::Method* method : methods)
+                EmitMethod(methods_.at(method));
+        }
+    }
+
+
+    void Emitter::Write(ostream& out) const
+    {
+        vector<const MethodInfo*> methods(methods_.size());
+        for (const auto& [method, info] : methods_)
+            methods[info.index] = &info;
+
+        out << "// Программа на C++, полученная транслятором Mython (mython --emit-cpp).\n"
+               "// Собирается вместе с runtime интерпретатора (см. transpiled.h)\n"
+               "#include \"transpiled.h\"\n\n"
+               "namespace\n{\n\n"sv;
+        out << INDENT << "using runtime::Context;\n"sv
+            << INDENT << "using runtime::ObjectHolder;\n"sv
+            << INDENT << "using namespace std::literals;\n\n"sv;
+
+        for (const string& declaration : declarations_)
+            out << INDENT << declaration << '\n';
+        if (!declarations_.empty())
+            out << '\n';
+
+        for (size_t i = 0; i < classes_.size(); ++i)
+            out << INDENT << "ObjectHolder "sv << ClassName(i) << ";  // "sv << classes_[i].cls->GetName() << '\n';
+        out << '\n';
+
+        for (const MethodInfo* info : methods)
+        {
+            out << INDENT << "ObjectHolder "sv << info->name << "(Context& context"sv;
+            for (size_t i = 0; i <= info->method->formal_params.size(); ++i)
+                out << ", ObjectHolder "sv << Local(i);
+            out << ");\n"sv;
+        }
+        if (!methods.empty())
+            out << '\n';
+
+        for (const string& code : method_code_)
+            out << code << '\n';
+
+        out << INDENT << "void DefineClasses()\n"sv << INDENT << "{\n"sv;
+        for (size_t i = 0; i < classes_.size(); ++i)
+        {
+            const ClassInfo& info = classes_[i];
+            const string indent = string(INDENT) + string(INDENT);
+            out << indent << "{\n"sv;
+            out << indent << INDENT << "std::vector<runtime::Method> methods;\n"sv;
+            for (const runtime::Method* method : info.methods)
+            {
+                vector<string> params;
+                for (runtime::Symbol param : method->formal_params)
+                    params.push_back(Literal(param.GetName()) + "sv"s);
+                out << indent << INDENT << "methods.push_back(transpiled::MakeMethod("sv
+                    << Literal(method->name.GetName()) << "sv, { "sv << Join(params) << " }, &"sv
+                    << methods_.at(method).name << "));\n"sv;
+            }
+
+            const runtime::Class* parent = info.cls->GetParent();
+            out << indent << INDENT << ClassName(i) << " = transpiled::MakeClass("sv << Literal(info.cls->GetName())
+                << "sv, std::move(methods), "sv
+                << (parent != nullptr ? "&"s + ClassName(class_indices_.at(parent)) : "nullptr"s) << ");\n"sv;
+            out << indent << "}\n"sv;
+        }
+        out << INDENT << "}\n\n"sv;
+
+        out << program_code_;
+        out << "\n}  // namespace\n\n"
+               "int main(int argc, char* argv[])\n{\n"sv
+            << INDENT << "return transpiled::Run(argc, argv, DefineClasses, Program);\n}\n"sv;
+    }
+
+
+    Value Emitter::Emit(ast::Statement* node)
+    {
+        if (node == nullptr)
+            throw runtime_error("Emitter::Emit: Null pointer"s);
+        return node->Transpile(*this);
+    }
+
+
+    void Emitter::Line(string_view code)
+    {
+        function_.lines.push_back({ function_.indent, string(code) });
+    }
+
+
+    void Emitter::Open(string_view header)
+    {
+        if (!header.empty())
+            Line(header);
+        Line("{"sv);
+        ++function_.indent;
+    }
+
+
+    void Emitter::Close()
+    {
+        --function_.indent;
+        Line("}"sv);
+    }
+
+
+    string Emitter::Temp(string_view expression)
+    {
+        string name = Name("t"sv);
+        Line("const ObjectHolder "s + name + " = "s + string(expression) + ';');
+        return name;
+    }
+
+
+    string Emitter::Declare()
+    {
+        string name = Name("t"sv);
+        Line("ObjectHolder "s + name + ';');
+        return name;
+    }
+
+
+    string Emitter::Name(string_view prefix)
+    {
+        return string(prefix) + to_string(function_.name_count++);
+    }
+
+
+    string Emitter::Symbol(runtime::Symbol name)
+    {
+        auto [it, inserted] = symbols_.emplace(name, "symbol_"s + to_string(symbols_.size()));
+        if (inserted)
+            declarations_.push_back("const runtime::Symbol "s + it->second + "{ "s + Literal(name.GetName()) + "sv };"s);
+        return it->second;
+    }
+
+
+    string Emitter::String(string_view value)
+    {
+        auto [it, inserted] = strings_.emplace(value, "string_"s + to_string(strings_.size()));
+        if (inserted)
+        {
+            declarations_.push_back("const ObjectHolder "s + it->second + " = ObjectHolder::Own(runtime::String("s
+                + Literal(value) + "s));"s);
+        }
+        return it->second;
+    }
+
+
+    string Emitter::Cache(string_view type)
+    {
+        string name = "cache_"s + to_string(cache_count_++);
+        declarations_.push_back(string(type) + ' ' + name + ';');
+        return name;
+    }
+
+
+    Value Emitter::ReadVariable(runtime::Symbol name, optional<size_t> slot)
+    {
+        const string variable = Variable(name, slot);
+        Value value;
+        if (auto it = function_.knowledge.find(variable); it != function_.knowledge.end())
+        {
+            value.cls = it->second.cls;
+            value.exact = it->second.exact;
+        }
+
+        if (IsParameter(slot))
+        {
+            value.code = variable;
+            return value;
+        }
+
+        // Выражения не присваивают переменным, поэтому до конца выражения значение не меняется
+        value.code = Name("t"sv);
+        Line("const ObjectHolder& "s + value.code + " = transpiled::Read("s + variable + ");"s);
+        return value;
+    }
+
+
+    void Emitter::Assign(runtime::Symbol name, optional<size_t> slot, const Value& value)
+    {
+        const string variable = Variable(name, slot);
+        Line(variable + " = "s + value.code + ';');
+        Learn(variable, value);
+    }
+
+
+    void Emitter::DefineClass(const runtime::Class& cls, optional<size_t> slot)
+    {
+        const string holder = ClassName(RegisterClass(cls));
+        // Как и Closure::emplace, объявление не заменяет значение переменной, у параметров оно есть всегда
+        if (IsParameter(slot))
+            return;
+
+        const string variable = Variable(runtime::Symbol(cls.GetName()), slot);
+        Open("if (!"s + variable + ')');
+        Line(variable + " = "s + holder + ';');
+        Close();
+        Learn(variable, {});
+    }
+
+
+    Value Emitter::NewInstance(const runtime::Class& cls, const runtime::Method* init, const vector<string>& args)
+    {
+        const string holder = ClassName(RegisterClass(cls));
+        Value instance{ Temp("transpiled::NewInstance("s + holder + ')'), &cls, true };
+        if (init != nullptr)
+        {
+            vector<string> call_args{ instance.code };
+            call_args.insert(call_args.end(), args.begin(), args.end());
+            Line("transpiled::Invoke(context, &"s + methods_.at(init).name + ", "s + Join(call_args) + ");"s);
+        }
+        return instance;
+    }
+
+
+    Value Emitter::Invoke(const Call& call)
+    {
+        if (const MethodInfo* target = Resolve(call.object, call.method, call.args.size()))
+        {
+            vector<string> call_args{ call.object.code };
+            call_args.insert(call_args.end(), call.args.begin(), call.args.end());
+            return { Temp("transpiled::Invoke(context, &"s + target->name + ", "s + Join(call_args) + ')') };
+        }
+        return { Temp("transpiled::CallMethod(context, "s + call.object.code + ", "s + Symbol(call.method)
+            + ", { "s + Join(call.args) + " }, "s + Cache("transpiled::CallCache"sv) + ')') };
+    }
+
+
+    void Emitter::Return(const Value& value)
+    {
+        Line(function_.method != nullptr ? "return "s + value.code + ';' : "return;"s);
+    }
+
+
+    void Emitter::ReturnCall(const Call& call)
+    {
+        if (function_.method == nullptr)
+        {
+            Return(Invoke(call));
+            return;
+        }
+
+        // Известный класс self означает, что self не менялся, поэтому вызов, как и отложенный,
+        // выполняется у того же объекта и может начать функцию заново
+        if (call.object.code == Local(0) && Resolve(call.object, call.method, call.args.size()) == function_.method)
+        {
+            // Аргументы копируются до присваивания: они могут быть прежними параметрами
+            Open();
+            vector<string> next;
+            for (const string& arg : call.args)
+            {
+                next.push_back(Name("next"sv));
+                Line("ObjectHolder "s + next.back() + " = "s + arg + ';');
+            }
+            for (size_t i = 0; i < next.size(); ++i)
+                Line(Local(i + 1) + " = std::move("s + next[i] + ");"s);
+            Line("continue;"sv);
+            Close();
+            function_.loops = true;
+            return;
+        }
+
+        Line("return transpiled::DeferCall(context, "s + call.object.code + ", "s + Symbol(call.method) + ", { "s
+            + Join(call.args) + " }, "s + Cache("transpiled::CallCache"sv) + ");"s);
+    }
+
+
+    size_t Emitter::RegisterClass(const runtime::Class& cls)
+    {
+        if (auto it = class_indices_.find(&cls); it != class_indices_.end())
+            return it->second;
+        // Родитель создаётся раньше наследника
+        if (cls.GetParent() != nullptr)
+            RegisterClass(*cls.GetParent());
+
+        ClassInfo info{ &cls, {} };
+        cls.ForEachOwnMethod([&info](const runtime::Method& method) {
+            info.methods.push_back(&method);
+        });
+        sort(info.methods.begin(), info.methods.end(), [](const runtime::Method* lhs, const runtime::Method* rhs) {
+            return lhs->name.GetName() < rhs->name.GetName();
+        });
+        for (const runtime::Method* method : info.methods)
+        {
+            const size_t index = methods_.size();
+            methods_.emplace(method, MethodInfo{ "method_"s + to_string(index), index, &cls, method });
+        }
+
+        class_indices_.emplace(&cls, classes_.size());
+        classes_.push_back(move(info));
+        return classes_.size() - 1;
+    }
+
+
+    const Emitter::MethodInfo* Emitter::Resolve(const Value& object, runtime::Symbol method,
+        size_t argument_count) const
+    {
+        if (object.cls == nullptr)
+            return nullptr;
+        const runtime::Method* found = object.cls->GetMethod(method, argument_count);
+        if (found == nullptr)
+            return nullptr;
+
+        // Объект может оказаться экземпляром наследника, и метод не должен быть в нём переопределён
+        if (!object.exact)
+        {
+            for (const ClassInfo& info : classes_)
+            {
+                if (IsDerived(*info.cls, *object.cls) && info.cls->GetMethod(method) != found)
+                    return nullptr;
+            }
+        }
+
+        auto it = methods_.find(found);
+        return it != methods_.end() ? &it->second : nullptr;
+    }
+
+
+    string Emitter::Variable(runtime::Symbol name, optional<size_t> slot)
+    {
+        if (function_.method != nullptr)
+        {
+            if (!slot)
+                throw runtime_error("Emitter: variable "s + name.GetName() + " has no frame slot"s);
+            return Local(*slot);
+        }
+
+        auto [it, inserted] = globals_.emplace(name, "global_"s + to_string(globals_.size()));
+        if (inserted)
+            global_declarations_.push_back("std::optional<ObjectHolder> "s + it->second + ";  // "s + name.GetName());
+        return it->second;
+    }
+
+
+    bool Emitter::IsParameter(optional<size_t> slot) const
+    {
+        return function_.method != nullptr && slot && *slot <= function_.method->method->formal_params.size();
+    }
+
+
+    void Emitter::Learn(const string& variable, const Value& value)
+    {
+        auto [it, inserted] = function_.knowledge.emplace(variable, Value{ {}, value.cls, value.exact });
+        if (!inserted && (it->second.cls != value.cls || it->second.exact != value.exact))
+            it->second = Value{};
+    }
+
+
+    void Emitter::BeginFunction(const MethodInfo* method)
+    {
+        function_ = Function{};
+        function_.method = method;
+        if (method == nullptr)
+            return;
+
+        // self - экземпляр класса метода либо его наследника, о параметрах ничего не известно
+        function_.knowledge[Local(0)] = Value{ {}, method->owner, false };
+        for (size_t i = 1; i <= method->method->formal_params.size(); ++i)
+            function_.knowledge[Local(i)] = Value{};
+    }
+
+
+    string Emitter::EndFunction(string_view header)
+    {
+        const auto mentioned = [this](string_view name) {
+            return any_of(function_.lines.begin(), function_.lines.end(), [name](const CodeLine& line) {
+                return Mentions(line.text, name);
+            });
+        };
+
+        // Переменные объявляются в начале функции, а если она переходит в начало - в начале цикла
+        vector<string> variables;
+        if (function_.method == nullptr)
+        {
+            variables = global_declarations_;
+        }
+        else
+        {
+            for (size_t slot = function_.method->method->formal_params.size() + 1;
+                 slot < function_.method->method->frame_size; ++slot)
+                variables.push_back("std::optional<ObjectHolder> "s + Local(slot) + ';');
+        }
+
+        ostringstream out;
+        out << INDENT << header << '\n' << INDENT << "{\n"sv;
+        string indent = string(INDENT) + string(INDENT);
+        if (function_.loops)
+        {
+            out << indent << "for (;;)\n"sv << indent << "{\n"sv;
+            indent += INDENT;
+        }
+        for (const string& variable : variables)
+            out << indent << variable << '\n';
+        if (!variables.empty() && !function_.lines.empty())
+            out << '\n';
+        for (const CodeLine& line : function_.lines)
+        {
+            out << indent;
+            for (size_t i = 0; i < line.indent; ++i)
+                out << INDENT;
+            out << line.text << '\n';
+        }
+        if (function_.loops)
+            out << INDENT << INDENT << "}\n"sv;
+        out << INDENT << "}\n"sv;
+
+        // Неиспользуемые параметры помечаются, чтобы компилятор не предупреждал о них
+        string result = out.str();
+        const auto mark_unused = [&result](const string& param) {
+            const size_t pos = result.find(param);
+            result.insert(pos, "[[maybe_unused]] "sv);
+        };
+        if (!mentioned("context"sv))
+            mark_unused("Context& context"s);
+        if (function_.method != nullptr)
+        {
+            for (size_t i = 0; i <= function_.method->method->formal_params.size(); ++i)
+            {
+                if (!mentioned(Local(i)))
+                    mark_unused("ObjectHolder "s + Local(i));
+            }
+        }
+        return result;
+    }
+
+
+    void Emitter::EmitMethod(const MethodInfo& info)
+    {
+        auto* body = dynamic_cast<ast::Statement*>(info.method->body.get());
+        if (body == nullptr)
+            throw runtime_error("Emitter: method "s + Signature(*info.owner, *info.method) + " is not a syntax tree"s);
+
+        BeginFunction(&info);
+        Emit(body);
+        Line("return ObjectHolder::None();"sv);
+
+        string header = "ObjectHolder "s + info.name + "(Context& context"s;
+        for (size_t i = 0; i <= info.method->formal_params.size(); ++i)
+            header += ", ObjectHolder "s + Local(i);
+        header += ')';
+
+        method_code_.resize(methods_.size());
+        method_code_[info.index] = string(INDENT) + "// "s + Signature(*info.owner, *info.method) + '\n'
+            + EndFunction(header);
+    }
+
+
+    string Emitter::Literal(string_view text)
+    {
+        string result = "\""s;
+        for (const char c : text)
+        {
+            const auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (byte >= 0x20 && byte < 0x7f)
+            {
+                result += c;
+            }
+            else
+            {
+                // Восьмеричная запись занимает не больше трёх цифр и не поглощает следующие символы
+                result += '\\';
+                result += static_cast<char>('0' + (byte >> 6));
+                result += static_cast<char>('0' + ((byte >> 3) & 7));
+                result += static_cast<char>('0' + (byte & 7));
+            }
+        }
+        return result + '"';
+    }
+
+
+    string Emitter::ClassName(size_t index)
+    {
+        return "class_"s + to_string(index);
+    }
+
+
+
+    void Transpile(ast::Statement& program, ostream& out)
+    {
+        // Первый проход находит все классы программы. Второй уже знает, какие методы
+        // переопределяют наследники, и выбирает вызовы, которые можно выполнить напрямую
+        Emitter emitter;
+        emitter.EmitProgram(program);
+        emitter.EmitProgram(program);
+        emitter.Write(out);
+    }
+
+}  // namespace transpiler
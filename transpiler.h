@@ -0,0 +1,175 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace transpiler
+{
+
+    // Значение выражения в генерируемом коде
+    struct Value
+    {
+        // Выражение C++ типа runtime::ObjectHolder: константа, переменная либо временная переменная
+        std::string code;
+        // Класс объекта, если он известен при трансляции. Если exact равен true, объект -
+        // экземпляр именно этого класса, иначе - этого класса либо его наследника
+        const runtime::Class* cls = nullptr;
+        bool exact = false;
+    };
+
+    // Вызов метода method, объект и аргументы которого уже вычислены
+    struct Call
+    {
+        Value object;
+        runtime::Symbol method;
+        std::vector<std::string> args;
+    };
+
+
+
+    /*
+     * Переводит дерево программы Mython в исходный текст на C++. Полученная программа собирается
+     * вместе с runtime (см. transpiled.h) и выводит то же, что интерпретатор, в том числе при ошибках.
+     * Методы классов становятся функциями C++, переменные - переменными C++, а выражения -
+     * временными переменными в порядке вычисления узлов дерева.
+     * Если класс объекта известен при трансляции (self либо переменная, которой присваиваются
+     * только новые экземпляры одного класса), метод вызывается напрямую, без поиска по имени.
+     * Узлы дерева переводят себя методом Statement::Transpile, вызывая методы Emitter
+     */
+    class Emitter
+    {
+    public:
+        // Переводит программу program. Повторный вызов переводит её заново, уже зная все классы
+        // программы, и заменяет результат предыдущего
+        void EmitProgram(ast::Statement& program);
+        // Выводит исходный текст программы, переведённой EmitProgram
+        void Write(std::ostream& out) const;
+
+        // Переводит узел node и возвращает его значение
+        Value Emit(ast::Statement* node);
+
+        // Добавляет строку code в текущую функцию
+        void Line(std::string_view code);
+        // Открывает блок: добавляет строку header, если она не пуста, и открывающую скобку
+        void Open(std::string_view header = {});
+        void Close();
+
+        // Объявляет временную переменную со значением expression и возвращает её имя
+        std::string Temp(std::string_view expression);
+        // Объявляет временную переменную со значением None, которой присваивается результат
+        std::string Declare();
+        // Возвращает новое имя вспомогательной переменной текущей функции
+        std::string Name(std::string_view prefix);
+
+        // Возвращают выражения для символа name, строковой константы value
+        // и нового встроенного кеша типа type (например, ast::FieldCache)
+        std::string Symbol(runtime::Symbol name);
+        std::string String(std::string_view value);
+        std::string Cache(std::string_view type);
+
+        // Переменная name (в методе - ячейка slot кадра вызова)
+        Value ReadVariable(runtime::Symbol name, std::optional<size_t> slot);
+        void Assign(runtime::Symbol name, std::optional<size_t> slot, const Value& value);
+        void DefineClass(const runtime::Class& cls, std::optional<size_t> slot);
+
+        // Создаёт экземпляр класса cls и вызывает его метод init (если он есть) с аргументами args
+        Value NewInstance(const runtime::Class& cls, const runtime::Method* init, const std::vector<std::string>& args);
+        Value Invoke(const Call& call);
+
+        void Return(const Value& value);
+        // Инструкция return с вызовом метода. Рекурсивный вызов выполняемого метода у self
+        // становится переходом в начало функции, остальные откладываются как runtime::TailCall
+        void ReturnCall(const Call& call);
+
+    private:
+        struct CodeLine
+        {
+            size_t indent;
+            std::string text;
+        };
+
+        struct MethodInfo
+        {
+            // Имя функции C++ и её номер
+            std::string name;
+            size_t index;
+            const runtime::Class* owner;
+            const runtime::Method* method;
+        };
+
+        struct ClassInfo
+        {
+            const runtime::Class* cls;
+            // Собственные методы класса в порядке имён
+            std::vector<const runtime::Method*> methods;
+        };
+
+        // Функция C++, в которую переводится метод либо инструкции верхнего уровня программы
+        struct Function
+        {
+            // Переводимый метод либо nullptr для инструкций верхнего уровня
+            const MethodInfo* method = nullptr;
+            std::vector<CodeLine> lines;
+            size_t indent = 0;
+            size_t name_count = 0;
+            // Классы значений переменных по именам переменных C++ для присваиваний, переведённых
+            // до текущего места. Методы не содержат циклов, поэтому каждое чтение переменной
+            // получает значение одного из этих присваиваний
+            std::unordered_map<std::string, Value> knowledge;
+            // Функция переходит в начало (см. ReturnCall)
+            bool loops = false;
+        };
+
+        // Регистрирует класс cls, его родителей и методы. Возвращает номер класса
+        size_t RegisterClass(const runtime::Class& cls);
+        // Возвращает метод, который вызывается у любого объекта со значением object, либо nullptr
+        [[nodiscard]] const MethodInfo* Resolve(const Value& object, runtime::Symbol method,
+            size_t argument_count) const;
+
+        // Возвращает имя переменной C++ для переменной name
+        std::string Variable(runtime::Symbol name, std::optional<size_t> slot);
+        // Возвращает true, если переменная в ячейке slot всегда имеет значение (self и параметры)
+        [[nodiscard]] bool IsParameter(std::optional<size_t> slot) const;
+        // Учитывает присваивание значения value переменной variable
+        void Learn(const std::string& variable, const Value& value);
+
+        void BeginFunction(const MethodInfo* method);
+        // Возвращает текст функции с заголовком header
+        std::string EndFunction(std::string_view header);
+        void EmitMethod(const MethodInfo& info);
+
+        static std::string Literal(std::string_view text);
+        static std::string ClassName(size_t index);
+
+        // Сохраняются между вызовами EmitProgram
+        std::vector<ClassInfo> classes_;
+        std::unordered_map<const runtime::Class*, size_t> class_indices_;
+        std::unordered_map<const runtime::Method*, MethodInfo> methods_;
+
+        // Результат последнего вызова EmitProgram
+        std::vector<std::string> declarations_;
+        std::unordered_map<runtime::Symbol, std::string, runtime::SymbolHasher> symbols_;
+        std::unordered_map<std::string, std::string> strings_;
+        std::unordered_map<runtime::Symbol, std::string, runtime::SymbolHasher> globals_;
+        std::vector<std::string> global_declarations_;
+        size_t cache_count_ = 0;
+        std::vector<std::string> method_code_;
+        std::string program_code_;
+
+        Function function_;
+    };
+
+
+
+    // Переводит программу program (результат ParseProgram, в том числе упрощённый optimizer::Optimize)
+    // и выводит в out исходный текст программы на C++
+    void Transpile(ast::Statement& program, std::ostream& out);
+
+}  // namespace transpiler
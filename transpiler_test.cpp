@@ -0,0 +1,120 @@
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "transpiler.h"
+
+#include "test_runner.h"
+
+using namespace std;
+
+namespace transpiler
+{
+
+    namespace
+    {
+
+        string TranspileProgram(const string& program)
+        {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            ostringstream out;
+            Transpile(*optimizer::Optimize(ParseProgram(lexer)), out);
+            return out.str();
+        }
+
+        // Возвращает количество вхождений text в code
+        size_t Count(const string& code, const string& text)
+        {
+            size_t count = 0;
+            for (size_t pos = code.find(text); pos != string::npos; pos = code.find(text, pos + 1))
+                ++count;
+            return count;
+        }
+
+        void TestStaticDispatch()
+        {
+            const string code = TranspileProgram(R"(
+class Point:
+  def __init__(x):
+    self.x = x
+  def shift(dx):
+    self.x = self.x + dx
+    return self.get()
+  def get():
+    return self.x
+
+p = Point(1)
+print p.shift(2)
+)"s);
+            // Конструктор, p.shift и self.get вызываются напрямую, без поиска метода
+            ASSERT_EQUAL(Count(code, "transpiled::NewInstance(class_0)"s), 1U);
+            ASSERT_EQUAL(Count(code, "transpiled::Invoke(context, &method_"s), 2U);
+            ASSERT_EQUAL(Count(code, "transpiled::DeferCall("s), 1U);
+            ASSERT_EQUAL(Count(code, "transpiled::CallMethod("s), 0U);
+            ASSERT(code.find("int main(int argc, char* argv[])"s) != string::npos);
+        }
+
+        void TestDynamicDispatch()
+        {
+            const string code = TranspileProgram(R"(
+class Base:
+  def name():
+    return 'base'
+  def show():
+    print self.name()
+
+class Derived(Base):
+  def name():
+    return 'derived'
+
+x = Base()
+if x:
+  x = Derived()
+x.show()
+d = Derived()
+d.show()
+)"s);
+            // Класс x после if неизвестен, а self.name переопределён в наследнике
+            ASSERT_EQUAL(Count(code, "transpiled::CallMethod(context, "s), 2U);
+            ASSERT_EQUAL(Count(code, "transpiled::CheckObject("s), 1U);
+            // Метод show экземпляра Derived известен
+            ASSERT_EQUAL(Count(code, "transpiled::Invoke(context, &method_"s), 1U);
+        }
+
+        void TestSelfTailRecursion()
+        {
+            const string code = TranspileProgram(R"(
+class Counter:
+  def count(n, acc):
+    if n == 0:
+      return acc
+    return self.count(n - 1, acc + 1)
+
+c = Counter()
+print c.count(100000, 0)
+)"s);
+            // Рекурсивный вызов у self становится переходом в начало функции
+            ASSERT_EQUAL(Count(code, "for (;;)"s), 1U);
+            ASSERT_EQUAL(Count(code, "continue;"s), 1U);
+            ASSERT_EQUAL(Count(code, "transpiled::DeferCall("s), 0U);
+        }
+
+        void TestComparatorIsRejected()
+        {
+            ast::Comparison comparison(runtime::Less, make_unique<ast::NumericConst>(1),
+                make_unique<ast::NumericConst>(2));
+            Emitter emitter;
+            ASSERT_THROWS(emitter.EmitProgram(comparison), runtime_error);
+        }
+
+    }  // namespace
+
+    void RunTranspilerTests(TestRunner& tr)
+    {
+        RUN_TEST(tr, transpiler::TestStaticDispatch);
+        RUN_TEST(tr, transpiler::TestDynamicDispatch);
+        RUN_TEST(tr, transpiler::TestSelfTailRecursion);
+        RUN_TEST(tr, transpiler::TestComparatorIsRejected);
+    }
+
+}  // namespace transpiler